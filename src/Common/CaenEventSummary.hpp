@@ -0,0 +1,234 @@
+/**
+ * Per-event channel summaries of CAEN output files (as written by CaenFileWriterModule).
+ * Each data file gets a "<file>.sum" sidecar with one fixed-size record per event and channel
+ * stored in the file, so that events can be selected (skimmed) without reading the waveforms.
+ * The summaries are the minimum, maximum, position of the (first) maximum and sum of the y
+ * samples, and the mean and RMS of the baseline: the samples in a configured window.
+ *
+ * Layout, little-endian:
+ *   caen_event_summary_header | caen_event_summary_record[num_records]
+ * Records are in file order: by event, then by channel in the order of the event.
+ */
+
+#pragma once
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+struct caen_event_summary_record {
+  enum Flags : uint16_t {
+    Empty = 1,             // The channel has no samples; everything else is 0.
+    BaselineTruncated = 2, // The baseline window extends past the samples.
+  };
+  uint64_t event_number;
+  uint64_t timestamp;
+  uint64_t sum;
+  uint32_t argmax; // Index of the first sample equal to max.
+  uint32_t samples;
+  uint16_t channel;
+  uint16_t min;
+  uint16_t max;
+  uint16_t flags;
+  float baseline_mean;
+  float baseline_rms; // Standard deviation of the baseline samples.
+};
+
+struct caen_event_summary_header {
+  static constexpr char magic_value[8] = {'C', 'A', 'E', 'N', 'S', 'U', 'M', '1'};
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t baseline_start;   // First sample of the baseline window.
+  uint32_t baseline_samples; // Length of the baseline window.
+  uint64_t num_records;
+
+  bool valid() const {
+    return std::memcmp(magic, magic_value, sizeof(magic)) == 0 && version == 1 &&
+           record_size == sizeof(caen_event_summary_record);
+  }
+};
+
+namespace caen_event_summary_detail {
+
+struct reduction {
+  uint16_t min = UINT16_MAX;
+  uint16_t max = 0;
+  uint64_t sum = 0;
+};
+
+inline void reduce_scalar(const uint16_t *ys, std::size_t n, reduction &r) {
+  for (std::size_t i = 0; i != n; ++i) {
+    r.min = std::min(r.min, ys[i]);
+    r.max = std::max(r.max, ys[i]);
+    r.sum += ys[i];
+  }
+}
+
+inline std::size_t find_scalar(const uint16_t *ys, std::size_t begin, std::size_t n, uint16_t value) {
+  return static_cast<std::size_t>(std::find(ys + begin, ys + n, value) - ys);
+}
+
+#if defined(__SSE2__)
+// SSE2 has signed 16-bit min/max only: samples are biased by 0x8000 to compare them as signed.
+inline void reduce(const uint16_t *ys, std::size_t n, reduction &r) {
+  const __m128i bias = _mm_set1_epi16(static_cast<short>(0x8000));
+  const __m128i ones = _mm_set1_epi16(1);
+  __m128i vmin = _mm_set1_epi16(SHRT_MAX);
+  __m128i vmax = _mm_set1_epi16(SHRT_MIN);
+  const std::size_t vectors = n / 8;
+  int64_t biased_sum = 0;
+  for (std::size_t done = 0; done != vectors;) {
+    // Pairwise sums of biased samples fit 32-bit lanes for 2^14 vectors at least.
+    const std::size_t block_end = std::min(vectors, done + (std::size_t{1} << 14));
+    __m128i vsum = _mm_setzero_si128();
+    for (; done != block_end; ++done) {
+      const __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(ys) + done), bias);
+      vmin = _mm_min_epi16(vmin, v);
+      vmax = _mm_max_epi16(vmax, v);
+      vsum = _mm_add_epi32(vsum, _mm_madd_epi16(v, ones));
+    }
+    alignas(16) int32_t lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), vsum);
+    biased_sum += int64_t{lanes[0]} + lanes[1] + lanes[2] + lanes[3];
+  }
+  if (vectors != 0) {
+    alignas(16) int16_t mins[8], maxs[8];
+    _mm_store_si128(reinterpret_cast<__m128i *>(mins), vmin);
+    _mm_store_si128(reinterpret_cast<__m128i *>(maxs), vmax);
+    for (int i = 0; i != 8; ++i) {
+      r.min = std::min(r.min, static_cast<uint16_t>(mins[i] ^ 0x8000));
+      r.max = std::max(r.max, static_cast<uint16_t>(maxs[i] ^ 0x8000));
+    }
+    r.sum += static_cast<uint64_t>(biased_sum + int64_t{0x8000} * static_cast<int64_t>(vectors * 8));
+  }
+  reduce_scalar(ys + vectors * 8, n - vectors * 8, r);
+}
+
+inline std::size_t find(const uint16_t *ys, std::size_t n, uint16_t value) {
+  const __m128i v = _mm_set1_epi16(static_cast<short>(value));
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const int mask = _mm_movemask_epi8(
+        _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(ys + i)), v));
+    if (mask != 0) {
+      return i + static_cast<std::size_t>(__builtin_ctz(static_cast<unsigned>(mask))) / 2;
+    }
+  }
+  return find_scalar(ys, i, n, value);
+}
+#else
+inline void reduce(const uint16_t *ys, std::size_t n, reduction &r) { reduce_scalar(ys, n, r); }
+
+inline std::size_t find(const uint16_t *ys, std::size_t n, uint16_t value) {
+  return find_scalar(ys, 0, n, value);
+}
+#endif
+
+} // namespace caen_event_summary_detail
+
+/// Summarizes `n` samples of one channel. Event number and timestamp are left to the caller.
+inline caen_event_summary_record caen_summarize(uint16_t channel, const uint16_t *ys, std::size_t n,
+                                                uint32_t baseline_start, uint32_t baseline_samples) {
+  caen_event_summary_record rec{};
+  rec.channel = channel;
+  rec.samples = static_cast<uint32_t>(n);
+  if (n == 0) {
+    rec.flags = caen_event_summary_record::Empty;
+    return rec;
+  }
+  caen_event_summary_detail::reduction r;
+  caen_event_summary_detail::reduce(ys, n, r);
+  rec.min = r.min;
+  rec.max = r.max;
+  rec.sum = r.sum;
+  rec.argmax = static_cast<uint32_t>(caen_event_summary_detail::find(ys, n, r.max));
+
+  // The window is short; integer sums keep the variance exact.
+  const std::size_t begin = std::min<std::size_t>(baseline_start, n);
+  const std::size_t end = std::min<std::size_t>(std::size_t{baseline_start} + baseline_samples, n);
+  if (end - begin != baseline_samples) {
+    rec.flags |= caen_event_summary_record::BaselineTruncated;
+  }
+  if (end != begin) {
+    uint64_t sum = 0, sum_squares = 0;
+    for (std::size_t i = begin; i != end; ++i) {
+      sum += ys[i];
+      sum_squares += uint64_t{ys[i]} * ys[i];
+    }
+    const double count = static_cast<double>(end - begin);
+    const double mean = static_cast<double>(sum) / count;
+    const double variance = static_cast<double>(sum_squares) / count - mean * mean;
+    rec.baseline_mean = static_cast<float>(mean);
+    rec.baseline_rms = static_cast<float>(std::sqrt(std::max(variance, 0.0)));
+  }
+  return rec;
+}
+
+/// Summary records of one data file.
+class caen_event_summary {
+public:
+  std::vector<caen_event_summary_record> records;
+  uint32_t baseline_start = 0;
+  uint32_t baseline_samples = 0;
+
+  caen_event_summary() = default;
+  caen_event_summary(uint32_t start, uint32_t samples) : baseline_start(start), baseline_samples(samples) {}
+
+  /// Summarizes the samples of `channel` in event `event_number`.
+  void add(uint64_t event_number, uint64_t timestamp, uint16_t channel, const uint16_t *ys, std::size_t n) {
+    records.push_back(caen_summarize(channel, ys, n, baseline_start, baseline_samples));
+    records.back().event_number = event_number;
+    records.back().timestamp = timestamp;
+  }
+
+  bool empty() const { return records.empty(); }
+
+  void write(std::ostream &out) const {
+    caen_event_summary_header header{};
+    std::memcpy(header.magic, caen_event_summary_header::magic_value, sizeof(header.magic));
+    header.version = 1;
+    header.record_size = sizeof(caen_event_summary_record);
+    header.baseline_start = baseline_start;
+    header.baseline_samples = baseline_samples;
+    header.num_records = records.size();
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(records.data()),
+              static_cast<std::streamsize>(records.size() * sizeof(caen_event_summary_record)));
+  }
+
+  /// Reads the summaries of data file `filename` from its "<filename>.sum" sidecar.
+  static std::optional<caen_event_summary> read(const std::string &filename) {
+    std::ifstream in(filename + ".sum", std::ios::binary | std::ios::ate);
+    if (!in.is_open()) {
+      return std::nullopt;
+    }
+    const auto file_size = static_cast<uint64_t>(in.tellg());
+    caen_event_summary_header header{};
+    if (file_size < sizeof(header)) {
+      return std::nullopt;
+    }
+    in.seekg(0);
+    in.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (in.fail() || !header.valid() ||
+        sizeof(header) + header.num_records * sizeof(caen_event_summary_record) != file_size) {
+      return std::nullopt;
+    }
+    caen_event_summary ret(header.baseline_start, header.baseline_samples);
+    ret.records.resize(header.num_records);
+    in.read(reinterpret_cast<char *>(ret.records.data()),
+            static_cast<std::streamsize>(header.num_records * sizeof(caen_event_summary_record)));
+    if (in.fail()) {
+      return std::nullopt;
+    }
+    return ret;
+  }
+};
@@ -0,0 +1,120 @@
+/**
+ * Pulse features of CAEN events, as sent by CaenFeatureExtractorModule in place of the
+ * waveforms: one fixed-size record per pulse, with its amplitude, integral, time and width.
+ * A message holds the records of one event, in the order of the channels of the event, and
+ * serializes to a short header and a single memcpy of the records.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Utils/Ers.hpp"
+#include "SerializableFormat.hpp"
+
+using Binary = daqling::utilities::Binary;
+using std::size_t;
+
+struct caen_pulse_record {
+  enum Flags : uint16_t {
+    StartTruncated = 1, // The pulse region starts at the first sample of the channel.
+    EndTruncated = 2,   // The pulse region ends at the last sample of the channel.
+    TimeAtEdge = 4,     // No crossing of the timing level before the peak: time is the region start.
+    WidthAtEdge = 8,    // No half-maximum crossing on a side: width runs to the region edge.
+    Saturated = 16,     // The peak sample is at the end of the ADC range.
+    NoBaseline = 32,    // No samples in the baseline window: the baseline is 0.
+  };
+  uint16_t channel;
+  uint16_t flags;
+  uint32_t peak;    // x of the (first) peak sample.
+  uint32_t samples; // Length of the pulse region, padding included.
+  float baseline;   // Mean of the baseline window, in ADC counts.
+  float amplitude;  // Peak height above (below, for negative pulses) the baseline.
+  float integral;   // Sum over the pulse region of the samples above (below) the baseline.
+  float time;       // x where the pulse first crosses the timing level, interpolated.
+  float width;      // Full width at half maximum, in x units.
+};
+static_assert(sizeof(caen_pulse_record) == 32, "caen_pulse_record: unexpected padding.");
+static_assert(std::is_trivially_copyable_v<caen_pulse_record>);
+
+class caen_feature_data : public SerializableFormat {
+public:
+  using SerializableFormat::serialize;
+  using SerializableFormat::deserialize;
+
+  uint32_t event_number; // since device start
+  uint64_t timestamp;
+  std::string device;
+  std::vector<caen_pulse_record> pulses;
+  caen_feature_data() = default;
+  virtual ~caen_feature_data() = default;
+
+  caen_feature_data(const caen_feature_data &) = default;
+  caen_feature_data(caen_feature_data &&) noexcept = default;
+  caen_feature_data &operator=(const caen_feature_data &) = default;
+  caen_feature_data &operator=(caen_feature_data &&) noexcept = default;
+
+  void clear(void) noexcept override {
+    pulses.clear();
+    device.clear();
+    timestamp = 0;
+  }
+
+protected:
+  size_t serialize_size_hint() const override {
+    return sizeof(uint32_t) + sizeof(uint64_t) + 2 * sizeof(size_t) + device.size() +
+           pulses.size() * sizeof(caen_pulse_record);
+  }
+
+  size_t serialize(Binary &dataBuffer, size_t dest) const override {
+    size_t current_pos = dest;
+    size_t sz;
+    try {
+      current_pos = dataBuffer.memwrite(current_pos, reinterpret_cast<const void *>(&event_number), sizeof(uint32_t));
+      current_pos = dataBuffer.memwrite(current_pos, reinterpret_cast<const void *>(&timestamp), sizeof(uint64_t));
+
+      sz = device.length();
+      current_pos = dataBuffer.memwrite(current_pos, reinterpret_cast<const void *>(&sz), sizeof(size_t));
+      current_pos = dataBuffer.memwrite(current_pos, reinterpret_cast<const void *>(device.data()), sz * sizeof(char));
+
+      sz = pulses.size();
+      current_pos = dataBuffer.memwrite(current_pos, reinterpret_cast<const void *>(&sz), sizeof(size_t));
+      current_pos = dataBuffer.memwrite(current_pos, reinterpret_cast<const void *>(pulses.data()),
+                                        sz * sizeof(caen_pulse_record));
+      return current_pos;
+    } catch (const std::exception &e) {
+      ERS_WARNING(std::string("Serialization failed after byte #") + std::to_string(current_pos)
+            + ".\n" + e.what() + "\nData will not be sent.");
+      dataBuffer.clear();
+      return 0;
+    }
+  }
+
+  size_t deserialize(const Binary &dataBuffer, std::size_t dest) override {
+    size_t current_pos = dest;
+    size_t sz = 0;
+    try {
+      current_pos = dataBuffer.memread(current_pos, reinterpret_cast<void *>(&event_number), sizeof(uint32_t));
+      current_pos = dataBuffer.memread(current_pos, reinterpret_cast<void *>(&timestamp), sizeof(uint64_t));
+
+      current_pos = dataBuffer.memread(current_pos, reinterpret_cast<void *>(&sz), sizeof(size_t));
+      device.resize(sz);
+      current_pos = dataBuffer.memread(current_pos, reinterpret_cast<void *>(device.data()), sz * sizeof(char));
+
+      current_pos = dataBuffer.memread(current_pos, reinterpret_cast<void *>(&sz), sizeof(size_t));
+      pulses.resize(sz);
+      current_pos = dataBuffer.memread(current_pos, reinterpret_cast<void *>(pulses.data()),
+                                       sz * sizeof(caen_pulse_record));
+      return current_pos;
+    } catch (const std::exception &e) {
+      ERS_WARNING(std::string("De-serialization failed after byte #") + std::to_string(current_pos)
+            + ".\n" + e.what() + "\nData will not be recieved.");
+      clear();
+      return 0;
+    }
+  }
+};
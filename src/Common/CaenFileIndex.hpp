@@ -0,0 +1,185 @@
+/**
+ * Event index of CAEN output files (as written by CaenFileWriterModule).
+ * Event records in the output files are variable-length and, in binary formats, not
+ * self-delimiting, so finding an event would otherwise require parsing all the preceding ones.
+ * The index maps event numbers (and timestamps) to byte offsets of the records in one file.
+ *
+ * Layout, little-endian, appended to the end of binary files or written to a "<file>.idx"
+ * sidecar for text files (which are kept readable with text tools):
+ *   caen_file_index_entry[num_entries] | caen_file_index_trailer
+ * The trailer is fixed-size and always the last bytes of the file, so it is found by a single
+ * read; trailer.data_size is where the event data ends and (for footers) the entries start.
+ */
+
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct caen_file_index_entry {
+  uint64_t event_number;
+  uint64_t timestamp;
+  uint64_t offset; // of the event record from the beginning of the file
+};
+
+struct caen_file_index_trailer {
+  static constexpr char magic_value[8] = {'C', 'A', 'E', 'N', 'I', 'D', 'X', '1'};
+  char magic[8];
+  uint32_t version;
+  uint32_t entry_size;
+  uint64_t num_entries;
+  uint64_t timestamp_min;
+  uint64_t timestamp_max;
+  uint64_t data_size;
+
+  bool valid() const {
+    return std::memcmp(magic, magic_value, sizeof(magic)) == 0 && version == 1 &&
+           entry_size == sizeof(caen_file_index_entry);
+  }
+};
+
+class caen_file_index {
+public:
+  std::vector<caen_file_index_entry> entries;
+  uint64_t timestamp_min = std::numeric_limits<uint64_t>::max();
+  uint64_t timestamp_max = 0;
+  uint64_t data_size = 0; // Bytes of event data in the file.
+  bool timestamps_sorted = true; // Whether the entries are in non-decreasing timestamp order.
+
+  /// Records an event record of `size` bytes written at the current end of the file.
+  void add(uint64_t event_number, uint64_t timestamp, uint64_t size) {
+    if (!entries.empty() && timestamp < entries.back().timestamp) {
+      timestamps_sorted = false;
+    }
+    entries.push_back({event_number, timestamp, data_size});
+    timestamp_min = std::min(timestamp_min, timestamp);
+    timestamp_max = std::max(timestamp_max, timestamp);
+    data_size += size;
+  }
+
+  bool empty() const { return entries.empty(); }
+
+  void write(std::ostream &out) const {
+    caen_file_index_trailer trailer{};
+    std::memcpy(trailer.magic, caen_file_index_trailer::magic_value, sizeof(trailer.magic));
+    trailer.version = 1;
+    trailer.entry_size = sizeof(caen_file_index_entry);
+    trailer.num_entries = entries.size();
+    trailer.timestamp_min = timestamp_min;
+    trailer.timestamp_max = timestamp_max;
+    trailer.data_size = data_size;
+    out.write(reinterpret_cast<const char *>(entries.data()),
+              static_cast<std::streamsize>(entries.size() * sizeof(caen_file_index_entry)));
+    out.write(reinterpret_cast<const char *>(&trailer), sizeof(trailer));
+  }
+
+  /// Reads the index of `filename` from its footer or, failing that, from its sidecar file.
+  static std::optional<caen_file_index> read(const std::string &filename) {
+    if (auto ret = read_trailing(filename, true)) {
+      return ret;
+    }
+    return read_trailing(filename + ".idx", false);
+  }
+
+  /// Returns the offset of the record of `event_number`.
+  /// O(1) for consecutive event numbers, logarithmic otherwise.
+  std::optional<uint64_t> find_event(uint64_t event_number) const {
+    if (entries.empty() || event_number < entries.front().event_number) {
+      return std::nullopt;
+    }
+    const uint64_t guess = event_number - entries.front().event_number;
+    if (guess < entries.size() && entries[guess].event_number == event_number) {
+      return entries[guess].offset;
+    }
+    auto it = std::lower_bound(entries.begin(), entries.end(), event_number,
+                               [](const caen_file_index_entry &e, uint64_t n) { return e.event_number < n; });
+    if (it == entries.end() || it->event_number != event_number) {
+      // Event numbers may wrap or restart within a file; fall back to a scan.
+      it = std::find_if(entries.begin(), entries.end(),
+                        [event_number](const caen_file_index_entry &e) { return e.event_number == event_number; });
+      if (it == entries.end()) {
+        return std::nullopt;
+      }
+    }
+    return it->offset;
+  }
+
+  /// Returns the first (in file order) record with timestamp not earlier than `timestamp`.
+  /// Logarithmic if the timestamps are in order, linear otherwise.
+  std::optional<caen_file_index_entry> find_timestamp(uint64_t timestamp) const {
+    if (entries.empty() || timestamp > timestamp_max) {
+      return std::nullopt;
+    }
+    const auto it =
+        timestamps_sorted
+            ? std::lower_bound(entries.begin(), entries.end(), timestamp,
+                               [](const caen_file_index_entry &e, uint64_t t) { return e.timestamp < t; })
+            : std::find_if(entries.begin(), entries.end(),
+                           [timestamp](const caen_file_index_entry &e) { return e.timestamp >= timestamp; });
+    if (it == entries.end()) {
+      return std::nullopt;
+    }
+    return *it;
+  }
+
+  /// Positions `in` (an opened output file) at the record of `event_number`.
+  bool seek_event(std::istream &in, uint64_t event_number) const {
+    if (auto offset = find_event(event_number)) {
+      in.seekg(static_cast<std::streamoff>(*offset));
+      return !in.fail();
+    }
+    return false;
+  }
+
+  /// Positions `in` at the first record with timestamp not earlier than `timestamp`.
+  bool seek_timestamp(std::istream &in, uint64_t timestamp) const {
+    if (auto entry = find_timestamp(timestamp)) {
+      in.seekg(static_cast<std::streamoff>(entry->offset));
+      return !in.fail();
+    }
+    return false;
+  }
+
+private:
+  static std::optional<caen_file_index> read_trailing(const std::string &filename, bool is_footer) {
+    std::ifstream in(filename, std::ios::binary | std::ios::ate);
+    if (!in.is_open()) {
+      return std::nullopt;
+    }
+    const auto file_size = static_cast<uint64_t>(in.tellg());
+    caen_file_index_trailer trailer{};
+    if (file_size < sizeof(trailer)) {
+      return std::nullopt;
+    }
+    in.seekg(static_cast<std::streamoff>(file_size - sizeof(trailer)));
+    in.read(reinterpret_cast<char *>(&trailer), sizeof(trailer));
+    if (in.fail() || !trailer.valid()) {
+      return std::nullopt;
+    }
+    const uint64_t entries_start = is_footer ? trailer.data_size : 0;
+    if (entries_start + trailer.num_entries * sizeof(caen_file_index_entry) + sizeof(trailer) !=
+        file_size) {
+      return std::nullopt;
+    }
+    caen_file_index ret;
+    ret.entries.resize(trailer.num_entries);
+    in.seekg(static_cast<std::streamoff>(entries_start));
+    in.read(reinterpret_cast<char *>(ret.entries.data()),
+            static_cast<std::streamsize>(trailer.num_entries * sizeof(caen_file_index_entry)));
+    if (in.fail()) {
+      return std::nullopt;
+    }
+    ret.timestamps_sorted =
+        std::is_sorted(ret.entries.begin(), ret.entries.end(),
+                       [](const caen_file_index_entry &a, const caen_file_index_entry &b) { return a.timestamp < b.timestamp; });
+    ret.timestamp_min = trailer.timestamp_min;
+    ret.timestamp_max = trailer.timestamp_max;
+    ret.data_size = trailer.data_size;
+    return ret;
+  }
+};
@@ -0,0 +1,63 @@
+/**
+ * Formats and file layouts of CAEN output files (as written by CaenFileWriterModule).
+ * The record layout of each combination is described in CaenFileReader.hpp.
+ */
+
+#pragma once
+#include <cstddef>
+#include <optional>
+#include <string>
+
+/// Built-in record formats. The "Short" ones write only y data; use them only when x step is fixed.
+enum class caen_file_format { Binary, Text, BinaryShort, TextShort };
+
+/// How the data of one device (connection) is split into files.
+enum class caen_file_splitting {
+  FilePerDevice,      // All data from each connection (device) is congregated to single file.
+  FilePerDeviceHead,  // Same as FilePerDevice, but header event info is written to a separate file.
+  FilePerChannel,     // Data both from each connection (device) and from each channel in it is written to its own file.
+  FilePerChannelHead, // Same as FilePerChannel, but header event info is also written to separate file.
+};
+
+/// Accepts the names used in CaenFileWriterModule settings and run manifests.
+inline std::optional<caen_file_format> caen_file_format_from_string(const std::string &str) {
+  if (str == "Text" || str == "text" || str == "txt") {
+    return caen_file_format::Text;
+  } else if (str == "Binary" || str == "binary" || str == "bin") {
+    return caen_file_format::Binary;
+  } else if (str == "BinaryShort" || str == "binary short" || str == "bin short") {
+    return caen_file_format::BinaryShort;
+  } else if (str == "TextShort" || str == "text short" || str == "txt short") {
+    return caen_file_format::TextShort;
+  }
+  return std::nullopt;
+}
+
+inline std::optional<caen_file_splitting> caen_file_splitting_from_string(const std::string &str) {
+  if (str == "FilePerDevice" || str == "PerDevice" || str == "single") {
+    return caen_file_splitting::FilePerDevice;
+  } else if (str == "FilePerDeviceHead" || str == "PerDeviceHead" || str == "single+head") {
+    return caen_file_splitting::FilePerDeviceHead;
+  } else if (str == "FilePerChannel" || str == "PerChannel" || str == "channel") {
+    return caen_file_splitting::FilePerChannel;
+  } else if (str == "FilePerChannelHead" || str == "PerChannelHead" || str == "channel+head") {
+    return caen_file_splitting::FilePerChannelHead;
+  }
+  return std::nullopt;
+}
+
+/// Returns the file (of those of one device, in the order they are written) holding the samples
+/// of the channel at `position` in the event.
+inline std::size_t caen_channel_file(caen_file_splitting splitting, std::size_t position) {
+  switch (splitting) {
+  case caen_file_splitting::FilePerDevice:
+    return 0;
+  case caen_file_splitting::FilePerDeviceHead:
+    return 1;
+  case caen_file_splitting::FilePerChannel:
+    return position;
+  case caen_file_splitting::FilePerChannelHead:
+    return position + 1;
+  }
+  return 0;
+}
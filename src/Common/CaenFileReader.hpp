@@ -0,0 +1,441 @@
+/**
+ * Reader of CAEN output files (as written by CaenFileWriterModule).
+ * Files are memory mapped and events are iterated in place: samples of binary formats are
+ * viewed directly in the mapping, those of text formats are decoded into buffers reused from
+ * event to event. All FileSplitting layouts are supported; the files of one set (head and/or
+ * per-channel files) are read in step and joined back into whole events.
+ *
+ * Binary formats are sequences of native-endian fixed-width fields:
+ *   FilePerDevice:      u32 event_number, u64 timestamp, u64 nch, nch x channel record
+ *                       where channel record = u16 channel, [u64 nx, nx x T], u64 ny, ny x T
+ *   FilePerDeviceHead:  head file: u32 event_number, u64 timestamp
+ *                       data file: u64 nch, nch x channel record
+ *   FilePerChannel:     per file:  u32 event_number, u64 timestamp, [u64 nx, nx x T], u64 ny, ny x T
+ *   FilePerChannelHead: head file: u32 event_number, u64 timestamp
+ *                       per file:  [u64 nx, nx x T], u64 ny, ny x T
+ * where [] are omitted by the "Short" formats. Text formats hold the same fields one per line
+ * (samples tab-separated on one line, events terminated by an empty line), with the device name
+ * after the timestamp in head files and per-channel files.
+ * An index footer (see CaenFileIndex.hpp) at the end of a file is not part of its event data.
+ */
+
+#pragma once
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CaenFileIndex.hpp"
+#include "CaenFileLayout.hpp"
+
+/// Read-only memory mapping of a whole file.
+class caen_mapped_file {
+public:
+  explicit caen_mapped_file(const std::string &filename) : m_filename(filename) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("Could not open '" + filename + "'");
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw std::runtime_error("Could not stat '" + filename + "'");
+    }
+    m_file_size = static_cast<size_t>(st.st_size);
+    if (m_file_size != 0) {
+      void *addr = ::mmap(nullptr, m_file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr == MAP_FAILED) { // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+        ::close(fd);
+        throw std::runtime_error("Could not map '" + filename + "'");
+      }
+      ::madvise(addr, m_file_size, MADV_SEQUENTIAL);
+      m_data = static_cast<const char *>(addr);
+    }
+    ::close(fd);
+    m_index = caen_file_index::read(filename);
+    m_size = m_file_size;
+    if (m_index && m_index->data_size <= m_file_size) {
+      m_size = m_index->data_size;
+    }
+  }
+
+  ~caen_mapped_file() {
+    if (m_data != nullptr) {
+      ::munmap(const_cast<char *>(m_data), m_file_size);
+    }
+  }
+
+  caen_mapped_file(const caen_mapped_file &) = delete;
+  caen_mapped_file &operator=(const caen_mapped_file &) = delete;
+  caen_mapped_file(caen_mapped_file &&other) noexcept
+      : m_filename(std::move(other.m_filename)), m_data(other.m_data),
+        m_file_size(other.m_file_size), m_size(other.m_size), m_index(std::move(other.m_index)) {
+    other.m_data = nullptr;
+  }
+  caen_mapped_file &operator=(caen_mapped_file &&) = delete;
+
+  const std::string &filename() const { return m_filename; }
+  /// Event data, without the index footer.
+  const char *data() const { return m_data; }
+  size_t size() const { return m_size; }
+  const std::optional<caen_file_index> &index() const { return m_index; }
+
+private:
+  std::string m_filename;
+  const char *m_data = nullptr;
+  size_t m_file_size = 0;
+  size_t m_size = 0;
+  std::optional<caen_file_index> m_index;
+};
+
+/// Samples of a channel. Not necessarily aligned, hence accessed by value.
+template <class T> struct caen_samples {
+  const char *data = nullptr;
+  size_t size = 0;
+  T operator[](size_t i) const {
+    T value;
+    std::memcpy(&value, data + i * sizeof(T), sizeof(T));
+    return value;
+  }
+};
+
+/// One event; valid until the next call to caen_file_reader::next().
+template <class T> struct caen_event_view {
+  struct channel {
+    uint16_t channel;
+    caen_samples<T> xs; // Empty for "Short" formats.
+    caen_samples<T> ys;
+  };
+  uint64_t event_number = 0;
+  uint64_t timestamp = 0;
+  std::string_view device; // Empty if the layout does not store it.
+  std::vector<channel> channels;
+};
+
+template <class T = uint16_t> class caen_file_reader {
+public:
+  /// `files` as generated by the writer for one set: the head file first, if any.
+  /// `channels` are the CAEN channels of per-channel files (they are not stored in the files
+  /// themselves); their positions are used if not given.
+  caen_file_reader(const std::vector<std::string> &files, caen_file_format format,
+                   caen_file_splitting splitting, std::vector<uint16_t> channels = {})
+      : m_text(format == caen_file_format::Text || format == caen_file_format::TextShort),
+        m_short(format == caen_file_format::BinaryShort || format == caen_file_format::TextShort),
+        m_splitting(splitting), m_channels(std::move(channels)) {
+    const bool has_head = splitting == caen_file_splitting::FilePerDeviceHead ||
+                          splitting == caen_file_splitting::FilePerChannelHead;
+    const bool per_device = splitting == caen_file_splitting::FilePerDevice ||
+                            splitting == caen_file_splitting::FilePerDeviceHead;
+    const size_t min_files = has_head ? 2 : 1;
+    if (per_device ? files.size() != min_files : files.size() < min_files) {
+      throw std::runtime_error("Wrong number of files for the file splitting");
+    }
+    if (!per_device && !m_channels.empty() && m_channels.size() != files.size() - (has_head ? 1 : 0)) {
+      throw std::runtime_error("Number of channels does not match the number of per-channel files");
+    }
+    m_files.reserve(files.size());
+    for (const auto &f : files) {
+      m_files.emplace_back(f);
+      m_cursors.push_back({m_files.back().data(), m_files.back().data() + m_files.back().size()});
+    }
+    if (!per_device && m_channels.empty()) {
+      for (size_t i = 0, n = files.size() - (has_head ? 1 : 0); i != n; ++i) {
+        m_channels.push_back(static_cast<uint16_t>(i));
+      }
+    }
+  }
+
+  /// Reads the next event. Returns false at the end of the files or on error (see error()).
+  bool next(caen_event_view<T> &event) {
+    if (!m_error.empty()) {
+      return false;
+    }
+    size_t at_end = 0;
+    for (const auto &c : m_cursors) {
+      at_end += c.pos == c.end ? 1 : 0;
+    }
+    if (at_end == m_cursors.size()) {
+      return false;
+    }
+    if (at_end != 0) {
+      return fail("files of the set end at different events");
+    }
+    event.device = {};
+    m_ch_count = 0;
+    bool ok = false;
+    switch (m_splitting) {
+    case caen_file_splitting::FilePerDevice:
+      ok = read_header(m_cursors[0], event, false) && read_device_channels(m_cursors[0]);
+      break;
+    case caen_file_splitting::FilePerDeviceHead:
+      ok = read_header(m_cursors[0], event, true) && read_device_channels(m_cursors[1]);
+      break;
+    case caen_file_splitting::FilePerChannel:
+      ok = true;
+      for (size_t i = 0; ok && i != m_cursors.size(); ++i) {
+        const uint64_t event_number = event.event_number;
+        ok = read_header(m_cursors[i], event, true) && read_channel(m_cursors[i], m_channels[i]) &&
+             (!m_text || read_end(m_cursors[i]));
+        if (ok && i != 0 && event.event_number != event_number) {
+          return fail("per-channel files are out of step");
+        }
+      }
+      break;
+    case caen_file_splitting::FilePerChannelHead:
+      ok = read_header(m_cursors[0], event, true) && (!m_text || read_end(m_cursors[0]));
+      for (size_t i = 1; ok && i != m_cursors.size(); ++i) {
+        ok = read_channel(m_cursors[i], m_channels[i - 1]) && (!m_text || read_end(m_cursors[i]));
+      }
+      break;
+    }
+    if (!ok) {
+      return false;
+    }
+    fill_view(event);
+    ++m_events_read;
+    return true;
+  }
+
+  /// Empty unless reading stopped because of malformed data.
+  const std::string &error() const { return m_error; }
+
+  /// Number of events listed by the indexes of all files; 0 if any file is not indexed.
+  size_t indexed_events() const {
+    size_t ret = SIZE_MAX;
+    for (const auto &f : m_files) {
+      ret = f.index() ? std::min(ret, f.index()->entries.size()) : 0;
+    }
+    return ret;
+  }
+
+  /// Positions all files at the `entry`-th indexed event.
+  bool seek_entry(size_t entry) {
+    if (entry >= indexed_events()) {
+      return false;
+    }
+    for (size_t i = 0; i != m_files.size(); ++i) {
+      const uint64_t offset = m_files[i].index()->entries[entry].offset;
+      if (offset > m_files[i].size()) {
+        return false;
+      }
+      m_cursors[i].pos = m_files[i].data() + offset;
+    }
+    m_error.clear();
+    return true;
+  }
+
+  /// Offset of the next event in file `i`.
+  uint64_t offset(size_t i) const { return static_cast<uint64_t>(m_cursors[i].pos - m_files[i].data()); }
+
+  const std::vector<caen_mapped_file> &files() const { return m_files; }
+  size_t events_read() const { return m_events_read; }
+
+private:
+  struct cursor {
+    const char *pos;
+    const char *end;
+  };
+  struct channel_buffers {
+    uint16_t channel = 0;
+    caen_samples<T> xs, ys;
+    std::vector<T> xs_text, ys_text;
+  };
+
+  bool fail(const std::string &what) {
+    m_error = what + " (event #" + std::to_string(m_events_read) + " of the set)";
+    return false;
+  }
+
+  // Binary fields
+
+  template <class V> bool take(cursor &c, V &value) {
+    if (static_cast<size_t>(c.end - c.pos) < sizeof(V)) {
+      return fail("file is truncated");
+    }
+    std::memcpy(&value, c.pos, sizeof(V));
+    c.pos += sizeof(V);
+    return true;
+  }
+
+  bool take_samples(cursor &c, caen_samples<T> &samples) {
+    uint64_t n = 0;
+    if (!take(c, n)) {
+      return false;
+    }
+    if (n > static_cast<size_t>(c.end - c.pos) / sizeof(T)) {
+      return fail("sample count exceeds the file");
+    }
+    samples.data = c.pos;
+    samples.size = n;
+    c.pos += n * sizeof(T);
+    return true;
+  }
+
+  // Text lines
+
+  bool line(cursor &c, std::string_view &ret) {
+    if (c.pos == c.end) {
+      return fail("file is truncated");
+    }
+    const char *eol = static_cast<const char *>(std::memchr(c.pos, '\n', static_cast<size_t>(c.end - c.pos)));
+    if (eol == nullptr) {
+      return fail("unterminated line");
+    }
+    ret = std::string_view(c.pos, static_cast<size_t>(eol - c.pos));
+    c.pos = eol + 1;
+    return true;
+  }
+
+  template <class V> bool parse_line(cursor &c, V &value) {
+    std::string_view l;
+    if (!line(c, l)) {
+      return false;
+    }
+    auto res = std::from_chars(l.data(), l.data() + l.size(), value);
+    if (res.ec != std::errc() || res.ptr != l.data() + l.size()) {
+      return fail("malformed number '" + std::string(l) + "'");
+    }
+    return true;
+  }
+
+  bool parse_samples(cursor &c, std::vector<T> &values) {
+    std::string_view l;
+    if (!line(c, l)) {
+      return false;
+    }
+    values.clear();
+    const char *p = l.data(), *end = l.data() + l.size();
+    while (p != end) {
+      T value{};
+      auto res = std::from_chars(p, end, value);
+      if (res.ec != std::errc()) {
+        return fail("malformed sample line");
+      }
+      values.push_back(value);
+      p = res.ptr;
+      while (p != end && (*p == '\t' || *p == ' ')) {
+        ++p;
+      }
+    }
+    return true;
+  }
+
+  bool read_end(cursor &c) {
+    std::string_view l;
+    if (!line(c, l)) {
+      return false;
+    }
+    return l.empty() || fail("missing end of event");
+  }
+
+  // Records
+
+  bool read_header(cursor &c, caen_event_view<T> &event, bool with_device) {
+    if (!m_text) {
+      uint32_t event_number = 0;
+      uint64_t timestamp = 0;
+      if (!take(c, event_number) || !take(c, timestamp)) {
+        return false;
+      }
+      event.event_number = event_number;
+      event.timestamp = timestamp;
+      return true;
+    }
+    if (!parse_line(c, event.event_number) || !parse_line(c, event.timestamp)) {
+      return false;
+    }
+    if (with_device) {
+      std::string_view device;
+      if (!line(c, device)) {
+        return false;
+      }
+      event.device = device;
+    }
+    return true;
+  }
+
+  channel_buffers &next_channel(uint16_t channel) {
+    if (m_ch_count == m_buffers.size()) {
+      m_buffers.emplace_back();
+    }
+    channel_buffers &ret = m_buffers[m_ch_count++];
+    ret.channel = channel;
+    ret.xs = {};
+    ret.ys = {};
+    return ret;
+  }
+
+  bool read_samples(cursor &c, channel_buffers &ch) {
+    if (!m_text) {
+      return (m_short || take_samples(c, ch.xs)) && take_samples(c, ch.ys);
+    }
+    return (m_short || parse_samples(c, ch.xs_text)) && parse_samples(c, ch.ys_text);
+  }
+
+  bool read_channel(cursor &c, uint16_t channel) { return read_samples(c, next_channel(channel)); }
+
+  bool read_device_channels(cursor &c) {
+    if (!m_text) {
+      uint64_t nch = 0;
+      if (!take(c, nch)) {
+        return false;
+      }
+      for (uint64_t i = 0; i != nch; ++i) {
+        uint16_t channel = 0;
+        if (!take(c, channel) || !read_channel(c, channel)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    while (true) {
+      std::string_view l;
+      if (!line(c, l)) {
+        return false;
+      }
+      if (l.empty()) {
+        return true;
+      }
+      uint16_t channel = 0;
+      auto res = std::from_chars(l.data(), l.data() + l.size(), channel);
+      if (res.ec != std::errc() || res.ptr != l.data() + l.size()) {
+        return fail("malformed channel '" + std::string(l) + "'");
+      }
+      if (!read_channel(c, channel)) {
+        return false;
+      }
+    }
+  }
+
+  void fill_view(caen_event_view<T> &event) {
+    event.channels.resize(m_ch_count);
+    for (size_t i = 0; i != m_ch_count; ++i) {
+      channel_buffers &b = m_buffers[i];
+      if (m_text) {
+        b.xs = {reinterpret_cast<const char *>(b.xs_text.data()), m_short ? 0 : b.xs_text.size()};
+        b.ys = {reinterpret_cast<const char *>(b.ys_text.data()), b.ys_text.size()};
+      }
+      event.channels[i] = {b.channel, b.xs, b.ys};
+    }
+  }
+
+  const bool m_text;
+  const bool m_short;
+  const caen_file_splitting m_splitting;
+  std::vector<uint16_t> m_channels;
+  std::vector<caen_mapped_file> m_files;
+  std::vector<cursor> m_cursors;
+  std::vector<channel_buffers> m_buffers;
+  size_t m_ch_count = 0;
+  size_t m_events_read = 0;
+  std::string m_error;
+};
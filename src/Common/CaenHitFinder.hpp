@@ -0,0 +1,82 @@
+/**
+ * Hit finding in CAEN waveforms (caen_output_data samples): the runs of consecutive samples
+ * outside a band [low, high] around the baseline. Used by the zero suppression and feature
+ * extraction modules.
+ * Samples are compared 8 at a time with SSE2; a block without a change of state (all in or all
+ * out of a run) costs one comparison and one mask test. A scalar loop handles the tail, and
+ * everything without SSE2.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/// Samples [begin, end) of a waveform.
+struct caen_sample_range {
+  uint32_t begin;
+  uint32_t end;
+};
+
+/// Replaces `runs` by the runs of samples of `ys` which are above `high` or below `low`.
+inline void caen_find_hits(const uint16_t *ys, std::size_t n, uint16_t low, uint16_t high,
+                           std::vector<caen_sample_range> &runs) {
+  runs.clear();
+  bool in_run = false;
+  uint32_t begin = 0;
+  const auto step = [&](uint32_t i, bool hit) {
+    if (hit != in_run) {
+      if (hit) {
+        begin = i;
+      } else {
+        runs.push_back({begin, i});
+      }
+      in_run = hit;
+    }
+  };
+  std::size_t i = 0;
+#if defined(__SSE2__)
+  // SSE2 compares signed 16-bit lanes only: samples and bounds are biased by 0x8000.
+  const __m128i bias = _mm_set1_epi16(static_cast<short>(0x8000));
+  const __m128i vlow = _mm_set1_epi16(static_cast<short>(low ^ 0x8000));
+  const __m128i vhigh = _mm_set1_epi16(static_cast<short>(high ^ 0x8000));
+  for (; i + 8 <= n; i += 8) {
+    const __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(ys + i)), bias);
+    const __m128i hits = _mm_or_si128(_mm_cmpgt_epi16(v, vhigh), _mm_cmplt_epi16(v, vlow));
+    // One bit per sample.
+    const auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_packs_epi16(hits, _mm_setzero_si128())));
+    if (mask == (in_run ? 0xFFu : 0u)) {
+      continue;
+    }
+    for (unsigned lane = 0; lane != 8; ++lane) {
+      step(static_cast<uint32_t>(i + lane), ((mask >> lane) & 1u) != 0);
+    }
+  }
+#endif
+  for (; i != n; ++i) {
+    step(static_cast<uint32_t>(i), ys[i] > high || ys[i] < low);
+  }
+  if (in_run) {
+    runs.push_back({begin, static_cast<uint32_t>(n)});
+  }
+}
+
+/// Replaces `kept` by `runs` widened by `pre` samples before and `post` after (within the `n`
+/// samples), merging those which then overlap or touch.
+inline void caen_pad_hits(const std::vector<caen_sample_range> &runs, std::size_t n, uint32_t pre,
+                          uint32_t post, std::vector<caen_sample_range> &kept) {
+  kept.clear();
+  for (const auto &run : runs) {
+    const uint32_t begin = run.begin - (run.begin < pre ? run.begin : pre);
+    const uint64_t padded_end = uint64_t{run.end} + post;
+    const auto end = static_cast<uint32_t>(padded_end < n ? padded_end : n);
+    if (!kept.empty() && begin <= kept.back().end) {
+      kept.back().end = end > kept.back().end ? end : kept.back().end;
+    } else {
+      kept.push_back({begin, end});
+    }
+  }
+}
@@ -0,0 +1,120 @@
+/**
+ * Interleaved output files of FileWriterModule ("interleaved" setting), which hold the payloads
+ * of all channels of the module as framed records, in the order they were written:
+ *   interleaved_record_header | payload (header.size bytes)
+ * Headers are native-endian and not aligned. Records are self-delimiting, so a file cut short
+ * (e.g. by a crash) is readable up to its last complete record, and reading the records of one
+ * channel only touches the headers of the others.
+ */
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct interleaved_record_header {
+  static constexpr uint32_t magic_value = 0x31524c44; // "DLR1"
+  uint32_t magic;
+  uint32_t reserved;
+  uint64_t chid;
+  uint64_t size; // of the payload
+};
+
+struct interleaved_record {
+  uint64_t chid;
+  uint64_t offset; // of the payload from the beginning of the file
+  const char *data;
+  size_t size;
+};
+
+/// Iterates the records of a memory mapped interleaved file.
+class interleaved_file_reader {
+public:
+  explicit interleaved_file_reader(const std::string &filename) : m_filename(filename) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("Could not open '" + filename + "'");
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw std::runtime_error("Could not stat '" + filename + "'");
+    }
+    m_size = static_cast<size_t>(st.st_size);
+    if (m_size != 0) {
+      void *addr = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr == MAP_FAILED) { // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+        ::close(fd);
+        throw std::runtime_error("Could not map '" + filename + "'");
+      }
+      ::madvise(addr, m_size, MADV_SEQUENTIAL);
+      m_data = static_cast<const char *>(addr);
+    }
+    ::close(fd);
+  }
+
+  ~interleaved_file_reader() {
+    if (m_data != nullptr) {
+      ::munmap(const_cast<char *>(m_data), m_size);
+    }
+  }
+
+  interleaved_file_reader(const interleaved_file_reader &) = delete;
+  interleaved_file_reader &operator=(const interleaved_file_reader &) = delete;
+
+  /// Returns the next record, or nullopt at the end of the file or at a corrupt record
+  /// (see error()).
+  std::optional<interleaved_record> next() {
+    if (m_pos == m_size || !m_error.empty()) {
+      return std::nullopt;
+    }
+    interleaved_record_header header{};
+    if (m_size - m_pos < sizeof(header)) {
+      return fail("truncated record header");
+    }
+    std::memcpy(&header, m_data + m_pos, sizeof(header));
+    if (header.magic != interleaved_record_header::magic_value) {
+      return fail("bad record header");
+    }
+    const size_t payload = m_pos + sizeof(header);
+    if (header.size > m_size - payload) {
+      return fail("truncated payload");
+    }
+    m_pos = payload + header.size;
+    return interleaved_record{header.chid, payload, m_data + payload, header.size};
+  }
+
+  /// Returns the next record of channel `chid`.
+  std::optional<interleaved_record> next(uint64_t chid) {
+    while (auto record = next()) {
+      if (record->chid == chid) {
+        return record;
+      }
+    }
+    return std::nullopt;
+  }
+
+  /// Empty unless reading stopped at a corrupt record.
+  const std::string &error() const { return m_error; }
+
+  const std::string &filename() const { return m_filename; }
+
+private:
+  std::optional<interleaved_record> fail(const std::string &what) {
+    m_error = m_filename + ": " + what + " at offset " + std::to_string(m_pos);
+    return std::nullopt;
+  }
+
+  std::string m_filename;
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+  size_t m_pos = 0;
+  std::string m_error;
+};
@@ -0,0 +1,416 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * caen_scan
+ * Description: Validates, counts, dumps or converts CaenFileWriterModule output files using
+ *   several threads. The file sets are taken from a run manifest or given on the command line;
+ *   sets with an event index are additionally split into event ranges scanned in parallel.
+ * Date: October 2026
+ */
+
+#include "Common/CaenFileReader.hpp"
+#include "Utils/CommandlineInterpreter.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include <nlohmann/json.hpp>
+
+namespace {
+
+using Reader = caen_file_reader<uint16_t>;
+using Event = caen_event_view<uint16_t>;
+
+struct FileSet {
+  std::vector<std::string> files;
+  caen_file_format format = caen_file_format::BinaryShort;
+  caen_file_splitting splitting = caen_file_splitting::FilePerDevice;
+  std::vector<uint16_t> channels;
+  std::optional<nlohmann::json> manifest_entry;
+};
+
+struct Unit {
+  size_t set;
+  size_t part;
+  size_t first_entry; // Of the index; 0 for whole sets.
+  size_t num_events;  // SIZE_MAX for all events to the end of the set.
+  // Dumped straight to stdout by the main thread when its turn comes, rather than buffered by a
+  // worker: whole sets may be many GB.
+  bool stream = false;
+};
+
+struct UnitResult {
+  size_t events = 0;
+  size_t bytes = 0;
+  uint64_t first_event = UINT64_MAX;
+  uint64_t last_event = 0;
+  uint64_t timestamp_min = UINT64_MAX;
+  uint64_t timestamp_max = 0;
+  std::vector<std::string> errors;
+  std::string output; // Dumped events, unless streamed
+};
+
+struct Options {
+  std::string mode = "validate";
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t chunk = 100000;
+  std::string output_dir = ".";
+  bool to_text = true;
+  bool to_short = false;
+};
+
+void usage() {
+  std::cerr
+      << "Usage: caen_scan (--manifest <run manifest> | --files <file>[,<file>...] --format <format> "
+         "--splitting <file splitting> [--channels <ch>[,<ch>...]])\n"
+         "                 [--mode validate|count|dump|convert] [--threads <n>] [--chunk <events>]\n"
+         "                 [--output <directory>] [--to Text|Binary|TextShort|BinaryShort]\n";
+}
+
+std::vector<std::string> split(const std::string &str) {
+  std::vector<std::string> ret;
+  std::stringstream ss(str);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (!item.empty()) {
+      ret.push_back(item);
+    }
+  }
+  return ret;
+}
+
+std::vector<FileSet> load_manifest(const std::string &filename) {
+  std::vector<FileSet> ret;
+  std::ifstream in(filename);
+  if (!in.is_open()) {
+    throw std::runtime_error("Could not open manifest '" + filename + "'");
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    auto entry = nlohmann::json::parse(line);
+    FileSet set;
+    set.files = entry.at("files").get<std::vector<std::string>>();
+    set.channels = entry.at("channels").get<std::vector<uint16_t>>();
+    auto format = caen_file_format_from_string(entry.at("format"));
+    auto splitting = caen_file_splitting_from_string(entry.at("file_splitting"));
+    if (!format || !splitting) {
+      throw std::runtime_error("Unknown format in manifest entry: " + line);
+    }
+    set.format = *format;
+    set.splitting = *splitting;
+    set.manifest_entry = std::move(entry);
+    ret.push_back(std::move(set));
+  }
+  return ret;
+}
+
+void dump_event(std::ostream &out, const Event &event) {
+  out << "event " << event.event_number << " timestamp " << event.timestamp;
+  if (!event.device.empty()) {
+    out << " device " << event.device;
+  }
+  out << "\n";
+  for (const auto &ch : event.channels) {
+    out << "  channel " << ch.channel << "\n";
+    for (const auto *samples : {&ch.xs, &ch.ys}) {
+      if (samples->size == 0) {
+        continue;
+      }
+      out << (samples == &ch.xs ? "    xs" : "    ys");
+      for (size_t i = 0; i != samples->size; ++i) {
+        out << ' ' << (*samples)[i];
+      }
+      out << "\n";
+    }
+  }
+}
+
+// Same layout as CaenFileWriterModule writes with FileSplitting::FilePerDevice.
+void convert_event(std::ostream &out, const Event &event, bool text, bool is_short) {
+  const auto raw = [&out](const auto &value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+  };
+  if (text) {
+    out << event.event_number << "\n" << event.timestamp << "\n";
+  } else {
+    raw(static_cast<uint32_t>(event.event_number));
+    raw(event.timestamp);
+    raw(static_cast<uint64_t>(event.channels.size()));
+  }
+  for (const auto &ch : event.channels) {
+    if (text) {
+      out << ch.channel << "\n";
+    } else {
+      raw(ch.channel);
+    }
+    for (const auto *samples : {&ch.xs, &ch.ys}) {
+      if (is_short && samples == &ch.xs) {
+        continue;
+      }
+      if (text) {
+        for (size_t i = 0; i != samples->size; ++i) {
+          out << (i == 0 ? "" : "\t") << (*samples)[i];
+        }
+        out << "\n";
+      } else {
+        raw(static_cast<uint64_t>(samples->size));
+        out.write(samples->data, static_cast<std::streamsize>(samples->size * sizeof(uint16_t)));
+      }
+    }
+  }
+  if (text) {
+    out << "\n";
+  }
+}
+
+/// Scans the events of `unit`. Dumped events go to `stream` if given, to the result otherwise.
+UnitResult scan(const FileSet &set, const Unit &unit, const Options &opt, std::ostream *stream = nullptr) {
+  UnitResult res;
+  try {
+    Reader reader(set.files, set.format, set.splitting, set.channels);
+    if (unit.first_entry != 0 && !reader.seek_entry(unit.first_entry)) {
+      res.errors.push_back("could not seek to indexed event #" + std::to_string(unit.first_entry));
+      return res;
+    }
+    std::ofstream converted;
+    if (opt.mode == "convert") {
+      std::filesystem::path name = std::filesystem::path(set.files.back()).stem();
+      name += "_part" + std::to_string(unit.part) + (opt.to_text ? ".txt" : ".dat");
+      converted.open(std::filesystem::path(opt.output_dir) / name, std::ios::binary | std::ios::trunc);
+      if (!converted.is_open()) {
+        res.errors.push_back("could not create output file '" + name.string() + "'");
+        return res;
+      }
+    }
+    std::ostringstream dumped;
+    const bool validate = opt.mode == "validate";
+    const size_t num_files = reader.files().size();
+    std::vector<uint64_t> begin(num_files), start(num_files);
+    for (size_t i = 0; i != num_files; ++i) {
+      begin[i] = reader.offset(i);
+    }
+    Event event;
+    while (res.events != unit.num_events) {
+      const size_t entry = unit.first_entry + res.events;
+      for (size_t i = 0; i != num_files; ++i) {
+        start[i] = reader.offset(i);
+      }
+      if (!reader.next(event)) {
+        break;
+      }
+      if (validate) {
+        for (size_t i = 0; i != num_files; ++i) {
+          const auto &index = reader.files()[i].index();
+          if (index && (entry >= index->entries.size() || index->entries[entry].offset != start[i] ||
+                        index->entries[entry].event_number != event.event_number)) {
+            res.errors.push_back("index of '" + reader.files()[i].filename() +
+                                 "' does not match event #" + std::to_string(event.event_number));
+          }
+        }
+        if (res.events != 0 && event.event_number <= res.last_event) {
+          res.errors.push_back("event number " + std::to_string(event.event_number) +
+                               " does not increase");
+        }
+      }
+      res.first_event = std::min(res.first_event, event.event_number);
+      res.last_event = event.event_number;
+      res.timestamp_min = std::min(res.timestamp_min, event.timestamp);
+      res.timestamp_max = std::max(res.timestamp_max, event.timestamp);
+      ++res.events;
+      if (opt.mode == "dump") {
+        dump_event(stream != nullptr ? *stream : dumped, event);
+      } else if (converted.is_open()) {
+        convert_event(converted, event, opt.to_text, opt.to_short);
+      }
+      if (res.errors.size() > 10) {
+        res.errors.emplace_back("too many errors, giving up on the range");
+        break;
+      }
+    }
+    for (size_t i = 0; i != num_files; ++i) {
+      res.bytes += reader.offset(i) - begin[i];
+    }
+    if (!reader.error().empty()) {
+      res.errors.push_back(reader.error());
+    }
+    res.output = dumped.str();
+    if (converted.is_open() && converted.fail()) {
+      res.errors.emplace_back("write of converted events failed");
+    }
+  } catch (const std::exception &e) {
+    res.errors.emplace_back(e.what());
+  }
+  return res;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  auto args = daqling::utilities::CommandlineInterpreter::map(argc, argv);
+  if (args.count("help") != 0u || argc == 1) {
+    usage();
+    return EXIT_SUCCESS;
+  }
+
+  Options opt;
+  std::vector<FileSet> sets;
+  try {
+    opt.mode = args.count("mode") != 0u ? args["mode"] : opt.mode;
+    if (opt.mode != "validate" && opt.mode != "count" && opt.mode != "dump" && opt.mode != "convert") {
+      throw std::runtime_error("unknown mode '" + opt.mode + "'");
+    }
+    if (args.count("threads") != 0u) {
+      opt.threads = std::max<size_t>(1, std::stoul(args["threads"]));
+    }
+    if (args.count("chunk") != 0u) {
+      opt.chunk = std::max<size_t>(1, std::stoul(args["chunk"]));
+    }
+    opt.output_dir = args.count("output") != 0u ? args["output"] : opt.output_dir;
+    if (args.count("to") != 0u) {
+      auto to = caen_file_format_from_string(args["to"]);
+      if (!to) {
+        throw std::runtime_error("unknown output format '" + args["to"] + "'");
+      }
+      opt.to_text = *to == caen_file_format::Text || *to == caen_file_format::TextShort;
+      opt.to_short = *to == caen_file_format::BinaryShort || *to == caen_file_format::TextShort;
+    }
+
+    if (args.count("manifest") != 0u) {
+      sets = load_manifest(args["manifest"]);
+    } else if (args.count("files") != 0u) {
+      FileSet set;
+      set.files = split(args["files"]);
+      auto format = caen_file_format_from_string(args["format"]);
+      auto splitting = caen_file_splitting_from_string(args["splitting"]);
+      if (!format || !splitting) {
+        throw std::runtime_error("--format and --splitting are required with --files");
+      }
+      set.format = *format;
+      set.splitting = *splitting;
+      for (const auto &ch : split(args["channels"])) {
+        set.channels.push_back(static_cast<uint16_t>(std::stoul(ch)));
+      }
+      sets.push_back(std::move(set));
+    } else {
+      throw std::runtime_error("either --manifest or --files is required");
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "caen_scan: " << e.what() << "\n";
+    usage();
+    return EXIT_FAILURE;
+  }
+
+  // Split indexed sets into event ranges so that large sets are also scanned in parallel.
+  std::vector<Unit> units;
+  for (size_t s = 0; s != sets.size(); ++s) {
+    size_t indexed = 0;
+    try {
+      indexed = Reader(sets[s].files, sets[s].format, sets[s].splitting, sets[s].channels).indexed_events();
+    } catch (const std::exception &) {
+      // Reported when the set is scanned.
+    }
+    if (indexed <= opt.chunk) {
+      units.push_back({s, 0, 0, SIZE_MAX, opt.mode == "dump"});
+      continue;
+    }
+    for (size_t first = 0, part = 0; first < indexed; first += opt.chunk, ++part) {
+      const bool last = first + opt.chunk >= indexed;
+      units.push_back({s, part, first, last ? SIZE_MAX : opt.chunk, false});
+    }
+  }
+
+  std::vector<std::promise<UnitResult>> promises(units.size());
+  std::atomic<size_t> next_unit{0};
+  std::vector<std::thread> workers;
+  for (size_t t = 0, n = std::min(opt.threads, units.size()); t != n; ++t) {
+    workers.emplace_back([&]() {
+      for (size_t u = next_unit++; u < units.size(); u = next_unit++) {
+        if (!units[u].stream) {
+          promises[u].set_value(scan(sets[units[u].set], units[u], opt));
+        }
+      }
+    });
+  }
+
+  // Results are reported in order while later units are still being scanned.
+  size_t total_events = 0, total_bytes = 0, failed_sets = 0;
+  UnitResult set_result;
+  for (size_t u = 0; u != units.size(); ++u) {
+    UnitResult res = units[u].stream ? scan(sets[units[u].set], units[u], opt, &std::cout)
+                                     : promises[u].get_future().get();
+    std::cout << res.output;
+    set_result.events += res.events;
+    set_result.bytes += res.bytes;
+    set_result.first_event = std::min(set_result.first_event, res.first_event);
+    set_result.last_event = res.events != 0 ? res.last_event : set_result.last_event;
+    set_result.timestamp_min = std::min(set_result.timestamp_min, res.timestamp_min);
+    set_result.timestamp_max = std::max(set_result.timestamp_max, res.timestamp_max);
+    set_result.errors.insert(set_result.errors.end(), res.errors.begin(), res.errors.end());
+    if (u + 1 != units.size() && units[u + 1].set == units[u].set) {
+      continue;
+    }
+
+    const FileSet &set = sets[units[u].set];
+    if (opt.mode == "validate" && set.manifest_entry) {
+      const auto &entry = *set.manifest_entry;
+      if (entry.value("events", SIZE_MAX) != set_result.events) {
+        set_result.errors.push_back("manifest lists " + entry.at("events").dump() + " events, found " +
+                                    std::to_string(set_result.events));
+      }
+      if (set_result.events != 0 && (entry.value("first_event", UINT64_MAX) != set_result.first_event ||
+                                     entry.value("last_event", UINT64_MAX) != set_result.last_event)) {
+        set_result.errors.emplace_back("first/last event differ from the manifest");
+      }
+    }
+    if (opt.mode != "dump") {
+      std::cout << (set_result.errors.empty() ? "OK    " : "ERROR ") << set.files.front()
+                << (set.files.size() > 1 ? " (+" + std::to_string(set.files.size() - 1) + " files)" : "")
+                << ": " << set_result.events << " events, " << set_result.bytes << " bytes";
+      if (set_result.events != 0) {
+        std::cout << ", events " << set_result.first_event << "-" << set_result.last_event
+                  << ", timestamps " << set_result.timestamp_min << "-" << set_result.timestamp_max;
+      }
+      std::cout << "\n";
+    }
+    for (const auto &err : set_result.errors) {
+      std::cerr << "  " << set.files.front() << ": " << err << "\n";
+    }
+    total_events += set_result.events;
+    total_bytes += set_result.bytes;
+    failed_sets += set_result.errors.empty() ? 0u : 1u;
+    set_result = UnitResult();
+  }
+  for (auto &w : workers) {
+    w.join();
+  }
+
+  if (opt.mode != "dump") {
+    std::cout << "Total: " << sets.size() << " file sets, " << total_events << " events, "
+              << total_bytes << " bytes, " << failed_sets << " with errors\n";
+  }
+  return failed_sets == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,138 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * interleaved_split
+ * Description: Lists the channels of interleaved FileWriterModule output files or splits them
+ *   back into one file per channel, holding the payloads of the channel in order, as written
+ *   without the "interleaved" setting. Input files are read in the order given.
+ * Date: October 2026
+ */
+
+#include "Common/InterleavedFile.hpp"
+#include "Utils/CommandlineInterpreter.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+struct ChannelSummary {
+  size_t records = 0;
+  size_t bytes = 0;
+  std::ofstream out;
+};
+
+void usage() {
+  std::cerr << "Usage: interleaved_split --files <file>[,<file>...] [--mode list|split]\n"
+               "                         [--output <directory>] [--channels <chid>[,<chid>...]]\n"
+               "  split writes <directory>/chid<chid>.bin for every (selected) channel.\n";
+}
+
+std::vector<std::string> split(const std::string &str) {
+  std::vector<std::string> ret;
+  std::stringstream ss(str);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (!item.empty()) {
+      ret.push_back(item);
+    }
+  }
+  return ret;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  auto args = daqling::utilities::CommandlineInterpreter::map(argc, argv);
+  if (args.count("help") != 0u || argc == 1) {
+    usage();
+    return EXIT_SUCCESS;
+  }
+
+  const std::string mode = args.count("mode") != 0u ? args["mode"] : "list";
+  const std::string output_dir = args.count("output") != 0u ? args["output"] : ".";
+  const auto files = split(args["files"]);
+  std::map<uint64_t, ChannelSummary> channels;
+  bool all_channels = true;
+  try {
+    if (mode != "list" && mode != "split") {
+      throw std::runtime_error("unknown mode '" + mode + "'");
+    }
+    if (files.empty()) {
+      throw std::runtime_error("--files is required");
+    }
+    for (const auto &chid : split(args["channels"])) {
+      channels[std::stoull(chid)];
+      all_channels = false;
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "interleaved_split: " << e.what() << "\n";
+    usage();
+    return EXIT_FAILURE;
+  }
+
+  bool failed = false;
+  for (const auto &file : files) {
+    try {
+      interleaved_file_reader reader(file);
+      while (auto record = reader.next()) {
+        auto it = channels.find(record->chid);
+        if (it == channels.end()) {
+          if (!all_channels) {
+            continue;
+          }
+          it = channels.emplace(record->chid, ChannelSummary()).first;
+        }
+        ChannelSummary &channel = it->second;
+        ++channel.records;
+        channel.bytes += record->size;
+        if (mode == "split") {
+          if (!channel.out.is_open()) {
+            const auto path = std::filesystem::path(output_dir) /
+                              ("chid" + std::to_string(record->chid) + ".bin");
+            channel.out.open(path, std::ios::binary);
+            if (!channel.out.is_open()) {
+              throw std::runtime_error("Could not open '" + path.string() + "'");
+            }
+          }
+          channel.out.write(record->data, static_cast<std::streamsize>(record->size));
+          if (channel.out.fail()) {
+            throw std::runtime_error("Could not write channel " + std::to_string(record->chid));
+          }
+        }
+      }
+      if (!reader.error().empty()) {
+        std::cerr << "interleaved_split: " << reader.error() << "\n";
+        failed = true;
+      }
+    } catch (const std::exception &e) {
+      std::cerr << "interleaved_split: " << e.what() << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  for (const auto & [ chid, channel ] : channels) {
+    std::cout << "channel " << chid << ": " << channel.records << " payloads, " << channel.bytes
+              << " bytes\n";
+  }
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
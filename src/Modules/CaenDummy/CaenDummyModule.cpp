@@ -33,34 +33,87 @@ CaenDummyModule::CaenDummyModule(const std::string &n) : DAQProcess(n) {
   m_n_samples_min = getModuleSettings()["n_samples"]["min"];
   m_n_samples_max = getModuleSettings()["n_samples"]["max"];
 
-  // Parameters of simulated gaus signal + background
-  m_baseline_amplitude = getModuleSettings()["baseline"]["amplitude"];
-  m_noise_amplitude = getModuleSettings()["baseline"]["noise_amplitude"];
-  m_signal_probability = getModuleSettings()["signal"]["probability"];
-  m_signal_amplitude = getModuleSettings()["signal"]["amplitude"];
-  m_signal_amplitude_jitter = getModuleSettings()["signal"]["amplitude_jitter"];
-  m_signal_duration = getModuleSettings()["signal"]["duration"];
-  m_signal_duration_jitter = getModuleSettings()["signal"]["duration_jitter"];
-  m_signal_position = getModuleSettings()["signal"]["position"];
-  m_signal_position_jitter = getModuleSettings()["signal"]["position_jitter"];
-
-  m_delay_us = std::chrono::microseconds(getModuleSettings()["delay_us"]);;
+  // Parameters of simulated signal + background. The top-level ones are the defaults of all channels:
+  // "channels" is either their number or a list of per-channel overrides. Without it, the signal is
+  // generated in channel 0 and channel 1 has background only.
+  CaenSignalModel defaults;
+  read_signal_model(getModuleSettings(), defaults);
+  const auto channels = getModuleSettings().value("channels", nlohmann::json());
+  if (channels.is_null()) {
+    m_channel_models = {defaults, defaults};
+    m_channel_models[1].channel = 1;
+    m_channel_models[1].probability = 0;
+  } else if (channels.is_number_unsigned()) {
+    m_channel_models.assign(channels.get<std::size_t>(), defaults);
+    for (std::size_t i = 0; i != m_channel_models.size(); ++i)
+      m_channel_models[i].channel = static_cast<uint16_t>(i);
+  } else {
+    for (const auto &elem : channels) {
+      CaenSignalModel &model = m_channel_models.emplace_back(defaults);
+      model.channel = elem.value("channel", static_cast<uint16_t>(m_channel_models.size() - 1));
+      read_signal_model(elem, model);
+    }
+  }
+  if (m_channel_models.empty())
+    throw InvalidParameter(ERS_HERE, channels.dump(), std::string("channels"));
+  if (getModuleSettings().contains("seed"))
+    m_seed = getModuleSettings()["seed"].get<uint64_t>();
+  m_generator_threads = getModuleSettings().value("generator_threads", m_generator_threads);
+  m_ordered = getModuleSettings().value("ordered", m_ordered);
+  m_event_ring_size = getModuleSettings().value("event_ring_size", m_event_ring_size);
+
+  // "delay_us" between events is the former way of setting the rate.
+  const double delay_us = getModuleSettings().value("delay_us", 0.0);
+  m_rate_hz = getModuleSettings().value("rate_hz", delay_us > 0 ? 1e6 / delay_us : 0.0);
+  m_rate_burst = getModuleSettings().value("rate_burst", m_rate_burst);
   m_pause = false;
 
   registerCommand("pause", "pausing", "paused", &CaenDummyModule::pause, this);
   registerCommand("resume", "resuming", "running", &CaenDummyModule::resume, this);
 }
 
+void CaenDummyModule::read_signal_model(const nlohmann::json &settings, CaenSignalModel &model) {
+  const auto baseline = settings.value("baseline", nlohmann::json::object());
+  model.baseline = baseline.value("amplitude", model.baseline);
+  model.noise = baseline.value("noise_amplitude", model.noise);
+  const auto signal = settings.value("signal", nlohmann::json::object());
+  model.probability = signal.value("probability", model.probability);
+  if (signal.contains("shape")) {
+    const std::string str = signal["shape"];
+    if (auto shape = CaenSignalModel::shape_from_string(str))
+      model.shape = *shape;
+    else
+      throw InvalidParameter(ERS_HERE, str, std::string("signal.shape"));
+  }
+  model.amplitude = signal.value("amplitude", model.amplitude);
+  model.amplitude_jitter = signal.value("amplitude_jitter", model.amplitude_jitter);
+  model.duration = signal.value("duration", model.duration);
+  model.duration_jitter = signal.value("duration_jitter", model.duration_jitter);
+  model.position = signal.value("position", model.position);
+  model.position_jitter = signal.value("position_jitter", model.position_jitter);
+}
+
 void CaenDummyModule::configure() {
   DAQProcess::configure();
   try {
-    m_event_data = std::make_shared<EventType>();
-    m_event_data->device = m_name;
+    m_generator.emplace(m_channel_models, m_adc_max_amplitude, m_n_samples_min, m_n_samples_max);
+    // Workers may run ahead of the sending by a few events each.
+    m_slots = std::vector<Slot>(m_event_ring_size != 0 ? m_event_ring_size
+                                                       : std::max<std::size_t>(4, 4 * std::size_t{m_generator_threads}));
+    for (auto &slot : m_slots) {
+      slot.event = std::make_shared<EventType>();
+      slot.event->device = m_name;
+    }
   } catch (const std::bad_alloc &) {
     throw MemoryAllocationFailure(ERS_HERE);
   } catch (const std::exception& e) {
     throw UnexpectedFailure(ERS_HERE, e.what());
   }
+  if (m_statistics) {
+    m_statistics->registerMetric<std::atomic<size_t>>(&m_events_sent, "EventRate", daqling::core::metrics::RATE);
+    m_statistics->registerMetric<std::atomic<size_t>>(&m_events_reallocated, "EventsReallocated",
+                                                      daqling::core::metrics::LAST_VALUE);
+  }
   std::this_thread::sleep_for(2s); // some sleep to demonstrate transition states
 }
 
@@ -72,104 +125,150 @@ void CaenDummyModule::start(unsigned run_num) {
   if (run_num != m_state.prev_run) {
     m_state.event_number = 0;
     m_state.prev_run = run_num;
+    m_state.seed = m_seed ? *m_seed : (uint64_t{std::random_device()()} << 32) ^ std::random_device()();
   }
   DAQProcess::start(run_num);
 }
 
 void CaenDummyModule::stop() { DAQProcess::stop(); }
 
+bool CaenDummyModule::generate(uint64_t event_number, EventType &event) {
+  // With workers, the timestamp is that of the generation rather than of the sending.
+  const auto timestamp = duration_cast<microseconds>(system_clock::now().time_since_epoch());
+  event.timestamp = static_cast<uint64_t>(timestamp.count());
+  event.event_number = static_cast<uint32_t>(event_number);
+  try {
+    Xoshiro256pp rng = Xoshiro256pp::for_event(m_state.seed, event_number);
+    m_generator->generate(event, rng);
+    event.serialize();
+  } catch (const std::bad_alloc &) {
+    ERS_WARNING("Generation of event failed due to failed memory allocation. Skipping.");
+    ers::error(MemoryAllocationFailure(ERS_HERE));
+    return false;
+  } catch (const std::exception& e) {
+    ERS_ERROR("Generation of event failed due unexpected exception. Stopping run.");
+    m_run = false;
+    ers::error(UnexpectedFailure(ERS_HERE, e.what()));
+    return false;
+  }
+  return true;
+}
+
+CaenDummyModule::EventType &CaenDummyModule::writable_event(Slot &slot) {
+  // The connection shares the event of a message until it is sent; writing into it before
+  // would alter the data in flight.
+  if (slot.event.use_count() != 1) {
+    slot.event = std::make_shared<EventType>();
+    slot.event->device = m_name;
+    ++m_events_reallocated;
+  } else {
+    // Pairs with the release of the last reference by the connection.
+    std::atomic_thread_fence(std::memory_order_acquire);
+  }
+  return *slot.event;
+}
+
+void CaenDummyModule::worker() {
+  while (m_run) {
+    const uint64_t n = m_next_event.fetch_add(1);
+    if (n >= UINT32_MAX)
+      return;
+    Slot &slot = m_slots[n % m_slots.size()];
+    while (slot.sequence.load(std::memory_order_acquire) != 2 * n) {
+      if (!m_run)
+        return;
+      std::this_thread::sleep_for(20us);
+    }
+    slot.generated = generate(n, writable_event(slot));
+    slot.sequence.store(2 * n + 1, std::memory_order_release);
+  }
+}
+
 void CaenDummyModule::runner() noexcept {
-  if (!m_event_data) {
+  if (m_slots.empty() || !m_generator) {
     ERS_DEBUG(0, "Run abourted due to null data pointer.");
     ers::error(UnexpectedFailure(ERS_HERE, "Run abourted due to null data pointer."));
     return;
-  } else {
-    m_event_data->event_number = m_state.event_number;
   }
-  microseconds timestamp{};
+  const std::size_t num_slots = m_slots.size();
+  uint64_t next = m_state.event_number; // To be sent, in order.
+  for (uint64_t n = next; n != next + num_slots; ++n)
+    m_slots[n % num_slots].sequence.store(2 * n);
+  m_next_event = next;
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i != m_generator_threads; ++i)
+    workers.emplace_back(&CaenDummyModule::worker, this);
+  std::size_t cursor = 0; // Where to look for ready events first, out of order.
+  daqling::utilities::RateLimiter limiter(m_rate_hz, m_rate_burst);
 
-  std::random_device rd;
-  std::mt19937 gen(rd());
-  
   ERS_DEBUG(0, "Running...");
   while (m_run) {
     if (m_pause) {
-      ERS_INFO("Paused at event number " << m_state.event_number);
+      ERS_INFO("Paused at event number " << next);
       while (m_pause && m_run) {
         std::this_thread::sleep_for(10ms);
       }
     }
-    timestamp = duration_cast<microseconds>(system_clock::now().time_since_epoch());
-    m_event_data->timestamp = static_cast<uint64_t>(timestamp.count());
-    m_event_data->event_number = m_state.event_number;
-    try {
-      generate_signal(gen);
-    } catch (const std::bad_alloc &) {
-      ERS_WARNING("Generation of event failed due to failed memory allocation. Skipping.");
-      ers::error(MemoryAllocationFailure(ERS_HERE));
-    } catch (const std::exception& e) {
-      ERS_ERROR("Generation of event failed due unexpected exception. Stopping run.");
+    if (next >= UINT32_MAX) {
       m_run = false;
-      ers::error(UnexpectedFailure(ERS_HERE, e.what()));
+      ers::fatal(EventLimitReached(ERS_HERE));
+      break;
     }
+    Slot *slot = nullptr;
+    uint64_t n = next;
+    if (workers.empty()) {
+      slot = &m_slots[n % num_slots];
+      slot->generated = generate(n, writable_event(*slot));
+    } else if (m_ordered) {
+      slot = &m_slots[n % num_slots];
+      while (slot->sequence.load(std::memory_order_acquire) != 2 * n + 1 && m_run)
+        std::this_thread::sleep_for(5us);
+    } else {
+      // Any ready event, starting after the last one sent.
+      while (m_run && slot == nullptr) {
+        for (std::size_t i = 0; i != num_slots; ++i) {
+          Slot &candidate = m_slots[(cursor + i) % num_slots];
+          const uint64_t sequence = candidate.sequence.load(std::memory_order_acquire);
+          if (sequence % 2 == 1) {
+            slot = &candidate;
+            n = sequence / 2;
+            cursor = (cursor + i + 1) % num_slots;
+            break;
+          }
+        }
+        if (slot == nullptr)
+          std::this_thread::sleep_for(5us);
+      }
+    }
+    if (!m_run)
+      break;
 
-    ERS_DEBUG(0, "event number " << m_event_data->event_number << " | timestamp " << std::hex << "0x"
-                                    << m_event_data->timestamp << std::dec);
-
-    // Passing shared pointers so that resources are persistent and are not re-allocated
-    // every time the data is sent
-    SharedDataType<EventType> data_massage(m_event_data);
-    ERS_INFO("Sending event #" << m_event_data->event_number << " timestamp = " << m_event_data->timestamp);
-    m_event_data->serialize();
-    ERS_INFO("Serialized event, total size = " << m_event_data->size() << ", n_samples = " << m_event_data->ch_data[0].xs.size());
-    while ((!m_connections.sleep_send(0, data_massage)) && m_run) {
-      ERS_WARNING("put() failed. Trying again");
-    };
-
-    ++m_state.event_number;
-
-    if (m_state.event_number == UINT32_MAX) {
-      m_run = false;
-      ers::fatal(EventLimitReached(ERS_HERE));
+    if (slot->generated) {
+      EventType &event = *slot->event;
+      ERS_DEBUG(0, "Sending event #" << event.event_number << " timestamp = " << std::hex << "0x"
+                                     << event.timestamp << std::dec << ", total size = " << event.size());
+      // Passing shared pointers so that resources are persistent and are not re-allocated
+      // every time the data is sent. sleep_send() moves from the message: one per attempt.
+      if (!limiter.acquire(1, m_run))
+        break;
+      while (m_run) {
+        SharedDataType<EventType> data_massage(slot->event);
+        data_massage.make_shared();
+        if (m_connections.sleep_send(0, data_massage))
+          break;
+        ERS_WARNING("put() failed. Trying again");
+      }
+      ++m_events_sent;
     }
-    std::this_thread::sleep_for(m_delay_us);
+    // The slot is free for the event num_slots later.
+    if (!workers.empty())
+      slot->sequence.store(2 * (n + num_slots), std::memory_order_release);
+    next = workers.empty() || m_ordered ? n + 1 : std::max(next, n + 1);
   }
+  for (auto &thread : workers)
+    thread.join();
+  // Events generated but not sent are generated again if the run continues; out of order, the
+  // unsent ones before the last sent are skipped.
+  m_state.event_number = static_cast<uint32_t>(std::min<uint64_t>(next, UINT32_MAX));
   ERS_DEBUG(0, "Runner stopped");
 }
-
-template<typename UniformRandomNumberGenerator>
-void CaenDummyModule::generate_signal(UniformRandomNumberGenerator & urng) {
-  std::uniform_int_distribution<> distr_n_samples(static_cast<int>(m_n_samples_min),
-      static_cast<int>(m_n_samples_max));
-  std::normal_distribution<> distr_baseline(static_cast<double>(m_baseline_amplitude),
-      static_cast<double>(m_noise_amplitude));
-  std::bernoulli_distribution distr_signal_present(m_signal_probability);
-  std::normal_distribution<> distr_signal_position(static_cast<double>(m_signal_position),
-      static_cast<double>(m_signal_position_jitter));
-  std::normal_distribution<> distr_signal_amplitude(static_cast<double>(m_signal_amplitude),
-      static_cast<double>(m_signal_amplitude_jitter));
-  std::normal_distribution<> distr_signal_duration(static_cast<double>(m_signal_duration),
-      static_cast<double>(m_signal_duration_jitter));
-
-  const uint16_t n_samples_size = static_cast<uint16_t>(distr_n_samples(urng));
-  const bool has_signal = distr_signal_present(urng);
-  const double signal_position = distr_signal_position(urng);
-  const double signal_duration = distr_signal_duration(urng);
-  const double signal_amplitude = distr_signal_amplitude(urng);
-
-  m_event_data->ch_data.resize(2);
-  m_event_data->ch_data[0].channel = 0;
-  m_event_data->ch_data[0].xs.resize(n_samples_size);
-  m_event_data->ch_data[0].ys.resize(n_samples_size);
-  m_event_data->ch_data[1].channel = 1;
-  m_event_data->ch_data[1].xs.resize(n_samples_size);
-  m_event_data->ch_data[1].ys.resize(n_samples_size);
-  for (std::size_t i = 0; i!=n_samples_size; ++i) {
-    m_event_data->ch_data[0].xs[i] = i;
-    m_event_data->ch_data[1].xs[i] = i;
-
-    m_event_data->ch_data[0].ys[i] = distr_baseline(urng) +
-        (has_signal ? std::round(signal_amplitude * std::exp(-std::pow((i - signal_position)/signal_duration, 2))) : 0);
-    m_event_data->ch_data[1].ys[i] = distr_baseline(urng);
-  }
-}
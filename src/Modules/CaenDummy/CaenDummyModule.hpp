@@ -19,9 +19,16 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <atomic>
 #include <chrono>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
 #include "Core/DAQProcess.hpp"
 #include "Common/CaenOutputFormat.hpp"
+#include "Utils/Common.hpp"
+#include "WaveformGenerator.hpp"
 
 namespace daqling {
 #include <ers/Issue.h>
@@ -32,6 +39,8 @@ ERS_DECLARE_ISSUE(module, UnexpectedFailure,
                   "Unexpected error was thrown: " << eWhat, ((const char *)eWhat))
 ERS_DECLARE_ISSUE(module, EventLimitReached,
                   "Reached maximum event number! Stopping acquisition", ERS_EMPTY)
+ERS_DECLARE_ISSUE(module, InvalidParameter, "Invalid parameter \""<< par <<"\" was provided for "<<target<<".",
+                  ((std::string)par)((std::string)target))
 }
 // NOLINTNEXTLINE(cppcoreguidelines-special-member-functions)
 class CaenDummyModule : public daqling::core::DAQProcess {
@@ -54,27 +63,50 @@ private:
   uint16_t m_n_samples_min; // Of course, in parctice the number of sampled points does not change from event to event
   uint16_t m_n_samples_max;
 
-  // Parameters of simulated gaus signal + background
-  uint16_t m_baseline_amplitude;
-  uint16_t m_noise_amplitude;
-  double m_signal_probability;
-  uint16_t m_signal_amplitude;
-  uint16_t m_signal_amplitude_jitter;
-  uint16_t m_signal_duration;
-  uint16_t m_signal_duration_jitter;
-  uint16_t m_signal_position;
-  uint16_t m_signal_position_jitter;
-
-  std::chrono::microseconds m_delay_us{};
+  // Simulated signal + background of each channel
+  std::vector<CaenSignalModel> m_channel_models;
+  std::optional<uint64_t> m_seed; // Of the events; drawn anew for each run if not configured.
+  std::optional<CaenWaveformGenerator> m_generator;
+
+  // Events sent per second (unlimited if 0), of which up to m_rate_burst at once after a pause.
+  double m_rate_hz = 0;
+  double m_rate_burst = 1;
+  std::atomic<size_t> m_events_sent{0};
   bool m_pause;
 
+  // Events are generated and serialized by m_generator_threads workers (by the runner itself if 0)
+  // and sent by the runner, in event number order unless m_ordered is false.
+  unsigned m_generator_threads = 0;
+  bool m_ordered = true;
+
+  // Ring of m_event_ring_size preallocated events (0: 4 per worker, at least 4): event n is
+  // generated in slot n % size, in turn, once the event before it in the slot is sent. Its
+  // vectors and serialized buffer are reused, unless the connection still holds it.
+  std::size_t m_event_ring_size = 0;
+  std::atomic<size_t> m_events_reallocated{0};
+  struct Slot {
+    std::shared_ptr<EventType> event;
+    std::atomic<uint64_t> sequence{0}; // 2n: free for event n; 2n + 1: holds event n.
+    bool generated = false;            // Whether the generation of the event it holds succeeded.
+  };
+  std::vector<Slot> m_slots;
+  std::atomic<uint64_t> m_next_event{0}; // Next event number to be taken by a worker.
+
   struct State {
     unsigned prev_run = 0;
     uint32_t event_number = 0;
+    uint64_t seed = 0;
   } m_state;
 
-  std::shared_ptr<EventType> m_event_data;
+  /// Generates and serializes event `event_number` into `event`. Returns false if it failed.
+  bool generate(uint64_t event_number, EventType &event);
+
+  /// The event of `slot`, replaced by a new one if the last sent from it is still in use.
+  EventType &writable_event(Slot &slot);
+
+  /// Takes event numbers in turn and generates them into their slots.
+  void worker();
 
-  template<typename UniformRandomNumberGenerator>
-  void generate_signal(UniformRandomNumberGenerator & urng);
+  /// Reads the "baseline" and "signal" settings in `settings` over `model`.
+  static void read_signal_model(const nlohmann::json &settings, CaenSignalModel &model);
 };
@@ -0,0 +1,231 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+#include "Common/CaenOutputFormat.hpp"
+
+/// xoshiro256++ pseudo-random generator (Blackman & Vigna), seeded through splitmix64.
+/// A UniformRandomBitGenerator; each event gets its own generator derived from the run seed
+/// and the event number, so that events are reproducible whichever thread generates them.
+class Xoshiro256pp {
+public:
+  using result_type = uint64_t;
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+  explicit Xoshiro256pp(uint64_t seed) {
+    for (auto &s : m_s)
+      s = splitmix64(seed);
+  }
+
+  static Xoshiro256pp for_event(uint64_t seed, uint64_t event_number) {
+    return Xoshiro256pp(seed ^ (event_number * 0xd1342543de82ef95ULL));
+  }
+
+  result_type operator()() {
+    const uint64_t result = rotl(m_s[0] + m_s[3], 23) + m_s[0];
+    const uint64_t t = m_s[1] << 17;
+    m_s[2] ^= m_s[0];
+    m_s[3] ^= m_s[1];
+    m_s[1] ^= m_s[2];
+    m_s[0] ^= m_s[3];
+    m_s[2] ^= t;
+    m_s[3] = rotl(m_s[3], 45);
+    return result;
+  }
+
+  /// Uniform in [0, 1).
+  double uniform() { return static_cast<double>((*this)() >> 11) * 0x1.0p-53; }
+
+  /// Uniform in [0, n), for n up to 2^32.
+  uint64_t below(uint64_t n) { return (((*this)() >> 32) * n) >> 32; }
+
+  /// Standard normal, by the Box-Muller transform.
+  double normal() {
+    const double u1 = 1.0 - uniform(); // (0, 1]
+    const double u2 = uniform();
+    return std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+  }
+
+private:
+  static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+  static uint64_t splitmix64(uint64_t &x) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  uint64_t m_s[4];
+};
+
+/// Simulated signal of one digitizer channel: baseline with gaussian noise, and a pulse
+/// present with `probability` in each event. Jitters are standard deviations.
+struct CaenSignalModel {
+  enum class Shape {
+    Gaussian,    // exp(-((t - position) / duration)^2)
+    Exponential, // Steps up at position and decays with time constant duration.
+  };
+  uint16_t channel = 0;
+  double baseline = 2000;
+  double noise = 60;
+  double probability = 0;
+  Shape shape = Shape::Gaussian;
+  double amplitude = 400;
+  double amplitude_jitter = 10;
+  double duration = 500;
+  double duration_jitter = 30;
+  double position = 2200;
+  double position_jitter = 100;
+
+  static std::optional<Shape> shape_from_string(const std::string &str) {
+    if (str == "Gaussian" || str == "gaussian" || str == "gaus") {
+      return Shape::Gaussian;
+    } else if (str == "Exponential" || str == "exponential" || str == "exp") {
+      return Shape::Exponential;
+    }
+    return std::nullopt;
+  }
+};
+
+/**
+ * Generates the waveforms of CaenDummyModule events for any number of channels.
+ * Nothing is computed per sample but table lookups and single precision multiply-adds, in
+ * loops the compiler vectorizes:
+ * - noise is a slice, at a random offset, of a table of standard normal values (fixed point)
+ *   scaled by the noise of the channel;
+ * - pulses are a template of the shape in units of the duration, precomputed at fine
+ *   resolution, stretched by the drawn duration, shifted to the drawn position and scaled
+ *   by the drawn amplitude.
+ * Samples saturate at 0 and adc_max like an ADC. generate() is const and thread safe.
+ */
+class CaenWaveformGenerator {
+public:
+  using EventType = caen_output_data<uint16_t>;
+
+  CaenWaveformGenerator(std::vector<CaenSignalModel> channels, uint16_t adc_max, uint16_t n_samples_min,
+                        uint16_t n_samples_max, uint64_t seed = 0x5eed)
+      : m_channels(std::move(channels)), m_adc_max(adc_max), m_n_samples_min(n_samples_min),
+        m_n_samples_max(std::max(n_samples_min, n_samples_max)) {
+    Xoshiro256pp rng(seed);
+    m_noise.resize(2 * noise_table_size);
+    for (std::size_t i = 0; i != noise_table_size; ++i) {
+      const double v = std::clamp(rng.normal(), -31.0, 31.0);
+      m_noise[i] = m_noise[i + noise_table_size] = static_cast<int16_t>(std::lround(v * noise_one));
+    }
+    for (auto shape : {CaenSignalModel::Shape::Gaussian, CaenSignalModel::Shape::Exponential}) {
+      Template &t = m_templates[static_cast<std::size_t>(shape)];
+      t.begin = shape == CaenSignalModel::Shape::Gaussian ? -4.0 : 0.0;
+      const double end = shape == CaenSignalModel::Shape::Gaussian ? 4.0 : 16.0;
+      t.values.resize(static_cast<std::size_t>((end - t.begin) * template_resolution) + 1);
+      for (std::size_t i = 0; i != t.values.size(); ++i) {
+        const double u = t.begin + static_cast<double>(i) / template_resolution;
+        t.values[i] = static_cast<float>(shape == CaenSignalModel::Shape::Gaussian ? std::exp(-u * u) : std::exp(-u));
+      }
+    }
+  }
+
+  std::size_t channels() const { return m_channels.size(); }
+
+  /// Generates the samples of all channels of `event`. Vectors are only reallocated when the
+  /// number of channels or samples grows.
+  void generate(EventType &event, Xoshiro256pp &rng) const {
+    const auto n_samples = static_cast<std::size_t>(
+        m_n_samples_min + rng.below(static_cast<uint64_t>(m_n_samples_max - m_n_samples_min) + 1));
+    event.ch_data.resize(m_channels.size());
+    for (std::size_t c = 0, c_end_ = m_channels.size(); c != c_end_; ++c) {
+      const CaenSignalModel &model = m_channels[c];
+      auto &ch = event.ch_data[c];
+      ch.channel = model.channel;
+      if (ch.xs.size() != n_samples) {
+        ch.xs.resize(n_samples);
+        for (std::size_t i = 0; i != n_samples; ++i)
+          ch.xs[i] = static_cast<uint16_t>(i);
+      }
+      ch.ys.resize(n_samples);
+      add_noise(ch.ys.data(), n_samples, model, rng);
+      if (model.probability > 0 && rng.uniform() < model.probability)
+        add_pulse(ch.ys.data(), n_samples, model, rng);
+    }
+  }
+
+private:
+  static constexpr std::size_t noise_table_size = std::size_t{1} << 16; // At least the most samples.
+  static constexpr int noise_shift = 10;
+  static constexpr double noise_one = 1 << noise_shift;
+  static constexpr double template_resolution = 1024; // Template values per unit of duration.
+
+  struct Template {
+    double begin; // In units of duration, relative to the position.
+    std::vector<float> values;
+  };
+
+  void add_noise(uint16_t *ys, std::size_t n, const CaenSignalModel &model, Xoshiro256pp &rng) const {
+    const int16_t *noise = m_noise.data() + rng.below(noise_table_size);
+    // Rounded to nearest by the truncation of the clamped, non-negative value.
+    const auto baseline = static_cast<float>(model.baseline + 0.5);
+    const auto scale = static_cast<float>(model.noise / noise_one);
+    const auto adc_max = static_cast<float>(m_adc_max);
+    for (std::size_t i = 0; i != n; ++i)
+      ys[i] = static_cast<uint16_t>(std::clamp(baseline + scale * static_cast<float>(noise[i]), 0.f, adc_max));
+  }
+
+  void add_pulse(uint16_t *ys, std::size_t n, const CaenSignalModel &model, Xoshiro256pp &rng) const {
+    const double amplitude = model.amplitude + model.amplitude_jitter * rng.normal();
+    const double duration = model.duration + model.duration_jitter * rng.normal();
+    const double position = model.position + model.position_jitter * rng.normal();
+    if (duration <= 0)
+      return;
+    const Template &t = m_templates[static_cast<std::size_t>(model.shape)];
+    // Samples covered by the template, and template index of each in 16.16 fixed point.
+    const double first = std::max(0.0, std::ceil(position + t.begin * duration));
+    const double last = std::min(static_cast<double>(n),
+                                 std::floor(position + (t.begin + static_cast<double>(t.values.size() - 1) /
+                                                                      template_resolution) * duration) + 1);
+    if (last <= first)
+      return;
+    const double step = template_resolution / duration;
+    // first is not before the template begins: the index is not negative.
+    uint64_t index = static_cast<uint64_t>(std::max(0.0, ((first - position) / duration - t.begin) * template_resolution * 65536.0));
+    const auto index_step = static_cast<uint64_t>(step * 65536.0);
+    const std::size_t max_index = t.values.size() - 1;
+    const float *values = t.values.data();
+    const auto scale = static_cast<float>(amplitude);
+    const auto adc_max = static_cast<float>(m_adc_max);
+    for (auto i = static_cast<std::size_t>(first), i_end_ = static_cast<std::size_t>(last); i != i_end_; ++i) {
+      const float y = static_cast<float>(ys[i]) + scale * values[std::min<std::size_t>(index >> 16, max_index)] + 0.5f;
+      ys[i] = static_cast<uint16_t>(std::clamp(y, 0.f, adc_max));
+      index += index_step;
+    }
+  }
+
+  const std::vector<CaenSignalModel> m_channels;
+  const uint16_t m_adc_max;
+  const uint16_t m_n_samples_min;
+  const uint16_t m_n_samples_max;
+  std::vector<int16_t> m_noise; // Standard normal, noise_shift fractional bits; twice over for slices.
+  Template m_templates[2];      // Per CaenSignalModel::Shape.
+};
@@ -0,0 +1,247 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CaenFeatureExtractorModule.hpp"
+#include "Utils/Ers.hpp"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <utility>
+
+using namespace std::chrono_literals;
+using namespace daqling::module;
+
+CaenFeatureExtractorModule::CaenFeatureExtractorModule(const std::string &n) : DAQProcess(n) {
+  ERS_DEBUG(0, "With config: " << getModuleSettings());
+  const auto &settings = getModuleSettings();
+  m_extractor.baseline_start = settings.value("baseline_start", m_extractor.baseline_start);
+  m_extractor.baseline_samples = settings.value("baseline_samples", m_extractor.baseline_samples);
+  if (m_extractor.baseline_samples == 0)
+    throw InvalidParameter(ERS_HERE, "0", std::string("baseline_samples"));
+  m_extractor.threshold = settings.value("threshold", m_extractor.threshold);
+  m_extractor.pre = settings.value("pre_samples", m_extractor.pre);
+  m_extractor.post = settings.value("post_samples", m_extractor.post);
+  const std::string polarity = settings.value("polarity", std::string("positive"));
+  if (polarity == "positive") {
+    m_extractor.polarity = CaenFeatureExtractor::Polarity::Positive;
+  } else if (polarity == "negative") {
+    m_extractor.polarity = CaenFeatureExtractor::Polarity::Negative;
+  } else {
+    throw InvalidParameter(ERS_HERE, polarity, std::string("polarity"));
+  }
+  const std::string timing = settings.value("timing", std::string("cfd"));
+  if (timing == "cfd") {
+    m_extractor.timing = CaenFeatureExtractor::Timing::ConstantFraction;
+  } else if (timing == "leading_edge") {
+    m_extractor.timing = CaenFeatureExtractor::Timing::LeadingEdge;
+  } else {
+    throw InvalidParameter(ERS_HERE, timing, std::string("timing"));
+  }
+  m_extractor.cfd_fraction = settings.value("cfd_fraction", m_extractor.cfd_fraction);
+  if (m_extractor.cfd_fraction <= 0 || m_extractor.cfd_fraction > 1)
+    throw InvalidParameter(ERS_HERE, std::to_string(m_extractor.cfd_fraction), std::string("cfd_fraction"));
+  m_extractor.max_pulses = settings.value("max_pulses", m_extractor.max_pulses);
+  if (m_extractor.max_pulses == 0)
+    throw InvalidParameter(ERS_HERE, "0", std::string("max_pulses"));
+  m_waveform_prescale = settings.value("waveform_prescale", m_waveform_prescale);
+  m_threads = settings.value("threads", m_threads);
+  m_queue_size = settings.value("queue_size", m_queue_size);
+  for (uint16_t channel : settings.value("channels", std::vector<uint16_t>{}))
+    m_channel_metrics.try_emplace(channel);
+  for (auto &[channel, metrics] : m_channel_metrics) {
+    if (m_channel_lookup.size() <= channel)
+      m_channel_lookup.resize(size_t{channel} + 1, nullptr);
+    m_channel_lookup[channel] = &metrics;
+  }
+}
+
+void CaenFeatureExtractorModule::configure() {
+  DAQProcess::configure();
+  // Without a second sender, sending the waveforms would retry until stop and stall the ring.
+  if (m_waveform_prescale != 0 && m_config.getNumSenderConnections(m_name) < 2)
+    throw InvalidParameter(ERS_HERE, std::to_string(m_waveform_prescale), std::string("waveform_prescale"));
+  m_slots = std::vector<Slot>(m_queue_size != 0 ? m_queue_size : std::max<size_t>(4, 4 * size_t{m_threads}));
+  for (auto &slot : m_slots)
+    slot.features = std::make_shared<FeatureType>();
+  if (m_statistics) {
+    using daqling::core::metrics::LAST_VALUE;
+    using daqling::core::metrics::RATE;
+    m_statistics->registerMetric<std::atomic<size_t>>(&m_events, "EventRate", RATE);
+    m_statistics->registerMetric<std::atomic<size_t>>(&m_pulses, "PulseRate", RATE);
+    m_statistics->registerMetric<std::atomic<size_t>>(&m_pulses_dropped, "PulsesDropped", LAST_VALUE);
+    m_statistics->registerMetric<std::atomic<size_t>>(&m_waveforms, "WaveformRate", RATE);
+    m_statistics->registerMetric<std::atomic<size_t>>(&m_bytes_in, "ByteRateIn", RATE);
+    m_statistics->registerMetric<std::atomic<size_t>>(&m_bytes_out, "ByteRateOut", RATE);
+    m_statistics->registerMetric<std::atomic<double>>(&m_reduction, "ReductionFactor", LAST_VALUE);
+    for (auto &[channel, metrics] : m_channel_metrics) {
+      const std::string suffix = "_ch" + std::to_string(channel);
+      m_statistics->registerMetric<std::atomic<size_t>>(&metrics.pulses, "PulseRate" + suffix, RATE);
+      m_statistics->registerMetric<std::atomic<double>>(&metrics.amplitude, "Amplitude" + suffix, LAST_VALUE);
+    }
+  }
+}
+
+void CaenFeatureExtractorModule::start(unsigned run_num) {
+  m_run_bytes_in = 0;
+  m_run_bytes_out = 0;
+  m_reduction = 0;
+  DAQProcess::start(run_num);
+}
+
+void CaenFeatureExtractorModule::stop() { DAQProcess::stop(); }
+
+bool CaenFeatureExtractorModule::extract(const EventType &event, FeatureType &features,
+                                         CaenFeatureExtractor &extractor) {
+  features.event_number = event.event_number;
+  features.timestamp = event.timestamp;
+  features.device = event.device;
+  features.pulses.clear();
+  for (const auto &ch : event.ch_data) {
+    const size_t first = features.pulses.size();
+    // Channels without xs (or with a mismatched number) are timed in samples.
+    const uint16_t *xs = ch.xs.size() == ch.ys.size() ? ch.xs.data() : nullptr;
+    const size_t found = extractor.extract(ch.channel, xs, ch.ys.data(), ch.ys.size(), features.pulses);
+    const size_t kept = features.pulses.size() - first;
+    m_pulses_dropped += found - kept;
+    if (kept != 0 && ch.channel < m_channel_lookup.size() && m_channel_lookup[ch.channel] != nullptr) {
+      m_channel_lookup[ch.channel]->pulses += kept;
+      m_channel_lookup[ch.channel]->amplitude = features.pulses[first].amplitude;
+    }
+  }
+  m_pulses += features.pulses.size();
+  if (!features.serialize()) {
+    ERS_WARNING("Serialization of the features of event #" << event.event_number << " failed. Skipping.");
+    return false;
+  }
+  return true;
+}
+
+CaenFeatureExtractorModule::FeatureType &CaenFeatureExtractorModule::writable_features(Slot &slot) {
+  // The connection shares the features of a message until they are sent; writing into them
+  // before would alter the data in flight.
+  if (slot.features.use_count() != 1) {
+    slot.features = std::make_shared<FeatureType>();
+  } else {
+    // Pairs with the release of the last reference by the connection.
+    std::atomic_thread_fence(std::memory_order_acquire);
+  }
+  return *slot.features;
+}
+
+void CaenFeatureExtractorModule::send(Slot &slot) {
+  ++m_events;
+  if (!slot.extracted)
+    return;
+  m_bytes_in += slot.bytes_in;
+  m_bytes_out += slot.features->size();
+  m_run_bytes_in += slot.bytes_in;
+  m_run_bytes_out += slot.features->size();
+  // sleep_send() moves from the message: one per attempt, sharing the features.
+  while (m_run) {
+    SharedDataType<FeatureType> message(slot.features);
+    message.make_shared();
+    if (m_connections.sleep_send(0, message))
+      break;
+    ERS_WARNING("put() failed. Trying again");
+  }
+  if (slot.keep_waveform) {
+    m_bytes_out += slot.event.size();
+    m_run_bytes_out += slot.event.size();
+    slot.event.make_shared();
+    while (m_run) {
+      SharedDataType<EventType> message(slot.event);
+      if (m_connections.sleep_send(1, message)) {
+        ++m_waveforms;
+        break;
+      }
+      ERS_WARNING("put() failed. Trying again");
+    }
+  }
+  m_reduction = m_run_bytes_out != 0
+                  ? static_cast<double>(m_run_bytes_in) / static_cast<double>(m_run_bytes_out)
+                  : 0.0;
+}
+
+void CaenFeatureExtractorModule::worker() {
+  CaenFeatureExtractor extractor(m_extractor);
+  while (m_run) {
+    const uint64_t n = m_next_job.fetch_add(1);
+    Slot &slot = m_slots[n % m_slots.size()];
+    while (slot.sequence.load(std::memory_order_acquire) != 3 * n + 1) {
+      if (!m_run)
+        return;
+      std::this_thread::sleep_for(20us);
+    }
+    slot.extracted = extract(*slot.event.get(), writable_features(slot), extractor);
+    slot.sequence.store(3 * n + 2, std::memory_order_release);
+  }
+}
+
+void CaenFeatureExtractorModule::sender() {
+  const size_t num_slots = m_slots.size();
+  for (uint64_t n = 0; m_run; ++n) {
+    Slot &slot = m_slots[n % num_slots];
+    while (slot.sequence.load(std::memory_order_acquire) != 3 * n + 2) {
+      if (!m_run)
+        return;
+      std::this_thread::sleep_for(5us);
+    }
+    send(slot);
+    slot.sequence.store(3 * (n + num_slots), std::memory_order_release);
+  }
+}
+
+void CaenFeatureExtractorModule::runner() noexcept {
+  const size_t num_slots = m_slots.size();
+  for (uint64_t n = 0; n != num_slots; ++n)
+    m_slots[n].sequence.store(3 * n);
+  m_next_job = 0;
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i != m_threads; ++i)
+    threads.emplace_back(&CaenFeatureExtractorModule::worker, this);
+  if (m_threads != 0)
+    threads.emplace_back(&CaenFeatureExtractorModule::sender, this);
+  CaenFeatureExtractor extractor(m_extractor);
+
+  ERS_DEBUG(0, "Running...");
+  for (uint64_t n = 0; m_run;) {
+    DataFragment<EventType> pl;
+    while (!m_connections.sleep_receive(0, pl) && m_run) {
+    }
+    if (!m_run || pl.get() == nullptr)
+      continue;
+    Slot &slot = m_slots[n % num_slots];
+    while (slot.sequence.load(std::memory_order_acquire) != 3 * n && m_run)
+      std::this_thread::sleep_for(5us);
+    if (!m_run)
+      break;
+    slot.bytes_in = pl.size();
+    slot.keep_waveform = m_waveform_prescale != 0 && n % m_waveform_prescale == 0;
+    slot.event = SharedDataType<EventType>(std::move(pl));
+    if (m_threads == 0) {
+      slot.extracted = extract(*slot.event.get(), writable_features(slot), extractor);
+      send(slot);
+      slot.sequence.store(3 * (n + num_slots));
+    } else {
+      slot.sequence.store(3 * n + 1, std::memory_order_release);
+    }
+    ++n;
+  }
+  for (auto &thread : threads)
+    thread.join();
+  ERS_DEBUG(0, "Runner stopped");
+}
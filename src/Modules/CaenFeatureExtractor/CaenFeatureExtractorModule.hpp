@@ -0,0 +1,115 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Common/CaenFeatureFormat.hpp"
+#include "Common/CaenOutputFormat.hpp"
+#include "Common/DataType.hpp"
+#include "Core/DAQProcess.hpp"
+#include "FeatureExtraction.hpp"
+
+namespace daqling {
+#include <ers/Issue.h>
+
+ERS_DECLARE_ISSUE(module, InvalidParameter, "Invalid parameter \""<< par <<"\" was provided for "<<target<<".",
+                  ((std::string)par)((std::string)target))
+}
+
+/**
+ * Online pulse feature extraction of CAEN events: receives caen_output_data events on channel 0
+ * and sends, in the same order, the caen_feature_data records of their pulses (see
+ * CaenFeatureExtractor) on channel 0. With "waveform_prescale" N, every N-th event is also
+ * sent unchanged on channel 1.
+ */
+class CaenFeatureExtractorModule : public daqling::core::DAQProcess {
+public:
+  using EventType = caen_output_data<uint16_t>;
+  using FeatureType = caen_feature_data;
+
+  CaenFeatureExtractorModule(const std::string & /*n*/);
+
+  void configure() override;
+  void start(unsigned run_num) override;
+  void stop() override;
+  void runner() noexcept override;
+
+private:
+  // Received event n goes to slot n % size once the features of event n - size are sent.
+  // Workers extract the features of the events in turn, and the sender thread sends them in
+  // order. The feature messages and their buffers are reused unless the connection still
+  // holds them.
+  struct Slot {
+    std::atomic<uint64_t> sequence{0}; // 3n: free for event n; 3n + 1: received; 3n + 2: extracted.
+    SharedDataType<EventType> event;
+    std::shared_ptr<FeatureType> features;
+    size_t bytes_in = 0;
+    bool keep_waveform = false;
+    bool extracted = false; // Whether the features were extracted and serialized.
+  };
+
+  struct ChannelMetrics {
+    std::atomic<size_t> pulses = 0;
+    std::atomic<double> amplitude = 0; // Of the first pulse of the last event with one.
+  };
+
+  /// Extracts and serializes the features of `event` into `features`. Returns false if the
+  /// serialization failed.
+  bool extract(const EventType &event, FeatureType &features, CaenFeatureExtractor &extractor);
+
+  /// The features of `slot`, replaced by new ones if the last sent from it are still in use.
+  FeatureType &writable_features(Slot &slot);
+
+  /// Sends the features of `slot`, and its event if kept.
+  void send(Slot &slot);
+
+  /// Takes received events in turn and extracts their features.
+  void worker();
+
+  /// Sends the extracted features in event order and frees their slots.
+  void sender();
+
+  CaenFeatureExtractor::Config m_extractor;
+  uint32_t m_waveform_prescale = 0; // 0: no waveforms are sent.
+  // Features are extracted by m_threads workers (by the runner itself if 0), over a ring of
+  // m_queue_size slots (0: 4 per worker, at least 4).
+  unsigned m_threads = 1;
+  size_t m_queue_size = 0;
+  std::vector<Slot> m_slots;
+  std::atomic<uint64_t> m_next_job{0}; // Next received event to be taken by a worker.
+
+  std::atomic<size_t> m_events = 0;
+  std::atomic<size_t> m_pulses = 0;
+  std::atomic<size_t> m_pulses_dropped = 0; // Over max_pulses.
+  std::atomic<size_t> m_waveforms = 0;
+  std::atomic<size_t> m_bytes_in = 0;  // Never reset: RATE metrics difference them.
+  std::atomic<size_t> m_bytes_out = 0;
+  std::atomic<double> m_reduction = 0; // Bytes in over bytes out, since the start of the run.
+  size_t m_run_bytes_in = 0;           // Of the run, for m_reduction.
+  size_t m_run_bytes_out = 0;
+  // Per CAEN channel listed in "channels"; m_channel_lookup is indexed by channel number.
+  std::map<uint16_t, ChannelMetrics> m_channel_metrics;
+  std::vector<ChannelMetrics *> m_channel_lookup;
+};
@@ -0,0 +1,178 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Common/CaenEventSummary.hpp"
+#include "Common/CaenFeatureFormat.hpp"
+#include "Common/CaenHitFinder.hpp"
+
+/**
+ * Pulse features of CAEN waveforms. A pulse is a run of samples further than a threshold from
+ * the baseline (the mean of a window), padded by `pre` and `post` samples; pulses whose padded
+ * regions overlap are merged into one. Per pulse:
+ * - amplitude: the largest distance of a sample from the baseline, on the side of `polarity`;
+ * - integral: the sum of the distances over the padded region;
+ * - time: the first crossing of the timing level before the peak, linearly interpolated. The
+ *   level is `cfd_fraction` of the amplitude (constant fraction) or the threshold (leading edge);
+ * - width: the distance between the crossings of half the amplitude on either side of the peak.
+ * Times and widths are in x when the channel has them, in samples otherwise.
+ * Hits are found by caen_find_hits(), sums and peaks by the SSE2 reductions of the event
+ * summaries; only the few samples around the crossings are looked at one by one.
+ * Not thread safe: ranges are buffered between calls.
+ */
+class CaenFeatureExtractor {
+public:
+  enum class Polarity { Positive, Negative };
+  enum class Timing { ConstantFraction, LeadingEdge };
+
+  struct Config {
+    uint32_t baseline_start = 0;
+    uint32_t baseline_samples = 16;
+    uint16_t threshold = 50; // ADC counts from the baseline.
+    Polarity polarity = Polarity::Positive;
+    uint32_t pre = 4;
+    uint32_t post = 8;
+    Timing timing = Timing::ConstantFraction;
+    double cfd_fraction = 0.3;
+    uint32_t max_pulses = 16; // Per channel and event; further pulses are dropped.
+  };
+
+  explicit CaenFeatureExtractor(const Config &config) : m_config(config) {}
+
+  /// Appends the records of the pulses of one channel to `out`, at most max_pulses of them.
+  /// `xs` may be null, or must have `n` entries. Returns the number of pulses found.
+  size_t extract(uint16_t channel, const uint16_t *xs, const uint16_t *ys, size_t n,
+                 std::vector<caen_pulse_record> &out) {
+    namespace detail = caen_event_summary_detail;
+    uint16_t flags = 0;
+    const double base = baseline(ys, n, flags);
+    const bool positive = m_config.polarity == Polarity::Positive;
+    const double threshold = m_config.threshold;
+    const uint16_t high =
+        positive ? static_cast<uint16_t>(std::clamp(std::floor(base + threshold), 0.0, 65535.0)) : UINT16_MAX;
+    const uint16_t low = positive ? 0 : static_cast<uint16_t>(std::clamp(std::ceil(base - threshold), 0.0, 65535.0));
+    caen_find_hits(ys, n, low, high, m_runs);
+    caen_pad_hits(m_runs, n, m_config.pre, m_config.post, m_regions);
+
+    // Distance from the baseline, positive on the side of the pulses.
+    const auto signal = [&](size_t i) { return positive ? ys[i] - base : base - ys[i]; };
+    const auto position = [&](double t) {
+      if (xs == nullptr) {
+        return t;
+      }
+      const auto i = static_cast<size_t>(t);
+      return i + 1 < n ? xs[i] + (t - static_cast<double>(i)) * (xs[i + 1] - xs[i]) : static_cast<double>(xs[i]);
+    };
+    // Interpolated first crossing of `level` going back from the peak, or the region start.
+    const auto rising = [&](size_t begin, size_t peak, double level, bool &at_edge) {
+      size_t j = peak;
+      while (j > begin && signal(j - 1) >= level) {
+        --j;
+      }
+      at_edge = j == begin;
+      if (at_edge) {
+        return static_cast<double>(j);
+      }
+      const double before = signal(j - 1);
+      return static_cast<double>(j - 1) + (level - before) / (signal(j) - before);
+    };
+
+    const size_t kept = std::min<size_t>(m_regions.size(), m_config.max_pulses);
+    for (size_t p = 0; p != kept; ++p) {
+      const size_t begin = m_regions[p].begin;
+      const size_t end = m_regions[p].end;
+      const size_t length = end - begin;
+      detail::reduction r;
+      detail::reduce(ys + begin, length, r);
+      const uint16_t extreme = positive ? r.max : r.min;
+      const size_t peak = begin + detail::find(ys + begin, length, extreme);
+
+      caen_pulse_record rec{};
+      rec.channel = channel;
+      rec.flags = flags;
+      rec.peak = xs == nullptr ? static_cast<uint32_t>(peak) : xs[peak];
+      rec.samples = static_cast<uint32_t>(length);
+      rec.baseline = static_cast<float>(base);
+      const double amplitude = signal(peak);
+      rec.amplitude = static_cast<float>(amplitude);
+      const double integral = static_cast<double>(r.sum) - base * static_cast<double>(length);
+      rec.integral = static_cast<float>(positive ? integral : -integral);
+
+      bool at_edge = false;
+      const double level =
+          m_config.timing == Timing::ConstantFraction ? m_config.cfd_fraction * amplitude : threshold;
+      rec.time = static_cast<float>(position(rising(begin, peak, level, at_edge)));
+      if (at_edge) {
+        rec.flags |= caen_pulse_record::TimeAtEdge;
+      }
+
+      const double half = 0.5 * amplitude;
+      bool left_at_edge = false;
+      const double left = rising(begin, peak, half, left_at_edge);
+      size_t k = peak;
+      while (k + 1 < end && signal(k + 1) >= half) {
+        ++k;
+      }
+      const bool right_at_edge = k + 1 == end;
+      const double right =
+          right_at_edge ? static_cast<double>(k)
+                        : static_cast<double>(k) + (signal(k) - half) / (signal(k) - signal(k + 1));
+      rec.width = static_cast<float>(position(right) - position(left));
+      if (left_at_edge || right_at_edge) {
+        rec.flags |= caen_pulse_record::WidthAtEdge;
+      }
+
+      if (begin == 0) {
+        rec.flags |= caen_pulse_record::StartTruncated;
+      }
+      if (end == n) {
+        rec.flags |= caen_pulse_record::EndTruncated;
+      }
+      if (extreme == (positive ? UINT16_MAX : 0)) {
+        rec.flags |= caen_pulse_record::Saturated;
+      }
+      out.push_back(rec);
+    }
+    return m_regions.size();
+  }
+
+  const Config &config() const { return m_config; }
+
+private:
+  double baseline(const uint16_t *ys, size_t n, uint16_t &flags) const {
+    const size_t begin = std::min<size_t>(m_config.baseline_start, n);
+    const size_t end = std::min<size_t>(size_t{m_config.baseline_start} + m_config.baseline_samples, n);
+    if (begin == end) {
+      flags |= caen_pulse_record::NoBaseline;
+      return 0;
+    }
+    caen_event_summary_detail::reduction r;
+    caen_event_summary_detail::reduce(ys + begin, end - begin, r);
+    return static_cast<double>(r.sum) / static_cast<double>(end - begin);
+  }
+
+  const Config m_config;
+  std::vector<caen_sample_range> m_runs;
+  std::vector<caen_sample_range> m_regions;
+};
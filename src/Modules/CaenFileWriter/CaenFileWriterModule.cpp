@@ -23,6 +23,8 @@
 #include <fmt/core.h>
 #include <fmt/format.h>
 #include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
 #include "Utils/Common.hpp"
 #include "Utils/Ers.hpp"
 #include "CaenFileWriterModule.hpp"
@@ -92,6 +94,14 @@ CaenFileWriterModule::WriteState CaenFileWriterModule::FileGenerator::next()
   std::string daqling_str = cstr == nullptr ? "./" : cstr;
   ERS_DEBUG(0, " Environment: {daqling_dir}="<<daqling_str);
 
+  std::string root = ".";
+  if (m_settings.output_roots) {
+    m_state.root = m_settings.output_roots->select(m_state.chid);
+    root = (*m_settings.output_roots)[m_state.root].path;
+  }
+  const bool prefix_root = m_settings.output_roots && fs::path(m_settings.filename_pattern).is_relative()
+                           && m_settings.filename_pattern.find("{root") == std::string::npos;
+
   std::vector<std::string> fnames(fnames_pattern.size());
   while (true) {
     for (std::size_t i = 0, i_end_ = fnames_pattern.size(); i!=i_end_; ++i) {
@@ -110,7 +120,10 @@ CaenFileWriterModule::WriteState CaenFileWriterModule::FileGenerator::next()
                     fmt::arg("run", m_state.run_number),
                     fmt::arg("ch", channels[i]),
                     fmt::arg("filenum", m_state.filenum),
-                    fmt::arg("device", m_settings.device_name));
+                    fmt::arg("device", m_settings.device_name),
+                    fmt::arg("root", root));
+        if (prefix_root)
+          fnames[i] = (fs::path(root) / fnames[i]).string();
       }
       catch (const fmt::format_error &e) {
         throw FormatError(ERS_HERE, fnames_pattern[i], e.what());
@@ -162,20 +175,20 @@ bool CaenFileWriterModule::FileGenerator::check_all_names_changed(const std::vec
   return true;
 }
 
-std::vector<std::ofstream> CaenFileWriterModule::open_ofstreams(WriteState& state, const Settings &settings, bool append)
+CaenOutputStreams CaenFileWriterModule::open_streams(WriteState& state, const Settings &settings, bool append)
 {
-  std::vector<std::ofstream> ret;
+  CaenOutputStreams ret;
   for (const auto & fn : state.filenames) {
     fs::path file_path(fn);
     fs::create_directories(file_path.parent_path());
-    std::ofstream str(fn, (settings.file_format == Settings::FileFormat::Binary ? std::ios::binary : std::ios::out) |
-                          (append ? std::ios::app : std::ios::out));
+    daqutils::IoStream str(daqutils::IoBackend::create(settings.io));
+    str.open(fn, append);
     if (!str.is_open()) {
       state.error_code = WriteState::ErrorCode::FilestreamsNotOpened;
       ret.clear();
       ERS_WARNING("Could not open file '"
-                << fn
-                << "'. The event will not be written and output will proceed to next files.");
+                << fn << "' (" << str.error()
+                << "). The event will not be written and output will proceed to next files.");
       return ret;
     }
     ret.push_back(std::move(str));
@@ -183,6 +196,148 @@ std::vector<std::ofstream> CaenFileWriterModule::open_ofstreams(WriteState& stat
   return ret;
 }
 
+CaenFileWriterModule::PreparedFiles CaenFileWriterModule::prepare_files(WriteState state, const Settings &settings)
+{
+  FileGenerator gen(state, settings);
+  PreparedFiles ret{gen.next(), {}};
+  if (!ret.state.is_error())
+    ret.streams = open_streams(ret.state, settings);
+  return ret;
+}
+
+void CaenFileWriterModule::write_index(CaenOutputStreams &streams, const std::vector<std::string> &filenames,
+                                       const std::vector<caen_file_index> &index, bool text)
+{
+  for (std::size_t i = 0, i_end_ = std::min(filenames.size(), index.size()); i != i_end_; ++i) {
+    if (index[i].empty())
+      continue;
+    const bool own_stream = text || i >= streams.size() || !streams[i].is_open();
+    std::ofstream out;
+    if (own_stream)
+      out.open(text ? filenames[i] + ".idx" : filenames[i], std::ios::binary | (text ? std::ios::trunc : std::ios::app));
+    std::ostream &dest = own_stream ? static_cast<std::ostream &>(out) : streams[i];
+    index[i].write(dest);
+    dest.flush();
+    if (dest.fail())
+      ERS_WARNING("Could not write event index of file '" << filenames[i] << "'");
+  }
+}
+
+void CaenFileWriterModule::write_summaries(const std::vector<std::string> &filenames,
+                                           const std::vector<caen_event_summary> &summaries)
+{
+  for (std::size_t i = 0, i_end_ = std::min(filenames.size(), summaries.size()); i != i_end_; ++i) {
+    if (summaries[i].empty())
+      continue;
+    std::ofstream out(filenames[i] + ".sum", std::ios::binary | std::ios::trunc);
+    summaries[i].write(out);
+    out.flush();
+    if (out.fail())
+      ERS_WARNING("Could not write event summaries of file '" << filenames[i] << "'");
+  }
+}
+
+void CaenFileWriterModule::close_files(CaenOutputStreams &streams, const std::vector<std::string> &filenames,
+                                       const std::vector<caen_file_index> &index,
+                                       const std::vector<caen_event_summary> &summaries, bool text, bool sync)
+{
+  write_index(streams, filenames, index, text);
+  write_summaries(filenames, summaries);
+  for (std::size_t i = 0, i_end_ = streams.size(); i != i_end_; ++i) {
+    streams[i].close();
+    if (streams[i].fail())
+      ERS_WARNING("Could not close file '" << filenames[i] << "': " << streams[i].error());
+  }
+  streams.clear();
+  if (sync)
+    sync_files(filenames);
+}
+
+void CaenFileWriterModule::sync_files(const std::vector<std::string> &filenames)
+{
+  // The streams do not expose their descriptors, so sync through new ones. Sidecars that were
+  // not written are skipped.
+  for (const auto& fn : filenames) {
+    for (const auto& path : {fn, fn + ".idx", fn + ".sum"}) {
+      int fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0)
+        continue;
+      if (::fsync(fd) != 0)
+        ERS_WARNING("fsync of file '" << path << "' failed");
+      ::close(fd);
+    }
+  }
+}
+
+void CaenFileWriterModule::remove_files(const std::vector<std::string> &filenames)
+{
+  for (const auto& fn : filenames) {
+    std::error_code ec;
+    fs::remove(fs::path(fn), ec);
+    fs::remove(fs::path(fn + ".idx"), ec);
+    fs::remove(fs::path(fn + ".sum"), ec);
+  }
+}
+
+void CaenFileWriterModule::RunManifest::append(unsigned run, const nlohmann::json &entry)
+{
+  char* cstr = getenv("DAQLING_LOCATION");
+  std::string daqling_str = cstr == nullptr ? "./" : cstr;
+  std::string fname;
+  try {
+    fname = fmt::format(m_pattern, fmt::arg("run", run), fmt::arg("daqling_dir", daqling_str));
+  }
+  catch (const fmt::format_error &e) {
+    throw FormatError(ERS_HERE, m_pattern, e.what());
+  }
+  const std::string line = entry.dump() + "\n";
+
+  std::lock_guard<std::mutex> lock(m_mtx);
+  fs::path file_path(fname);
+  std::error_code ec;
+  if (file_path.has_parent_path())
+    fs::create_directories(file_path.parent_path(), ec);
+  int fd = ::open(fname.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (fd < 0) {
+    ERS_WARNING("Could not open run manifest '" << fname << "'. Entry is lost: " << line);
+    return;
+  }
+  if (::write(fd, line.data(), line.size()) != static_cast<ssize_t>(line.size()))
+    ERS_WARNING("Could not append to run manifest '" << fname << "'. Entry is lost: " << line);
+  else if (::fdatasync(fd) != 0)
+    ERS_WARNING("fdatasync of run manifest '" << fname << "' failed");
+  ::close(fd);
+}
+
+nlohmann::json CaenFileWriterModule::manifest_entry(const WriteState &state, const Settings &settings)
+{
+  static const std::map<Settings::FileSplitting, std::string> splittings = {
+    {Settings::FileSplitting::FilePerDevice, "FilePerDevice"},
+    {Settings::FileSplitting::FilePerDeviceHead, "FilePerDeviceHead"},
+    {Settings::FileSplitting::FilePerChannel, "FilePerChannel"},
+    {Settings::FileSplitting::FilePerChannelHead, "FilePerChannelHead"},
+  };
+  const auto& summary = state.files_summary;
+  nlohmann::json entry;
+  entry["run"] = state.run_number;
+  entry["chid"] = state.chid;
+  entry["device"] = settings.device_name;
+  entry["files"] = state.filenames;
+  entry["channels"] = state.caen_channels;
+  entry["format"] = settings.file_format;
+  entry["file_splitting"] = splittings.at(settings.file_splitting);
+  entry["indexed"] = settings.write_index && state.index.size() == state.filenames.size();
+  entry["summarized"] = settings.write_summary && state.summaries.size() == state.filenames.size();
+  entry["events"] = summary.events;
+  entry["bytes"] = summary.bytes;
+  if (summary.events != 0) {
+    entry["first_event"] = summary.first_event;
+    entry["last_event"] = summary.last_event;
+    entry["timestamp_min"] = summary.timestamp_min;
+    entry["timestamp_max"] = summary.timestamp_max;
+  }
+  return entry;
+}
 
 CaenFileWriterModule::CaenFileWriterModule(const std::string &n) : DAQProcess(n), m_stopWriters{false} {
   // Set up static resources...
@@ -207,6 +362,56 @@ void CaenFileWriterModule::configure() {
   default_settings.max_events_per_file = getModuleSettings().value("max_events_per_file", 1000u);
   default_settings.filename_pattern = getModuleSettings().value("filename_pattern",
                                 "CAEN_{date}/{device}_run{run:02d}_ch{ch}_f{filenum:03d}.dat");
+  str = getModuleSettings().value("overflow_policy", "default");
+  default_settings.overflow_policy = Settings::overflow_policy_from_string(str, true);
+  default_settings.spill_directory = getModuleSettings().value("spill_directory", default_settings.spill_directory);
+  default_settings.spill_max_bytes = getModuleSettings().value("spill_max_bytes", default_settings.spill_max_bytes);
+  default_settings.write_index = getModuleSettings().value("write_index", default_settings.write_index);
+  default_settings.write_summary = getModuleSettings().value("write_summary", default_settings.write_summary);
+  default_settings.baseline_start = getModuleSettings().value("baseline_start", default_settings.baseline_start);
+  default_settings.baseline_samples = getModuleSettings().value("baseline_samples", default_settings.baseline_samples);
+  str = getModuleSettings().value("manifest_pattern", "CAEN_manifests/run{run:02d}.jsonl");
+  if (!str.empty()) {
+    try {
+      (void)fmt::format(str, fmt::arg("run", 0u), fmt::arg("daqling_dir", ""));
+    }
+    catch (const fmt::format_error &e) {
+      throw FormatError(ERS_HERE, str, e.what());
+    }
+    default_settings.manifest = std::make_shared<RunManifest>(str);
+  }
+  str = getModuleSettings().value("io_backend", "Buffered");
+  if (auto kind = daqutils::IoBackend::kind_from_string(str))
+    default_settings.io.kind = *kind;
+  else
+    throw InvalidParameter(ERS_HERE, str, std::string("io_backend"));
+  default_settings.io.buffer_size = getModuleSettings().value("io_buffer_size", default_settings.io.buffer_size);
+  default_settings.io.queue_depth = getModuleSettings().value("io_queue_depth", default_settings.io.queue_depth);
+  default_settings.io.direct = getModuleSettings().value("io_direct", default_settings.io.direct);
+  default_settings.io = daqutils::IoBackend::available(default_settings.io);
+  ERS_INFO("I/O backend: " << daqutils::IoBackend::to_string(default_settings.io.kind));
+  // Closed files and their sidecars are synced on the lifecycle thread if sync_on_rotation is set,
+  // and always before their manifest entry: not by the writeback policy, which would sync the
+  // data files a second time.
+  default_settings.sync_on_rotation = getModuleSettings().value("sync_on_rotation", default_settings.sync_on_rotation);
+  daqutils::Writeback::Policy writeback;
+  writeback.range_bytes = getModuleSettings().value("writeback_bytes", writeback.range_bytes);
+  writeback.sync_interval = std::chrono::milliseconds(getModuleSettings().value("sync_interval_ms", 0u));
+  writeback.drop_cache = getModuleSettings().value("drop_cache", writeback.drop_cache);
+  if (writeback.enabled())
+    default_settings.io.writeback = std::make_shared<daqutils::Writeback>(writeback, &m_writebackStats);
+  // Module-wide: the events of each channel are put in order before they reach its destinations.
+  m_reorder.window = getModuleSettings().value("reorder_window", 0u);
+  m_reorder.timeout = std::chrono::milliseconds(getModuleSettings().value("reorder_timeout_ms", 0u));
+  if (getModuleSettings().contains("output_roots")) {
+    std::vector<std::string> roots = getModuleSettings()["output_roots"];
+    str = getModuleSettings().value("root_placement", "RoundRobin");
+    auto placement = daqutils::OutputRoots::placement_from_string(str);
+    if (!placement)
+      throw InvalidParameter(ERS_HERE, str, std::string("root_placement"));
+    if (!roots.empty())
+      default_settings.output_roots = std::make_shared<daqutils::OutputRoots>(roots, *placement);
+  }
 
   if (getModuleSettings().contains("inputs")) {
     auto recvs = getModuleSettings()["inputs"];
@@ -231,6 +436,33 @@ void CaenFileWriterModule::configure() {
       m_channelSettings[ch].max_total_events = elem.value("max_total_events", default_settings.max_total_events);
       m_channelSettings[ch].max_events_per_file = elem.value("max_events_per_file", default_settings.max_events_per_file);
       m_channelSettings[ch].filename_pattern = elem.value("filename_pattern", default_settings.filename_pattern);
+      if (elem.contains("overflow_policy"))
+        m_channelSettings[ch].overflow_policy = Settings::overflow_policy_from_string(elem["overflow_policy"], false);
+      m_channelSettings[ch].spill_directory = elem.value("spill_directory", default_settings.spill_directory);
+      m_channelSettings[ch].spill_max_bytes = elem.value("spill_max_bytes", default_settings.spill_max_bytes);
+      m_channelSettings[ch].write_index = elem.value("write_index", default_settings.write_index);
+      m_channelSettings[ch].write_summary = elem.value("write_summary", default_settings.write_summary);
+      m_channelSettings[ch].baseline_start = elem.value("baseline_start", default_settings.baseline_start);
+      m_channelSettings[ch].baseline_samples = elem.value("baseline_samples", default_settings.baseline_samples);
+    }
+  }
+
+  // Every event is written to each destination, by default the filename_pattern of its channel.
+  m_destinations.clear();
+  if (getModuleSettings().contains("destinations")) {
+    for (const auto& elem : getModuleSettings()["destinations"]) {
+      Destination &dest = m_destinations.emplace_back();
+      dest.filename_pattern = elem.at("filename_pattern");
+      dest.queue_size = elem.value("queue_size", dest.queue_size);
+      if (elem.contains("overflow_policy"))
+        dest.overflow_policy = Settings::overflow_policy_from_string(elem["overflow_policy"], false);
+      if (elem.contains("spill_directory"))
+        dest.spill_directory = elem["spill_directory"];
+      if (elem.contains("spill_max_bytes"))
+        dest.spill_max_bytes = elem["spill_max_bytes"];
+      for (std::size_t i = 0; i + 1 < m_destinations.size(); ++i)
+        if (m_destinations[i].filename_pattern == dest.filename_pattern)
+          throw InvalidParameter(ERS_HERE, dest.filename_pattern, std::string("destinations"));
     }
   }
 
@@ -241,26 +473,90 @@ void CaenFileWriterModule::configure() {
       m_channelSettings[chid] = default_settings;
       m_channelSettings[chid].device_name = "dev" + std::to_string(chid);
     }
+    // Instantiate the record format for the channel's settings.
+    Settings &settings = m_channelSettings[chid];
+    settings.format = CaenRecordFormats<EventPointType>::instance().create(settings.file_format, settings.file_splitting);
+    if (!settings.format)
+      throw InvalidParameter(ERS_HERE, settings.file_format, std::string("Settings::FileFormat"));
     // Contruct variables for metrics and writer states
-    m_channelMetrics[chid];
-    const auto & [ it, success ] = m_channelStates.emplace(chid, chid);
-    assert(success);
+    for (std::size_t dest = 0; dest != num_destinations(); ++dest) {
+      m_channelMetrics[chid].destinations[dest];
+      const auto & [ it, success ] = m_channelStates.emplace(std::make_pair(chid, dest), chid);
+      assert(success);
+    }
+  }
+
+  for (const auto & [ chid, channel_settings ] : m_channelSettings) {
+    for (std::size_t dest = 0; dest != num_destinations(); ++dest) {
+      const Settings settings = destination_settings(chid, dest);
+      if (settings.output_roots && fs::path(settings.filename_pattern).is_absolute()
+          && settings.filename_pattern.find("{root") == std::string::npos)
+        ERS_WARNING("Absolute filename pattern \"" << settings.filename_pattern << "\" of chid " << chid
+                    << " has no {root}; output_roots are not used for it.");
+      if (num_destinations() > 1 && settings.overflow_policy == PayloadQueue::Policy::Block)
+        ERS_WARNING("Destination \"" << settings.filename_pattern << "\" of chid " << chid
+                    << " blocks its input once it falls behind by queue_size events, holding back the"
+                    << " other destinations; consider the Spill or Drop overflow policies.");
+    }
   }
 
   ERS_DEBUG(0, "setup finished");
 
   if (m_statistics) {
+    if (default_settings.output_roots) {
+      auto &roots = *default_settings.output_roots;
+      for (std::size_t i = 0; i != roots.size(); ++i) {
+        m_statistics->registerMetric<std::atomic<size_t>>(&roots[i].bytes_written,
+                                                          "BytesWritten_root" + std::to_string(i),
+                                                          daqling::core::metrics::RATE);
+        m_statistics->registerMetric<std::atomic<size_t>>(&roots[i].write_latency_us,
+                                                          "WriteLatency_us_root" + std::to_string(i),
+                                                          daqling::core::metrics::AVERAGE);
+      }
+    }
+    if (default_settings.io.writeback) {
+      m_statistics->registerMetric<std::atomic<size_t>>(&m_writebackStats.range_latency_us, "WritebackLatency_us",
+                                                        daqling::core::metrics::AVERAGE);
+      m_statistics->registerMetric<std::atomic<size_t>>(&m_writebackStats.sync_latency_us, "SyncLatency_us",
+                                                        daqling::core::metrics::AVERAGE);
+    }
     // Register statistical variables
     for (auto & [ chid, metrics ] : m_channelMetrics) {
-      m_statistics->registerMetric<std::atomic<size_t>>(&metrics.bytes_written,
-                                                        "BytesWritten_chid" + std::to_string(chid),
-                                                        daqling::core::metrics::RATE);
-      m_statistics->registerMetric<std::atomic<size_t>>(
-          &metrics.payload_queue_size, "PayloadQueueSize_chid" + std::to_string(chid),
-          daqling::core::metrics::LAST_VALUE);
       m_statistics->registerMetric<std::atomic<size_t>>(&metrics.payload_size,
                                                         "PayloadSize_chid" + std::to_string(chid),
                                                         daqling::core::metrics::AVERAGE);
+      if (m_reorder.window != 0) {
+        const std::string suffix = "_chid" + std::to_string(chid);
+        m_statistics->registerMetric<std::atomic<size_t>>(&metrics.reorder.late, "ReorderLate" + suffix,
+                                                          daqling::core::metrics::LAST_VALUE);
+        m_statistics->registerMetric<std::atomic<size_t>>(&metrics.reorder.duplicate, "ReorderDuplicate" + suffix,
+                                                          daqling::core::metrics::LAST_VALUE);
+        m_statistics->registerMetric<std::atomic<size_t>>(&metrics.reorder.skipped, "ReorderSkipped" + suffix,
+                                                          daqling::core::metrics::LAST_VALUE);
+        m_statistics->registerMetric<std::atomic<size_t>>(&metrics.reorder.restarts, "ReorderRestarts" + suffix,
+                                                          daqling::core::metrics::LAST_VALUE);
+        m_statistics->registerMetric<std::atomic<size_t>>(&metrics.reorder.held, "ReorderHeld" + suffix,
+                                                          daqling::core::metrics::LAST_VALUE);
+      }
+      for (auto & [ dest, dm ] : metrics.destinations) {
+        const std::string suffix = metric_suffix(chid, dest);
+        m_statistics->registerMetric<std::atomic<size_t>>(&dm.bytes_written, "BytesWritten" + suffix,
+                                                          daqling::core::metrics::RATE);
+        m_statistics->registerMetric<std::atomic<size_t>>(&dm.payload_queue_size, "PayloadQueueSize" + suffix,
+                                                          daqling::core::metrics::LAST_VALUE);
+        m_statistics->registerMetric<std::atomic<size_t>>(&dm.overflow.blocked_us, "OverflowBlockedTime_us" + suffix,
+                                                          daqling::core::metrics::RATE);
+        m_statistics->registerMetric<std::atomic<size_t>>(&dm.overflow.dropped_newest, "OverflowDroppedNewest" + suffix,
+                                                          daqling::core::metrics::LAST_VALUE);
+        m_statistics->registerMetric<std::atomic<size_t>>(&dm.overflow.dropped_oldest, "OverflowDroppedOldest" + suffix,
+                                                          daqling::core::metrics::LAST_VALUE);
+        m_statistics->registerMetric<std::atomic<size_t>>(&dm.overflow.spilled, "OverflowSpilled" + suffix,
+                                                          daqling::core::metrics::LAST_VALUE);
+        m_statistics->registerMetric<std::atomic<size_t>>(&dm.overflow.unspilled, "OverflowUnspilled" + suffix,
+                                                          daqling::core::metrics::LAST_VALUE);
+        m_statistics->registerMetric<std::atomic<size_t>>(&dm.overflow.spill_bytes, "OverflowSpillBytes" + suffix,
+                                                          daqling::core::metrics::LAST_VALUE);
+      }
     }
     ERS_DEBUG(0, "Metrics are setup");
   }
@@ -274,22 +570,33 @@ void CaenFileWriterModule::start(unsigned run_num) {
   DAQProcess::start(run_num);
   m_stopWriters.store(false);
   unsigned int threadid = 11111;       // XXX: magic
-  constexpr size_t queue_size = 100;   // XXX: magic
 
   for (uint64_t chid = 0; chid < m_channels; ++chid) {
-    // For each connection channel, construct a context of a payload queue, a consumer thread, and a producer
-    // thread, settings and writer state.
-    m_channelStates.at(chid).new_run(run_num, m_channelSettings[chid]);
-    std::array<unsigned int, 2> tids = {threadid++, threadid++};
-    const auto & [ it, success ] =
-        m_channelContexts.emplace(std::piecewise_construct,
-        std::forward_as_tuple(chid),
-        std::forward_as_tuple(queue_size, std::move(tids), m_channelStates.at(chid), m_channelSettings[chid])
-        );
+    // For each connection channel, construct a context of a producer thread and, for each destination,
+    // a payload queue, a consumer thread, settings and writer state.
+    const auto & [ it, success ] = m_channelContexts.emplace(chid, threadid++);
     assert(success);
+    for (std::size_t dest = 0; dest != num_destinations(); ++dest) {
+      Settings settings = destination_settings(chid, dest);
+      // Each destination is written by its own flusher thread, and formats keep scratch buffers:
+      // one instance per destination.
+      settings.format = CaenRecordFormats<EventPointType>::instance().create(settings.file_format, settings.file_splitting);
+      WriteState &state = m_channelStates.at({chid, dest});
+      state.new_run(run_num, settings);
+      PayloadQueue::Config queue_config;
+      queue_config.capacity = m_destinations.empty() ? Destination().queue_size : m_destinations[dest].queue_size;
+      queue_config.policy = settings.overflow_policy;
+      queue_config.spill_filename = (fs::path(settings.spill_directory) /
+                                     (m_name + metric_suffix(chid, dest) + ".spill")).string();
+      queue_config.spill_max_bytes = settings.spill_max_bytes;
+      queue_config.counters = &m_channelMetrics.at(chid).destinations.at(dest).overflow;
+      auto &ctx = *it->second.destinations.emplace_back(
+          std::make_unique<DestinationContext>(queue_config, threadid++, state, settings));
 
-    // Start the context's consumer thread.
-    it->second.consumer.set_work(&CaenFileWriterModule::flusher, this, it->first, std::ref(it->second));
+      ctx.lifecycle.submit([this]() noexcept { addTag(); });
+      // Start the destination's consumer thread.
+      ctx.consumer.set_work(&CaenFileWriterModule::flusher, this, chid, dest, std::ref(ctx));
+    }
   }
   assert(m_channelContexts.size() == m_channels);
 
@@ -304,12 +611,20 @@ void CaenFileWriterModule::stop() {
   m_stop_completed.store(false);
 
   DAQProcess::stop();
+  // The producers pass on what they still hold, and the flushers write everything queued
+  // before they stop.
+  for (auto & [ chid, ctx ] : m_channelContexts) {
+    while (!ctx.producer.get_readiness())
+      std::this_thread::sleep_for(1ms);
+  }
   m_stopWriters.store(true);
   for (auto & [ chid, ctx ] : m_channelContexts) {
     ERS_DEBUG(0, " stopping context[" << chid << "]");
-    while (!ctx.consumer.get_readiness())
-      std::this_thread::sleep_for(1ms);
-    m_channelStates.at(chid) = ctx.write_state;
+    for (std::size_t dest = 0; dest != ctx.destinations.size(); ++dest) {
+      while (!ctx.destinations[dest]->consumer.get_readiness())
+        std::this_thread::sleep_for(1ms);
+      m_channelStates.at({chid, dest}) = ctx.destinations[dest]->write_state;
+    }
   }
   m_channelContexts.clear();
 
@@ -320,7 +635,7 @@ void CaenFileWriterModule::stop() {
 
 void CaenFileWriterModule::unconfigure() {
   for (auto & [key, state] : m_channelStates)
-    state.finish_run(m_channelSettings.at(key));
+    state.finish_run(destination_settings(key.first, key.second));
   m_channelSettings.clear();
   m_channelMetrics.clear();
   m_channelSettings.clear();
@@ -337,26 +652,79 @@ void CaenFileWriterModule::runner() noexcept {
   for (auto &it : m_channelContexts) {
     it.second.producer.set_work([&]() {
       addTag();
-      auto &pq = it.second.queue;
+      auto &destinations = it.second.destinations;
+      auto &metrics = m_channelMetrics.at(it.first);
+      const auto update_lag = [&]() {
+        if (m_statistics) {
+          for (std::size_t dest = 0; dest != destinations.size(); ++dest)
+            metrics.destinations.at(dest).payload_queue_size = destinations[dest]->queue.sizeGuess();
+        }
+      };
+      // Blocking pushes give up at stop, unless the remaining events are being flushed: the
+      // flushers keep writing until this thread is done.
+      const std::atomic<bool> flushing{true};
+      const std::atomic<bool> *push_run = &m_run;
+      const auto dispatch = [&](SharedDataType<EventDataType> &&pl_shared) {
+        pl_shared.make_shared();
+        // Every destination references the same event; overflow is handled according to the policy of each.
+        for (std::size_t dest = 0; dest + 1 < destinations.size(); ++dest) {
+          SharedDataType<EventDataType> reference(pl_shared);
+          destinations[dest]->queue.push(std::move(reference), *push_run);
+        }
+        destinations.back()->queue.push(std::move(pl_shared), *push_run);
+      };
+      // Events are passed on in event number order if reordering is enabled.
+      std::optional<Reorder> reorder;
+      if (m_reorder.window != 0) {
+        Reorder::Config config = m_reorder;
+        config.counters = &metrics.reorder;
+        reorder.emplace(config);
+      }
+      // Set by the first event after start: event numbers may continue from a previous start.
+      std::optional<uint64_t> last_key;
       while (m_run) {
         DataFragment<EventDataType> pl;
-        while (!m_connections.sleep_receive(it.first, pl) && m_run) {
-          if (m_statistics) {
-            m_channelMetrics.at(it.first).payload_queue_size = pq.sizeGuess();
-          }
+        bool received = false;
+        while (!(received = m_connections.sleep_receive(it.first, pl)) && m_run) {
+          for (auto &dest : destinations)
+            dest->queue.service(); // feed back payloads held back by the overflow policy
+          if (reorder)
+            reorder->poll(Reorder::Clock::now(), dispatch);
+          update_lag();
         }
-        if (m_run) {
+        if (received) {
           size_t size = pl.size();
           // ERS_DEBUG(0, " Received " << size << "B payload on channel: " << it.first);
           SharedDataType<EventDataType> pl_shared(std::move(pl));
-          pl_shared.make_shared();
-          while (!pq.write(pl_shared) && m_run) {
-          } // try until successful append
+          if (reorder && pl_shared.get() != nullptr) {
+            // Event numbers are 32-bit: extend them, taking wrap-arounds into account. The first
+            // key is offset by 2^32 so that events arriving late before it do not wrap through 0.
+            const uint32_t event_number = pl_shared.get()->event_number;
+            if (!last_key) {
+              last_key = (uint64_t{1} << 32) | event_number;
+            } else {
+              const int32_t step = static_cast<int32_t>(event_number - static_cast<uint32_t>(*last_key));
+              *last_key += static_cast<uint64_t>(static_cast<int64_t>(step));
+            }
+            reorder->push(*last_key, std::move(pl_shared), Reorder::Clock::now(), dispatch);
+          } else
+            dispatch(std::move(pl_shared));
           if (m_statistics) {
-            m_channelMetrics.at(it.first).payload_size = size;
+            metrics.payload_size = size;
           }
+          update_lag();
         }
       }
+      push_run = &flushing;
+      if (reorder)
+        reorder->flush(dispatch);
+      for (auto &dest : destinations) {
+        while (dest->queue.held() != 0) {
+          dest->queue.service();
+          std::this_thread::sleep_for(1ms);
+        }
+      }
+      update_lag();
     });
   }
 
@@ -366,142 +734,37 @@ void CaenFileWriterModule::runner() noexcept {
   ERS_DEBUG(0, " Runner stopped");
 }
 
-void CaenFileWriterModule::write_event_single_file_text(EventDataType *data, std::vector<std::ofstream> & streams, bool is_short)
-{
-  std::ofstream & out = streams[0];
-  out<<data->event_number<<"\n";
-  out<<data->timestamp<<"\n";
-  //out<<data->device<<"\n";
-  for (std::size_t i = 0, i_end_ = data->ch_data.size(); i != i_end_; ++i) {
-    out<<data->ch_data[i].channel<<"\n";
-    if (!is_short)
-      for (std::size_t j = 0, j_end_ = data->ch_data[i].xs.size(); j!= j_end_; ++j)
-        out<<data->ch_data[i].xs[j]<< ((j == j_end_ - 1) ? "\n" : "\t");
-    for (std::size_t j = 0, j_end_ = data->ch_data[i].ys.size(); j!= j_end_; ++j)
-      out<<data->ch_data[i].ys[j]<< ((j == j_end_ - 1) ? "\n" : "\t");
-  }
-  out<<"\n";
-}
-
-void CaenFileWriterModule::write_event_single_file_binary(EventDataType *data, std::vector<std::ofstream> & streams, bool is_short)
-{
-  std::ofstream & out = streams[0];
-  out<<data->event_number<<data->timestamp;
-  // Not writing device name here.
-  out<<data->ch_data.size();
-  for (std::size_t i = 0, i_end_ = data->ch_data.size(); i != i_end_; ++i) {
-    out<<data->ch_data[i].channel;
-    std::size_t xs_sz = data->ch_data[i].xs.size(), ys_sz = data->ch_data[i].ys.size();
-    if (!is_short) {
-      out<<xs_sz;
-      out.write(reinterpret_cast<const char *>(data->ch_data[i].xs.data()), static_cast<std::streamsize>(sizeof(EventPointType)*xs_sz));
-    }
-    out<<ys_sz;
-    out.write(reinterpret_cast<const char *>(data->ch_data[i].ys.data()), static_cast<std::streamsize>(sizeof(EventPointType)*ys_sz));
-  }
-}
-
-void CaenFileWriterModule::write_event_single_file_head_text(EventDataType *data, std::vector<std::ofstream> & streams, bool is_short)
-{
-  std::ofstream & out_head = streams[0];
-  std::ofstream & out = streams[1];
-  out_head<<data->event_number<<"\n";
-  out_head<<data->timestamp<<"\n";
-  out_head<<data->device<<"\n";
-  for (std::size_t i = 0, i_end_ = data->ch_data.size(); i != i_end_; ++i) {
-    out<<data->ch_data[i].channel<<"\n";
-    if (!is_short)
-      for (std::size_t j = 0, j_end_ = data->ch_data[i].xs.size(); j!= j_end_; ++j)
-        out<<data->ch_data[i].xs[j]<< ((j == j_end_ - 1) ? "\n" : "\t");
-    for (std::size_t j = 0, j_end_ = data->ch_data[i].ys.size(); j!= j_end_; ++j)
-      out<<data->ch_data[i].ys[j]<< ((j == j_end_ - 1) ? "\n" : "\t");
-  }
-  out<<"\n";
-}
-
-void CaenFileWriterModule::write_event_single_file_head_binary(EventDataType *data, std::vector<std::ofstream> & streams, bool is_short)
+bool CaenFileWriterModule::is_normalized(const std::vector<uint16_t>& channels, const EventDataType& event)
 {
-  std::ofstream & out_head = streams[0];
-  std::ofstream & out = streams[1];
-  out_head<<data->event_number<<data->timestamp;
-  // Not writing device name here.
-  out<<data->ch_data.size();
-  for (std::size_t i = 0, i_end_ = data->ch_data.size(); i != i_end_; ++i) {
-    out<<data->ch_data[i].channel;
-    std::size_t xs_sz = data->ch_data[i].xs.size(), ys_sz = data->ch_data[i].ys.size();
-    if (!is_short) {
-      out<<xs_sz;
-      out.write(reinterpret_cast<const char *>(data->ch_data[i].xs.data()), static_cast<std::streamsize>(sizeof(EventPointType)*xs_sz));
-    }
-    out<<ys_sz;
-    out.write(reinterpret_cast<const char *>(data->ch_data[i].ys.data()), static_cast<std::streamsize>(sizeof(EventPointType)*ys_sz));
-  }
-}
-
-void CaenFileWriterModule::write_event_per_channel_text(EventDataType *data, std::vector<std::ofstream> & streams, bool is_short)
-{
-  // Number of channels equals number of streams.
-  for (std::size_t i = 0, i_end_ = streams.size(); i != i_end_; ++i) {
-    streams[i]<<data->event_number<<"\n";
-    streams[i]<<data->timestamp<<"\n";
-    streams[i]<<data->device<<"\n";
-    // streams[i]<<data->ch_data[i].channel<<"\n";
-    if (!is_short)
-      for (std::size_t j = 0, j_end_ = data->ch_data[i].xs.size(); j!= j_end_; ++j)
-        streams[i]<<data->ch_data[i].xs[j]<< ((j == j_end_ - 1) ? "\n" : "\t");
-    for (std::size_t j = 0, j_end_ = data->ch_data[i].ys.size(); j!= j_end_; ++j)
-      streams[i]<<data->ch_data[i].ys[j]<< ((j == j_end_ - 1) ? "\n" : "\t");
-    streams[i]<<"\n";
+  if (event.ch_data.size() != channels.size())
+    return false;
+  for (const auto& event_ch : event.ch_data) {
+    if (std::find(channels.begin(), channels.end(), event_ch.channel) == channels.end())
+      return false;
   }
+  return true;
 }
 
-void CaenFileWriterModule::write_event_per_channel_binary(EventDataType *data, std::vector<std::ofstream> & streams, bool is_short)
+CaenFileWriterModule::Settings CaenFileWriterModule::destination_settings(uint64_t chid, std::size_t dest) const
 {
-  // Number of channels equals number of streams.
-  for (std::size_t i = 0, i_end_ = streams.size(); i != i_end_; ++i) {
-    streams[i]<<data->event_number<<data->timestamp;
-    // Not writing device name and channel here.
-    std::size_t xs_sz = data->ch_data[i].xs.size(), ys_sz = data->ch_data[i].ys.size();
-    if (!is_short) {
-      streams[i]<<xs_sz;
-      streams[i].write(reinterpret_cast<const char *>(data->ch_data[i].xs.data()), static_cast<std::streamsize>(sizeof(EventPointType)*xs_sz));
-    }
-    streams[i]<<ys_sz;
-    streams[i].write(reinterpret_cast<const char *>(data->ch_data[i].ys.data()), static_cast<std::streamsize>(sizeof(EventPointType)*ys_sz));
-  }
+  Settings settings = m_channelSettings.at(chid);
+  if (m_destinations.empty())
+    return settings;
+  const Destination &destination = m_destinations.at(dest);
+  settings.filename_pattern = destination.filename_pattern;
+  settings.overflow_policy = destination.overflow_policy.value_or(settings.overflow_policy);
+  settings.spill_directory = destination.spill_directory.value_or(settings.spill_directory);
+  settings.spill_max_bytes = destination.spill_max_bytes.value_or(settings.spill_max_bytes);
+  return settings;
 }
 
-void CaenFileWriterModule::write_event_per_channel_head_text(EventDataType *data, std::vector<std::ofstream> & streams, bool is_short)
+std::string CaenFileWriterModule::metric_suffix(uint64_t chid, std::size_t dest) const
 {
-  // Number of channels equals number of streams - 1.
-  streams[0]<<data->event_number<<"\n";
-  streams[0]<<data->timestamp<<"\n";
-  streams[0]<<data->device<<"\n";
-  streams[0]<<"\n";
-  for (std::size_t i = 0, i_end_ = data->ch_data.size(); i != i_end_; ++i) {
-    if (!is_short)
-      for (std::size_t j = 0, j_end_ = data->ch_data[i].xs.size(); j!= j_end_; ++j)
-        streams[i+1]<<data->ch_data[i].xs[j]<< ((j == j_end_ - 1) ? "\n" : "\t");
-    for (std::size_t j = 0, j_end_ = data->ch_data[i].ys.size(); j!= j_end_; ++j)
-      streams[i+1]<<data->ch_data[i].ys[j]<< ((j == j_end_ - 1) ? "\n" : "\t");
-    streams[i+1]<<"\n";
-  }
-}
-
-void CaenFileWriterModule::write_event_per_channel_head_binary(EventDataType *data, std::vector<std::ofstream> & streams, bool is_short)
-{
-  // Number of channels equals number of streams - 1.
-  streams[0]<<data->event_number<<data->timestamp;
-  // Not writing device name here.
-  for (std::size_t i = 0, i_end_ = data->ch_data.size(); i != i_end_; ++i) {
-    std::size_t xs_sz = data->ch_data[i].xs.size(), ys_sz = data->ch_data[i].ys.size();
-    if (!is_short) {
-      streams[i+1]<<xs_sz;
-      streams[i+1].write(reinterpret_cast<const char *>(data->ch_data[i].xs.data()), static_cast<std::streamsize>(sizeof(EventPointType)*xs_sz));
-    }
-    streams[i+1]<<ys_sz;
-    streams[i+1].write(reinterpret_cast<const char *>(data->ch_data[i].ys.data()), static_cast<std::streamsize>(sizeof(EventPointType)*ys_sz));
-  }
+  // With a single destination, names are those of the module without destinations.
+  std::string suffix = "_chid" + std::to_string(chid);
+  if (num_destinations() > 1)
+    suffix += "_dest" + std::to_string(dest);
+  return suffix;
 }
 
 void CaenFileWriterModule::normalize_event(const std::vector<uint16_t>& channels, EventDataType* event)
@@ -530,125 +793,24 @@ void CaenFileWriterModule::normalize_event(const std::vector<uint16_t>& channels
       });
 }
 
-void CaenFileWriterModule::flusher(uint64_t chid, Context &context) const {
+void CaenFileWriterModule::flusher(uint64_t chid, std::size_t dest, DestinationContext &context) const {
   addTag();
-  std::vector<std::ofstream> streams;
+  CaenOutputStreams streams;
 
-  const auto flush = [chid](EventDataType *data, const Settings& settings, std::vector<std::ofstream> &streams) {
+  const auto flush = [chid](EventDataType *data, const Settings& settings, CaenOutputStreams &streams) {
     std::vector<std::size_t> bytes_written(streams.size(), 0);
     std::vector<std::streampos> pos1(streams.size());
     for (std::size_t i = 0, i_end_ = streams.size(); i!=i_end_; ++i)
       pos1[i] = streams[i].tellp();
 
-    switch (settings.file_splitting) {
-      case Settings::FileSplitting::FilePerDevice:
-        switch (settings.file_format) {
-          case Settings::FileFormat::Text:
-            write_event_single_file_text(data, streams, false);
-            break;
-          case Settings::FileFormat::Binary:
-            write_event_single_file_binary(data, streams, false);
-            break;
-          case Settings::FileFormat::TextShort:
-            write_event_single_file_text(data, streams, true);
-            break;
-          case Settings::FileFormat::BinaryShort:
-            write_event_single_file_binary(data, streams, true);
-            break;
-          default:
-            ERS_WARNING(std::string(__PRETTY_FUNCTION__) + " One of Settings::FileFormat cases was not implemented.");
-            throw LogicFail(ERS_HERE);
-        }
-        streams[0].flush();
-        if (streams[0].fail()) {
-          ERS_WARNING(" Write operation for channel " << chid << " of event " << data->event_number
-                                                      << " failed!");
-          throw OfstreamFail(ERS_HERE);
-        }
-        break;
-      case Settings::FileSplitting::FilePerDeviceHead:
-        switch (settings.file_format) {
-          case Settings::FileFormat::Text:
-            write_event_single_file_head_text(data, streams, false);
-            break;
-          case Settings::FileFormat::Binary:
-            write_event_single_file_head_binary(data, streams, false);
-            break;
-          case Settings::FileFormat::TextShort:
-            write_event_single_file_head_text(data, streams, true);
-            break;
-          case Settings::FileFormat::BinaryShort:
-            write_event_single_file_head_binary(data, streams, true);
-            break;
-          default:
-            ERS_WARNING(std::string(__PRETTY_FUNCTION__) + " One of Settings::FileFormat cases was not implemented.");
-            throw LogicFail(ERS_HERE);
-        }
-        streams[0].flush();
-        streams[1].flush();
-        if (streams[0].fail() || streams[1].fail()) {
-          ERS_WARNING(" Write operation for channel " << chid << " of event " << data->event_number
-                                                      << " failed!");
-          throw OfstreamFail(ERS_HERE);
-        }
-        break;
-      case Settings::FileSplitting::FilePerChannel:
-        switch (settings.file_format) {
-          case Settings::FileFormat::Text:
-            write_event_per_channel_text(data, streams, false);
-            break;
-          case Settings::FileFormat::Binary:
-            write_event_per_channel_binary(data, streams, false);
-            break;
-          case Settings::FileFormat::TextShort:
-            write_event_per_channel_text(data, streams, true);
-            break;
-          case Settings::FileFormat::BinaryShort:
-            write_event_per_channel_binary(data, streams, true);
-            break;
-          default:
-            ERS_WARNING(std::string(__PRETTY_FUNCTION__) + " One of Settings::FileFormat cases was not implemented.");
-            throw LogicFail(ERS_HERE);
-        }
-        for (std::size_t i = 0, i_end_ = streams.size(); i != i_end_; ++i) {
-          streams[i].flush();
-          if (streams[i].fail()) {
-            ERS_WARNING(" Write operation for chid " << chid << " and channel " << i << " of event "
-                                                     << data->event_number << " failed!");
-            throw OfstreamFail(ERS_HERE);
-          }
-        }
-        break;
-      case Settings::FileSplitting::FilePerChannelHead:
-        switch (settings.file_format) {
-          case Settings::FileFormat::Text:
-            write_event_per_channel_head_text(data, streams, false);
-            break;
-          case Settings::FileFormat::Binary:
-            write_event_per_channel_head_binary(data, streams, false);
-            break;
-          case Settings::FileFormat::TextShort:
-            write_event_per_channel_head_text(data, streams, true);
-            break;
-          case Settings::FileFormat::BinaryShort:
-            write_event_per_channel_head_binary(data, streams, true);
-            break;
-          default:
-            ERS_WARNING(std::string(__PRETTY_FUNCTION__) + " One of Settings::FileFormat cases was not implemented.");
-            throw LogicFail(ERS_HERE);
-        }
-        for (std::size_t i = 0, i_end_ = streams.size(); i != i_end_; ++i) {
-          streams[i].flush();
-          if (streams[i].fail()) {
-            ERS_WARNING(" Write operation for chid " << chid << " and channel " << i << " of event "
-                                                     << data->event_number << " failed!");
-            throw OfstreamFail(ERS_HERE);
-          }
-        }
-        break;
-      default:
-        ERS_WARNING(std::string(__PRETTY_FUNCTION__) + " One of Settings::FileSplitting cases was not implemented.");
-        throw LogicFail(ERS_HERE);
+    settings.format->write(*data, streams);
+    for (std::size_t i = 0, i_end_ = streams.size(); i != i_end_; ++i) {
+      streams[i].flush();
+      if (streams[i].fail()) {
+        ERS_WARNING(" Write operation for chid " << chid << " to file #" << i << " of event "
+                                                 << data->event_number << " failed!");
+        throw WriteFail(ERS_HERE, streams[i].error());
+      }
     }
 
     for (std::size_t i = 0, i_end_ = streams.size(); i!=i_end_; ++i)
@@ -659,12 +821,59 @@ void CaenFileWriterModule::flusher(uint64_t chid, Context &context) const {
   const Settings& settings = context.settings;
   WriteState& state = context.write_state;
   bool continuing_after_pause = !state.filenames.empty();
-  while (!m_stopWriters) {
+  // Files for after the next rotation are created on the lifecycle thread while the current ones are written.
+  std::future<PreparedFiles> next_files;
+
+  // Files are final unless writing is only paused; only then their index and summaries are written.
+  const auto close_async = [&](bool final = true) {
+    if (streams.empty())
+      return;
+    std::vector<caen_file_index> index;
+    std::vector<caen_event_summary> summaries;
+    nlohmann::json entry;
+    if (final) {
+      if (settings.manifest)
+        entry = manifest_entry(state, settings);
+      index = std::move(state.index);
+      state.index.clear();
+      summaries = std::move(state.summaries);
+      state.summaries.clear();
+      state.files_summary = WriteState::FilesSummary();
+    }
+    // The manifest entry is appended only once the files are on disk.
+    const bool sync = settings.sync_on_rotation || (final && settings.manifest);
+    context.lifecycle.submit([str = std::move(streams), fnames = state.filenames, index = std::move(index),
+                              summaries = std::move(summaries), text = settings.is_text(), sync, entry = std::move(entry),
+                              run = state.run_number, manifest = settings.manifest]() mutable {
+      close_files(str, fnames, index, summaries, text, sync);
+      if (manifest && !entry.is_null())
+        manifest->append(run, entry);
+    });
+    streams.clear();
+  };
+  const auto discard_next_files = [&]() {
+    if (!next_files.valid())
+      return;
+    // Runs after the preparation itself as the lifecycle thread executes tasks in order.
+    context.lifecycle.submit([prepared = std::move(next_files)]() mutable {
+      try {
+        PreparedFiles next = prepared.get();
+        next.streams.clear();
+        remove_files(next.state.filenames);
+      } catch (const std::exception &e) {
+        ERS_DEBUG(0, " Discarded preparation of next files had failed: " << e.what());
+      }
+    });
+  };
+
+  while (true) {
     while (context.queue.isEmpty() && !m_stopWriters) { // wait until we have something to write
       std::this_thread::sleep_for(1ms);
     };
-    if (m_stopWriters) {
-      streams.clear();
+    // Set once the producer is done: what is still queued is written first.
+    if (m_stopWriters && context.queue.isEmpty()) {
+      close_async(settings.when_stopped_writing != Settings::StopBehavior::Pause);
+      discard_next_files();
       switch (settings.when_stopped_writing) {
       case Settings::StopBehavior::Pause:
         ERS_DEBUG(0, " Paused writing. Files are closed.");
@@ -677,11 +886,7 @@ void CaenFileWriterModule::flusher(uint64_t chid, Context &context) const {
         break;
       case Settings::StopBehavior::CloseAndTrim:
         if (state.num_events_written > 0 && state.num_events_written < settings.max_events_per_file) {
-          for (const auto& fn : state.filenames) {
-            fs::path file_path(fn);
-            std::error_code ec;
-            fs::remove(file_path, ec);
-          }
+          context.lifecycle.submit([fnames = state.filenames]() { remove_files(fnames); });
           if (state.filenum > 0)
             --state.filenum;
           ERS_DEBUG(0, " Stopped writing. Last files are deleted.");
@@ -697,7 +902,10 @@ void CaenFileWriterModule::flusher(uint64_t chid, Context &context) const {
     }
 
     auto payload = context.queue.frontPtr();
+    if (payload == nullptr) // Everything queued was dropped by the overflow policy
+      continue;
     EventDataType* event = payload->get();
+    std::optional<EventDataType> normalized;
     std::vector<std::size_t> bytes_written;
     std::size_t total_bytes_written = 0;
 
@@ -711,9 +919,29 @@ void CaenFileWriterModule::flusher(uint64_t chid, Context &context) const {
       state.caen_channels.reserve(event->ch_data.size());
       for (const auto& ch : event->ch_data)
         state.caen_channels.push_back(ch.channel);
-    } else {
+    } else if (!is_normalized(state.caen_channels, *event)) {
+      // The event is shared by the destinations of the channel: normalize a copy.
+      event = &normalized.emplace(*event);
       normalize_event(state.caen_channels, event);
     }
+    if (state.filenames.empty() && next_files.valid()) {
+      // Normally the files were prepared long ago and this does not wait.
+      PreparedFiles next = next_files.get();
+      state.error_code = next.state.error_code;
+      state.filenames = next.state.filenames;
+      state.filenum = next.state.filenum;
+      state.root = next.state.root;
+      streams = std::move(next.streams);
+      state.index.assign(settings.write_index ? streams.size() : 0, caen_file_index{});
+      state.summaries.assign(settings.write_summary ? streams.size() : 0,
+                             caen_event_summary(settings.baseline_start, settings.baseline_samples));
+      state.files_summary = WriteState::FilesSummary();
+      ERS_DEBUG(0, " Switched to prepared files: "<<list_files(state.filenames));
+      if (state.is_error()) {
+        state.filenames.clear();
+        goto skip;
+      }
+    }
     if (state.filenames.empty()) {
       FileGenerator gen(state, settings);
       state = gen.next();
@@ -729,41 +957,79 @@ void CaenFileWriterModule::flusher(uint64_t chid, Context &context) const {
     // If necessary, open streams. In case the writing was
     // stopped and continued, open streams in append mode.
     if (streams.empty()) {
-      streams = open_ofstreams(state, settings, continuing_after_pause);
+      streams = open_streams(state, settings, continuing_after_pause);
       if (continuing_after_pause)
         ERS_DEBUG(0, " Re-opened "<<streams.size()<<" file streams after pausing writing.");
       else
         ERS_DEBUG(0, " Opened "<<streams.size()<<" file streams.");
+      // Paused files keep their index and summaries, unless they do not match the files (then none are written).
+      if (!continuing_after_pause) {
+        state.index.assign(settings.write_index ? streams.size() : 0, caen_file_index{});
+        state.summaries.assign(settings.write_summary ? streams.size() : 0,
+                               caen_event_summary(settings.baseline_start, settings.baseline_samples));
+        state.files_summary = WriteState::FilesSummary();
+      } else {
+        if (state.index.size() != streams.size())
+          state.index.clear();
+        if (state.summaries.size() != streams.size())
+          state.summaries.clear();
+      }
       continuing_after_pause = false;
       if (state.is_error()) {
         state.filenames.clear();
         goto skip;
       }
     }
+    if (!next_files.valid() && settings.max_events_per_file < settings.max_total_events) {
+      WriteState next = state;
+      next.index.clear();
+      next.summaries.clear();
+      next_files = context.lifecycle.submit([next = std::move(next), settings]() { return prepare_files(next, settings); });
+    }
 
-    bytes_written = flush(event, context.settings, streams);
+    {
+      const auto write_start = std::chrono::steady_clock::now();
+      bytes_written = flush(event, context.settings, streams);
+      for (const auto& b : bytes_written)
+        total_bytes_written += b;
+      if (settings.output_roots)
+        settings.output_roots->record(state.root, total_bytes_written,
+                                      std::chrono::steady_clock::now() - write_start);
+    }
+    state.files_summary.add(*event, total_bytes_written);
+    if (state.index.size() == bytes_written.size()) {
+      for (std::size_t i = 0, i_end_ = bytes_written.size(); i != i_end_; ++i)
+        state.index[i].add(event->event_number, event->timestamp, bytes_written[i]);
+    }
+    if (state.summaries.size() == bytes_written.size()) {
+      for (std::size_t k = 0, k_end_ = event->ch_data.size(); k != k_end_; ++k) {
+        const auto& ch = event->ch_data[k];
+        const std::size_t file = caen_channel_file(settings.file_splitting, k);
+        if (file < state.summaries.size())
+          state.summaries[file].add(event->event_number, event->timestamp, ch.channel, ch.ys.data(), ch.ys.size());
+      }
+    }
     ++state.num_events_written;
     ++state.num_total_events_written;
     state.last_event_written = event->event_number;
 
     if (state.num_events_written >= settings.max_events_per_file) { // Rotate output files
       ERS_DEBUG(0, " Rotating output files for channel " << chid);
-      streams.clear();
+      close_async();
       state.filenames.clear();
       state.num_events_written = 0;
     }
     if (state.num_total_events_written >= settings.max_total_events) {
       ERS_WARNING(" Reached maximum total events for channel " << chid);
       state.error_code = WriteState::ErrorCode::MaxTotalEventsReached;
-      streams.clear();
+      close_async();
+      discard_next_files();
       state.filenames.clear();
       // TODO: stop
     }
-    
-    for (const auto& b : bytes_written)
-      total_bytes_written += b;
+
     ERS_DEBUG(0, " Wrote event #"<<event->event_number<<" ("<<total_bytes_written<<" bytes)");
-    m_channelMetrics.at(chid).bytes_written += total_bytes_written;
+    m_channelMetrics.at(chid).destinations.at(dest).bytes_written += total_bytes_written;
   skip:
     // We are done with the payload; destruct it.
     context.queue.popFront();
@@ -772,15 +1038,17 @@ void CaenFileWriterModule::flusher(uint64_t chid, Context &context) const {
 
 void CaenFileWriterModule::monitor_runner() {
   addTag();
-  std::map<uint64_t, uint64_t> prev_value;
+  std::map<std::pair<uint64_t, std::size_t>, uint64_t> prev_value;
   while (m_run) {
     std::this_thread::sleep_for(1s);
     for (auto & [ chid, metrics ] : m_channelMetrics) {
-      // ERS_DEBUG(0, "Bytes written (channel "
-      //         << chid
-      //         << "): " << static_cast<double>(metrics.bytes_written - prev_value[chid]) / 1000000
-      //         << " MBytes/s");
-      prev_value[chid] = metrics.bytes_written;
+      for (auto & [ dest, dm ] : metrics.destinations) {
+        // ERS_DEBUG(0, "Bytes written (channel "
+        //         << chid
+        //         << "): " << static_cast<double>(dm.bytes_written - prev_value[{chid, dest}]) / 1000000
+        //         << " MBytes/s");
+        prev_value[{chid, dest}] = dm.bytes_written;
+      }
     }
   }
 }
@@ -18,13 +18,28 @@
 #pragma once
 
 #include <fstream>
+#include <future>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
 #include <filesystem>
+#include <nlohmann/json.hpp>
 #include "Core/DAQProcess.hpp"
+#include "Utils/BackgroundWorker.hpp"
 #include "Utils/Binary.hpp"
+#include "Utils/IoBackend.hpp"
+#include "Utils/OutputRoots.hpp"
+#include "Utils/OverflowQueue.hpp"
+#include "Utils/ReorderBuffer.hpp"
 #include "Utils/ReusableThread.hpp"
-#include "folly/ProducerConsumerQueue.h"
+#include "Utils/Writeback.hpp"
+#include "Common/CaenEventSummary.hpp"
+#include "Common/CaenFileIndex.hpp"
 #include "Common/CaenOutputFormat.hpp"
+#include "CaenRecordFormats.hpp"
 
 namespace fs = std::filesystem;
 namespace daqling {
@@ -33,7 +48,7 @@ namespace daqling {
 ERS_DECLARE_ISSUE(module, FormatError, "Filename generation for name pattern \""<<fname<<"\" failed.\n\tReason: "<<format_error,
                   ((std::string)fname)((std::string)format_error))
 ERS_DECLARE_ISSUE(module, NoFilePermission, "Permission for file \"" << fname <<"\" denied.", ((std::string)fname))
-ERS_DECLARE_ISSUE(module, OfstreamFail, "std::ofstream::fail()", ERS_EMPTY)
+ERS_DECLARE_ISSUE(module, WriteFail, "Writing output file failed: " << reason, ((std::string)reason))
 ERS_DECLARE_ISSUE(module, LogicFail, "Logic failure: the unreachable code was reached.", ERS_EMPTY)
 ERS_DECLARE_ISSUE(module, InvalidParameter, "Invalid parameter \""<< par <<"\" was provided for "<<target<<".",
                   ((std::string)par)((std::string)target))
@@ -55,20 +70,31 @@ public:
   void monitor_runner();
 
 private:
+  using EventPointType = uint16_t;
+  using EventDataType = caen_output_data<EventPointType>;
+  using PayloadQueue = daqling::utilities::OverflowQueue<SharedDataType<EventDataType>>;
+  using Reorder = daqling::utilities::ReorderBuffer<SharedDataType<EventDataType>>;
+
+  /// Per-run catalog of the written files, so that they can be planned for without opening them.
+  /// One JSON line per finished set of files, appended with a single write() on an O_APPEND
+  /// descriptor so readers never see partial entries. Shared by all channels.
+  class RunManifest {
+  public:
+    /// {run} (formatted as a number) and {daqling_dir} are substituted in `pattern`.
+    RunManifest(std::string pattern) : m_pattern(std::move(pattern)) {}
+    void append(unsigned run, const nlohmann::json &entry);
+
+  private:
+    std::mutex m_mtx;
+    const std::string m_pattern;
+  };
+
   // Settings are provided for each device connected to the file writer (for each DAQling channel).
   struct Settings {
-      enum FileFormat {
-        Binary,
-        Text,
-        BinaryShort, // Write only y data. Use only when x step is fixed.
-        TextShort,   // Write only y data. Use only when x step is fixed.
-      } file_format = BinaryShort;
-      enum FileSplitting {
-        FilePerDevice,      // All data from each connection (device) is congregated to single file.
-        FilePerDeviceHead,  // Same as FilePerDevice, but header event info is written to a separate file.
-        FilePerChannel,     // Data both from each connection (device) and from each channel in it is written to its own file.
-        FilePerChannelHead, // Same as FilePerChannel, but header event info is also written to separate file.
-      } file_splitting = FilePerDevice;
+      // Name of a format registered in CaenRecordFormats (built-in: Binary, Text, BinaryShort, TextShort).
+      std::string file_format = "BinaryShort";
+      using FileSplitting = caen_file_splitting;
+      FileSplitting file_splitting = FileSplitting::FilePerDevice;
       enum StopBehavior {
         Pause,        // Take no action after stopping writing events.
         CloseFiles,   // After stopping writing events close all files and proceed to the next ones.
@@ -89,19 +115,37 @@ private:
     // Will stop writing after reaching this limit
     // TODO: should transition the module into 'configured' state.
     size_t max_total_events = SIZE_MAX;
+    // What the receiving thread does when the payload queue is full.
+    PayloadQueue::Policy overflow_policy = PayloadQueue::Policy::Block;
+    std::string spill_directory = "/tmp";
+    size_t spill_max_bytes = SIZE_MAX;
+    // Output directories (disks) to stripe files across. Shared by all channels; may be null.
+    std::shared_ptr<daqling::utilities::OutputRoots> output_roots;
+    // Append an event index (see CaenFileIndex.hpp) to closed files, or write it to "<file>.idx" for text formats.
+    bool write_index = true;
+    // Write per-event channel summaries (see CaenEventSummary.hpp) of each file to "<file>.sum",
+    // with the baseline taken from baseline_samples samples starting at baseline_start.
+    bool write_summary = false;
+    uint32_t baseline_start = 0;
+    uint32_t baseline_samples = 16;
+    // Writer of the records, created for file_format and file_splitting at configure time, and
+    // anew for each destination at start.
+    std::shared_ptr<CaenRecordFormat<EventPointType>> format;
+    // Run manifest shared by all channels; null if disabled.
+    std::shared_ptr<RunManifest> manifest;
+    // Sync closed files and their sidecars. Module-wide.
+    bool sync_on_rotation = false;
+    // How the files are written (see Utils/IoBackend.hpp). Module-wide.
+    daqling::utilities::IoBackend::Config io;
+
+    bool is_text() const { return format && format->is_text(); }
 
-    static FileFormat file_format_from_string(const std::string& str, bool use_default) {
-      if (str == "Text" || str == "text" || str == "txt") {
-        return Settings::FileFormat::Text;
-      } else if (str == "Binary" || str == "binary" || str == "bin") {
-        return Settings::FileFormat::Binary;
-      } else if (str == "BinaryShort" || str == "binary short" || str == "bin short") {
-        return Settings::FileFormat::BinaryShort;
-      } else if (str == "TextShort" || str == "text short" || str == "txt short") {
-        return Settings::FileFormat::TextShort;
+    static std::string file_format_from_string(const std::string& str, bool use_default) {
+      if (auto name = CaenRecordFormats<EventPointType>::instance().find(str)) {
+        return *name;
       } else {
         if (use_default)
-          return Settings::FileFormat::BinaryShort;
+          return "BinaryShort";
       }
       throw daqling::module::InvalidParameter(ERS_HERE, str, std::string("Settings::FileFormat"));
     }
@@ -159,6 +203,15 @@ private:
       }
       throw daqling::module::InvalidParameter(ERS_HERE, str, std::string("Settings::FinishedRunBehavior"));
     }
+    static PayloadQueue::Policy overflow_policy_from_string(const std::string& str, bool use_default) {
+      if (auto policy = PayloadQueue::policy_from_string(str)) {
+        return *policy;
+      } else {
+        if (use_default)
+          return PayloadQueue::Policy::Block;
+      }
+      throw daqling::module::InvalidParameter(ERS_HERE, str, std::string("Settings::overflow_policy"));
+    }
   };
 
   struct WriteState {
@@ -169,6 +222,27 @@ private:
     std::size_t num_total_events_written;
     std::size_t last_event_written;
     std::vector<std::string> filenames;
+    std::size_t root; // Index in Settings::output_roots of the current files.
+    std::vector<caen_file_index> index; // Event index of each of the current files.
+    std::vector<caen_event_summary> summaries; // Channel summaries of each of the current files.
+    // What the current files hold, for the run manifest.
+    struct FilesSummary {
+      std::size_t events = 0;
+      std::size_t bytes = 0;
+      std::size_t first_event = SIZE_MAX;
+      std::size_t last_event = SIZE_MAX;
+      uint64_t timestamp_min = UINT64_MAX;
+      uint64_t timestamp_max = 0;
+
+      void add(const EventDataType &event, std::size_t event_bytes) {
+        if (events++ == 0)
+          first_event = event.event_number;
+        last_event = event.event_number;
+        timestamp_min = std::min(timestamp_min, event.timestamp);
+        timestamp_max = std::max(timestamp_max, event.timestamp);
+        bytes += event_bytes;
+      }
+    } files_summary;
     // There is some handling of the situation when these channels
     // varies from event to event even if it should not normally happen.
     std::vector<uint16_t> caen_channels;
@@ -183,8 +257,8 @@ private:
 
     WriteState(uint64_t channel_id) :
         chid(channel_id), run_number(0), filenum(0), num_events_written(0),
-        num_total_events_written(0), last_event_written(SIZE_MAX), filenames(),
-        caen_channels(), error_code(None) {}
+        num_total_events_written(0), last_event_written(SIZE_MAX), filenames(), root(SIZE_MAX),
+        index(), summaries(), files_summary(), caen_channels(), error_code(None) {}
 
     void new_run(unsigned run, const Settings& settings)
     {
@@ -198,6 +272,23 @@ private:
     void finish_run(const Settings& settings) {
       filenum = 0;
       num_events_written = 0;
+      if (!filenames.empty() && settings.when_finished_run != Settings::FinishedRunBehavior::ClearLast
+          && settings.write_index) {
+        // Files left open by pausing are complete now.
+        CaenOutputStreams no_streams;
+        write_index(no_streams, filenames, index, settings.is_text());
+      }
+      if (!filenames.empty() && settings.when_finished_run != Settings::FinishedRunBehavior::ClearLast)
+        write_summaries(filenames, summaries);
+      if (!filenames.empty() && settings.when_finished_run != Settings::FinishedRunBehavior::ClearLast
+          && (settings.sync_on_rotation || settings.manifest))
+        sync_files(filenames);
+      if (!filenames.empty() && settings.when_finished_run != Settings::FinishedRunBehavior::ClearLast
+          && settings.manifest)
+        settings.manifest->append(run_number, manifest_entry(*this, settings));
+      index.clear();
+      summaries.clear();
+      files_summary = FilesSummary();
       if (!filenames.empty() && settings.when_finished_run == Settings::FinishedRunBehavior::ClearLast) {
           ERS_DEBUG(0, "Finished run. Deleting files: "<<list_files(filenames));
           for (const auto& fn : filenames) {
@@ -216,23 +307,46 @@ private:
     bool is_error(void) const { return error_code != None; }
   };
 
-  using EventPointType = uint16_t;
-  using EventDataType = caen_output_data<EventPointType>;
-  using PayloadQueue = folly::ProducerConsumerQueue<SharedDataType<EventDataType>>;
-  struct Context {
-    Context(size_t queue_size, std::array<unsigned int, 2> tids, WriteState initial_state, const Settings chid_setings) :
-        queue(queue_size), consumer(tids[0]), producer(tids[1]), write_state(initial_state), settings(chid_setings) {}
+  /// Payload queue, writing thread and files of one destination of a channel.
+  struct DestinationContext {
+    DestinationContext(const PayloadQueue::Config &queue_config, unsigned int tid, WriteState initial_state, const Settings dest_settings) :
+        queue(queue_config), consumer(tid), write_state(initial_state), settings(dest_settings) {}
     PayloadQueue queue;
     daqling::utilities::ReusableThread consumer;
-    daqling::utilities::ReusableThread producer;
     WriteState write_state;
     Settings settings;
+    // Creates, closes and deletes files off the consumer thread. Destroyed first,
+    // finishing all queued file operations.
+    daqling::utilities::BackgroundWorker lifecycle;
   };
 
-  struct Metrics {
+  /// The receiving thread of a channel, which passes every payload to all its destinations.
+  struct Context {
+    Context(unsigned int tid) : producer(tid) {}
+    std::vector<std::unique_ptr<DestinationContext>> destinations;
+    daqling::utilities::ReusableThread producer; // Destroyed before the destinations it feeds.
+  };
+
+  /// An output of every channel, written independently of the others ("destinations").
+  /// Unset overflow settings are those of the channel.
+  struct Destination {
+    std::string filename_pattern;
+    size_t queue_size = 100; // Events the destination may fall behind by.
+    std::optional<PayloadQueue::Policy> overflow_policy;
+    std::optional<std::string> spill_directory;
+    std::optional<size_t> spill_max_bytes;
+  };
+
+  struct DestinationMetrics {
     std::atomic<size_t> bytes_written = 0;
-    std::atomic<size_t> payload_queue_size = 0;
+    std::atomic<size_t> payload_queue_size = 0; // The lag of the destination, in events.
+    daqling::utilities::OverflowCounters overflow;
+  };
+
+  struct Metrics {
     std::atomic<size_t> payload_size = 0;
+    daqling::utilities::ReorderCounters reorder;
+    std::map<size_t, DestinationMetrics> destinations;
   };
 
   std::atomic<bool> m_start_completed{true};
@@ -250,6 +364,8 @@ private:
   /// {ch} is substituted to empty string if all channels are written to the same file.
   /// {run} and {filenum} are formatted as numbers so leading zeros can be added:
   /// {run:03d} (will print 000, 001, etc).
+  /// {root} is the output root chosen for the files when "output_roots" are configured ("." otherwise).
+  /// Relative patterns without {root} are placed under the chosen root.
   class FileGenerator {
   public:
     FileGenerator(const WriteState state, const Settings &settings)
@@ -279,10 +395,46 @@ private:
     const Settings m_settings;
   };
 
-  /// Opens filestreams for WriteState. Creates necessary directories if necessary.
+  /// Opens filestreams for WriteState through the configured I/O backend. Creates necessary directories if necessary.
   /// If failed, appropriate error_code is set in m_state.
   /// @warning Always overwrites existing files.
-  static std::vector<std::ofstream> open_ofstreams(WriteState& state, const Settings &settings, bool append = false);
+  static CaenOutputStreams open_streams(WriteState& state, const Settings &settings, bool append = false);
+
+  /// Next set of output files, generated and opened in advance by the lifecycle thread.
+  struct PreparedFiles {
+    WriteState state;
+    CaenOutputStreams streams;
+  };
+
+  /// Generates and opens the set of files following the one in `state`.
+  /// Runs on the lifecycle thread.
+  static PreparedFiles prepare_files(WriteState state, const Settings &settings);
+
+  /// Closes streams, then syncs the files and their sidecars if `sync`. Writes `index` and
+  /// `summaries` first unless they are empty.
+  /// Runs on the lifecycle thread.
+  static void close_files(CaenOutputStreams &streams, const std::vector<std::string> &filenames,
+                          const std::vector<caen_file_index> &index,
+                          const std::vector<caen_event_summary> &summaries, bool text, bool sync);
+
+  /// fsync()s closed files together with their index and summary sidecars.
+  static void sync_files(const std::vector<std::string> &filenames);
+
+  /// Writes the event index of each file: at its end (through the stream if still open) or,
+  /// for text files, to the "<file>.idx" sidecar.
+  static void write_index(CaenOutputStreams &streams, const std::vector<std::string> &filenames,
+                          const std::vector<caen_file_index> &index, bool text);
+
+  /// Writes the channel summaries of each file to its "<file>.sum" sidecar.
+  static void write_summaries(const std::vector<std::string> &filenames,
+                              const std::vector<caen_event_summary> &summaries);
+
+  /// Describes the current files of `state` for the run manifest.
+  static nlohmann::json manifest_entry(const WriteState &state, const Settings &settings);
+
+  /// Removes files together with their index and summary sidecars.
+  /// Runs on the lifecycle thread.
+  static void remove_files(const std::vector<std::string> &filenames);
 
   static std::string list_files(const std::vector<std::string> &filenames) {
       std::stringstream ss;
@@ -295,20 +447,26 @@ private:
   /// @warning Can modify event data if channels are changed between events.
   static void normalize_event(const std::vector<uint16_t>& state, EventDataType* event);
 
+  /// Returns whether the channels of `event` are those of `state` (normalize_event() would not change it).
+  static bool is_normalized(const std::vector<uint16_t>& state, const EventDataType& event);
+
+  size_t num_destinations() const { return std::max<size_t>(1, m_destinations.size()); }
+
+  /// Settings of destination `dest` of channel `chid`.
+  Settings destination_settings(uint64_t chid, size_t dest) const;
+
+  /// "_chid<chid>", followed by "_dest<dest>" if there are several destinations.
+  std::string metric_suffix(uint64_t chid, size_t dest) const;
 
-  static void write_event_single_file_text(EventDataType *data, std::vector<std::ofstream> & streams, bool is_short);
-  static void write_event_single_file_binary(EventDataType *data, std::vector<std::ofstream> & streams, bool is_short);
-  static void write_event_single_file_head_text(EventDataType *data, std::vector<std::ofstream> & streams, bool is_short);
-  static void write_event_single_file_head_binary(EventDataType *data, std::vector<std::ofstream> & streams, bool is_short);
-  static void write_event_per_channel_text(EventDataType *data, std::vector<std::ofstream> & streams, bool is_short);
-  static void write_event_per_channel_binary(EventDataType *data, std::vector<std::ofstream> & streams, bool is_short);
-  static void write_event_per_channel_head_text(EventDataType *data, std::vector<std::ofstream> & streams, bool is_short);
-  static void write_event_per_channel_head_binary(EventDataType *data, std::vector<std::ofstream> & streams, bool is_short);
 
   // Configs
+  daqling::utilities::Writeback::Stats m_writebackStats; // Outlives the Writeback of the settings.
   std::map<uint64_t, Settings> m_channelSettings;
-  std::map<uint64_t, WriteState> m_channelStates;
+  // Empty unless "destinations" are configured; then their patterns replace those of the channels.
+  std::vector<Destination> m_destinations;
+  std::map<std::pair<uint64_t, size_t>, WriteState> m_channelStates; // Per channel and destination.
   uint64_t m_channels = 0;
+  Reorder::Config m_reorder{0}; // Reordering of the events of each channel; disabled with a window of 0.
 
   // Thread control
   std::atomic<bool> m_stopWriters;
@@ -317,7 +475,7 @@ private:
   mutable std::map<uint64_t, Metrics> m_channelMetrics;
 
   // Internals
-  void flusher(uint64_t chid, Context &context) const;
+  void flusher(uint64_t chid, size_t dest, DestinationContext &context) const;
   std::map<uint64_t, Context> m_channelContexts;
   std::thread m_monitor_thread;
 };
@@ -0,0 +1,250 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <charconv>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "Common/CaenFileLayout.hpp"
+#include "Common/CaenOutputFormat.hpp"
+#include "Utils/IoStream.hpp"
+
+/// Output files of one set, as named for the file splitting (head file first).
+using CaenOutputStreams = std::vector<daqling::utilities::IoStream>;
+
+/// Record format of CaenFileWriterModule output files: writes events to the files of one set.
+/// An instance is created per connection (channel) and destination for its file splitting, so
+/// that the per-event path has a single virtual call and no branching on settings. Instances
+/// are used by one thread at a time.
+template <class T> class CaenRecordFormat {
+public:
+  virtual ~CaenRecordFormat() = default;
+  virtual void write(const caen_output_data<T> &event, CaenOutputStreams &streams) = 0;
+  /// Text files get their index in a sidecar file, keeping them readable with text tools.
+  virtual bool is_text() const = 0;
+};
+
+/// Named record formats selectable with the "file_format" setting.
+/// Additional formats are registered with add(), e.g. from a static initializer of their own
+/// translation unit, and need no changes to the writer.
+template <class T> class CaenRecordFormats {
+public:
+  using Factory = std::function<std::unique_ptr<CaenRecordFormat<T>>(caen_file_splitting)>;
+
+  static CaenRecordFormats &instance() {
+    static CaenRecordFormats formats;
+    return formats;
+  }
+
+  /// Registers `factory` under `name` and `aliases`.
+  void add(const std::string &name, const std::vector<std::string> &aliases, Factory factory) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_factories[name] = std::move(factory);
+    m_names[name] = name;
+    for (const auto &alias : aliases) {
+      m_names[alias] = name;
+    }
+  }
+
+  /// Registered name of the format `name_or_alias`, if any.
+  std::optional<std::string> find(const std::string &name_or_alias) const {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    auto it = m_names.find(name_or_alias);
+    if (it == m_names.end()) {
+      return std::nullopt;
+    }
+    return it->second;
+  }
+
+  /// Returns nullptr if `name` is not registered or does not support `splitting`.
+  std::unique_ptr<CaenRecordFormat<T>> create(const std::string &name, caen_file_splitting splitting) const {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    auto it = m_names.find(name);
+    if (it == m_names.end()) {
+      return nullptr;
+    }
+    return m_factories.at(it->second)(splitting);
+  }
+
+  /// Instantiates Format<T, S, Short> for the run-time `splitting`.
+  template <template <class, caen_file_splitting, bool> class Format, bool Short>
+  static std::unique_ptr<CaenRecordFormat<T>> make(caen_file_splitting splitting) {
+    switch (splitting) {
+    case caen_file_splitting::FilePerDevice:
+      return std::make_unique<Format<T, caen_file_splitting::FilePerDevice, Short>>();
+    case caen_file_splitting::FilePerDeviceHead:
+      return std::make_unique<Format<T, caen_file_splitting::FilePerDeviceHead, Short>>();
+    case caen_file_splitting::FilePerChannel:
+      return std::make_unique<Format<T, caen_file_splitting::FilePerChannel, Short>>();
+    case caen_file_splitting::FilePerChannelHead:
+      return std::make_unique<Format<T, caen_file_splitting::FilePerChannelHead, Short>>();
+    }
+    return nullptr;
+  }
+
+private:
+  CaenRecordFormats();
+
+  mutable std::mutex m_mtx;
+  std::map<std::string, Factory> m_factories;
+  std::map<std::string, std::string> m_names; // name or alias -> name
+};
+
+/// Binary formats: native-endian fixed-width fields (see Common/CaenFileReader.hpp).
+/// Short formats write only y data.
+template <class T, caen_file_splitting S, bool Short> class CaenBinaryFormat final : public CaenRecordFormat<T> {
+public:
+  void write(const caen_output_data<T> &event, CaenOutputStreams &streams) override {
+    if constexpr (S == caen_file_splitting::FilePerDevice) {
+      header(streams[0], event);
+      channels(streams[0], event);
+    } else if constexpr (S == caen_file_splitting::FilePerDeviceHead) {
+      header(streams[0], event);
+      channels(streams[1], event);
+    } else if constexpr (S == caen_file_splitting::FilePerChannel) {
+      // Number of channels equals number of streams. Channel is not written.
+      for (std::size_t i = 0, i_end_ = streams.size(); i != i_end_; ++i) {
+        header(streams[i], event);
+        samples(streams[i], event.ch_data[i]);
+      }
+    } else {
+      // Number of channels equals number of streams - 1.
+      header(streams[0], event);
+      for (std::size_t i = 0, i_end_ = event.ch_data.size(); i != i_end_; ++i)
+        samples(streams[i + 1], event.ch_data[i]);
+    }
+  }
+
+  bool is_text() const override { return false; }
+
+private:
+  template <class V> static void raw(std::ostream &out, const V &value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+  }
+
+  static void header(std::ostream &out, const caen_output_data<T> &event) {
+    // Not writing device name here.
+    raw(out, event.event_number);
+    raw(out, event.timestamp);
+  }
+
+  static void array(std::ostream &out, const std::vector<T> &values) {
+    raw(out, static_cast<uint64_t>(values.size()));
+    out.write(reinterpret_cast<const char *>(values.data()), static_cast<std::streamsize>(sizeof(T) * values.size()));
+  }
+
+  static void samples(std::ostream &out, const typename caen_output_data<T>::channel_data &ch) {
+    if constexpr (!Short)
+      array(out, ch.xs);
+    array(out, ch.ys);
+  }
+
+  static void channels(std::ostream &out, const caen_output_data<T> &event) {
+    raw(out, static_cast<uint64_t>(event.ch_data.size()));
+    for (const auto &ch : event.ch_data) {
+      raw(out, ch.channel);
+      samples(out, ch);
+    }
+  }
+};
+
+/// Text formats: one field per line, samples tab-separated, events end with an empty line
+/// (see Common/CaenFileReader.hpp). Short formats write only y data.
+template <class T, caen_file_splitting S, bool Short> class CaenTextFormat final : public CaenRecordFormat<T> {
+public:
+  void write(const caen_output_data<T> &event, CaenOutputStreams &streams) override {
+    if constexpr (S == caen_file_splitting::FilePerDevice) {
+      header(streams[0], event, false);
+      channels(streams[0], event);
+    } else if constexpr (S == caen_file_splitting::FilePerDeviceHead) {
+      header(streams[0], event, true);
+      channels(streams[1], event);
+    } else if constexpr (S == caen_file_splitting::FilePerChannel) {
+      // Number of channels equals number of streams. Channel is not written.
+      for (std::size_t i = 0, i_end_ = streams.size(); i != i_end_; ++i) {
+        header(streams[i], event, true);
+        samples(streams[i], event.ch_data[i]);
+        streams[i] << '\n';
+      }
+    } else {
+      // Number of channels equals number of streams - 1.
+      header(streams[0], event, true);
+      streams[0] << '\n';
+      for (std::size_t i = 0, i_end_ = event.ch_data.size(); i != i_end_; ++i) {
+        samples(streams[i + 1], event.ch_data[i]);
+        streams[i + 1] << '\n';
+      }
+    }
+  }
+
+  bool is_text() const override { return true; }
+
+private:
+  static void header(std::ostream &out, const caen_output_data<T> &event, bool with_device) {
+    out << event.event_number << '\n' << event.timestamp << '\n';
+    if (with_device)
+      out << event.device << '\n';
+  }
+
+  // Formats the whole line before writing it, instead of going through the stream per sample.
+  void line(std::ostream &out, const std::vector<T> &values) {
+    m_line.resize(values.size() * (max_digits + 1) + 1);
+    char *p = m_line.data();
+    char *const end = p + m_line.size();
+    for (std::size_t j = 0, j_end_ = values.size(); j != j_end_; ++j) {
+      if (j != 0)
+        *p++ = '\t';
+      p = std::to_chars(p, end, values[j]).ptr;
+    }
+    *p++ = '\n';
+    out.write(m_line.data(), p - m_line.data());
+  }
+
+  void samples(std::ostream &out, const typename caen_output_data<T>::channel_data &ch) {
+    if constexpr (!Short)
+      line(out, ch.xs);
+    line(out, ch.ys);
+  }
+
+  void channels(std::ostream &out, const caen_output_data<T> &event) {
+    for (const auto &ch : event.ch_data) {
+      out << ch.channel << '\n';
+      samples(out, ch);
+    }
+    out << '\n';
+  }
+
+  static_assert(std::is_integral_v<T>, "CaenTextFormat: only integral sample types are supported.");
+  static constexpr std::size_t max_digits = std::numeric_limits<T>::digits10 + 2; // incl. sign
+  std::vector<char> m_line;
+};
+
+template <class T> CaenRecordFormats<T>::CaenRecordFormats() {
+  add("Binary", {"binary", "bin"}, &CaenRecordFormats::make<CaenBinaryFormat, false>);
+  add("BinaryShort", {"binary short", "bin short"}, &CaenRecordFormats::make<CaenBinaryFormat, true>);
+  add("Text", {"text", "txt"}, &CaenRecordFormats::make<CaenTextFormat, false>);
+  add("TextShort", {"text short", "txt short"}, &CaenRecordFormats::make<CaenTextFormat, true>);
+}
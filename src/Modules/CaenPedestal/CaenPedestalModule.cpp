@@ -0,0 +1,109 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CaenPedestalModule.hpp"
+#include "Common/DataType.hpp"
+#include "Utils/Ers.hpp"
+#include <utility>
+
+using namespace daqling::module;
+
+CaenPedestalModule::CaenPedestalModule(const std::string &n) : DAQProcess(n) {
+  ERS_DEBUG(0, "With config: " << getModuleSettings());
+  const auto &settings = getModuleSettings();
+  const std::string mode = settings.value("mode", std::string("ema"));
+  if (mode == "ema") {
+    m_pedestal.mode = CaenPedestalTracker::Mode::Ema;
+  } else if (mode == "median") {
+    m_pedestal.mode = CaenPedestalTracker::Mode::Median;
+  } else {
+    throw InvalidParameter(ERS_HERE, mode, std::string("mode"));
+  }
+  m_pedestal.alpha = settings.value("alpha", m_pedestal.alpha);
+  if (m_pedestal.alpha <= 0 || m_pedestal.alpha > 1)
+    throw InvalidParameter(ERS_HERE, std::to_string(m_pedestal.alpha), std::string("alpha"));
+  m_pedestal.window_start = settings.value("window_start", m_pedestal.window_start);
+  m_pedestal.window_samples = settings.value("window_samples", m_pedestal.window_samples);
+  if (m_pedestal.window_samples == 0)
+    throw InvalidParameter(ERS_HERE, "0", std::string("window_samples"));
+  // Signed samples would be sent as caen_output_data<uint16_t>, which every consumer (writer,
+  // zero suppression, feature extraction) reads as unsigned: undershoots would wrap to 65535.
+  if (settings.value("signed", false))
+    throw InvalidParameter(ERS_HERE, "true", std::string("signed"));
+  m_pedestal.offset = settings.value("offset", m_pedestal.offset);
+  for (uint16_t channel : settings.value("channels", std::vector<uint16_t>{}))
+    m_channel_metrics.try_emplace(channel);
+  for (auto &[channel, metrics] : m_channel_metrics) {
+    if (m_channel_lookup.size() <= channel)
+      m_channel_lookup.resize(size_t{channel} + 1, nullptr);
+    m_channel_lookup[channel] = &metrics;
+  }
+}
+
+void CaenPedestalModule::configure() {
+  DAQProcess::configure();
+  if (m_statistics) {
+    m_statistics->registerMetric<std::atomic<size_t>>(&m_events, "EventRate", daqling::core::metrics::RATE);
+    for (auto &[channel, metrics] : m_channel_metrics) {
+      const std::string suffix = "_ch" + std::to_string(channel);
+      m_statistics->registerMetric<std::atomic<double>>(&metrics.pedestal, "Pedestal" + suffix,
+                                                        daqling::core::metrics::LAST_VALUE);
+      m_statistics->registerMetric<std::atomic<double>>(&metrics.drift, "PedestalDrift" + suffix,
+                                                        daqling::core::metrics::LAST_VALUE);
+    }
+  }
+}
+
+void CaenPedestalModule::start(unsigned run_num) { DAQProcess::start(run_num); }
+
+void CaenPedestalModule::stop() { DAQProcess::stop(); }
+
+void CaenPedestalModule::runner() noexcept {
+  CaenPedestalTracker tracker(m_pedestal);
+  ERS_DEBUG(0, "Running...");
+  while (m_run) {
+    DataFragment<EventType> pl;
+    while (!m_connections.sleep_receive(0, pl) && m_run) {
+    }
+    if (!m_run || pl.get() == nullptr)
+      continue;
+    EventType &event = *pl.get();
+    for (auto &ch : event.ch_data) {
+      const auto &state = tracker.process(ch.channel, ch.ys.data(), ch.ys.size());
+      if (ch.channel < m_channel_lookup.size() && m_channel_lookup[ch.channel] != nullptr) {
+        m_channel_lookup[ch.channel]->pedestal = state.pedestal;
+        m_channel_lookup[ch.channel]->drift = state.pedestal - state.first;
+      }
+    }
+    ++m_events;
+    if (!event.serialize()) {
+      ERS_WARNING("Serialization of event #" << event.event_number << " failed. Skipping.");
+      continue;
+    }
+
+    SharedDataType<EventType> shared(std::move(pl));
+    shared.make_shared();
+    // sleep_send() moves from the message: one per attempt, sharing the event.
+    while (m_run) {
+      SharedDataType<EventType> message(shared);
+      if (m_connections.sleep_send(0, message))
+        break;
+      ERS_WARNING("put() failed. Trying again");
+    }
+  }
+  ERS_DEBUG(0, "Runner stopped");
+}
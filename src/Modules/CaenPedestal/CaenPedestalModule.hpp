@@ -0,0 +1,67 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Common/CaenOutputFormat.hpp"
+#include "Core/DAQProcess.hpp"
+#include "PedestalSubtraction.hpp"
+
+namespace daqling {
+#include <ers/Issue.h>
+
+ERS_DECLARE_ISSUE(module, InvalidParameter, "Invalid parameter \""<< par <<"\" was provided for "<<target<<".",
+                  ((std::string)par)((std::string)target))
+}
+
+/**
+ * Online pedestal subtraction of CAEN events: receives caen_output_data events on channel 0,
+ * subtracts the running pedestal of each channel from its samples (see CaenPedestalTracker)
+ * and sends the events on on channel 0. Pedestals are tracked from the start of each run.
+ * Subtraction is unsigned, with "offset" added back to keep undershoots.
+ */
+class CaenPedestalModule : public daqling::core::DAQProcess {
+public:
+  using EventType = caen_output_data<uint16_t>;
+
+  CaenPedestalModule(const std::string & /*n*/);
+
+  void configure() override;
+  void start(unsigned run_num) override;
+  void stop() override;
+  void runner() noexcept override;
+
+private:
+  struct ChannelMetrics {
+    std::atomic<double> pedestal = 0;
+    std::atomic<double> drift = 0; // From the pedestal of the first event of the run.
+  };
+
+  CaenPedestalTracker::Config m_pedestal;
+
+  std::atomic<size_t> m_events = 0;
+  // Per CAEN channel listed in "channels"; m_channel_lookup is indexed by channel number.
+  std::map<uint16_t, ChannelMetrics> m_channel_metrics;
+  std::vector<ChannelMetrics *> m_channel_lookup;
+};
@@ -0,0 +1,156 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * Running pedestal (baseline) of CAEN channels, subtracted from the samples in place.
+ * The pedestal of a channel is updated from every event by the samples of the pre-trigger
+ * window:
+ * - Ema: exponential moving average of their mean, with weight `alpha` for the new event;
+ * - Median: their median, event by event, which ignores pulses reaching into the window.
+ * Subtraction is 8 samples at a time with SSE2 saturating arithmetic, either
+ * - unsigned: y - pedestal + offset, saturated to [0, 65535], or
+ * - signed: y - pedestal as two's complement int16, saturated to [-32768, 32767], stored in
+ *   the uint16 samples (the serialized bytes are those of caen_output_data<int16_t>). Only for
+ *   receivers reading the events as such: CaenPedestalModule does not offer it.
+ * Not thread safe.
+ */
+class CaenPedestalTracker {
+public:
+  enum class Mode { Ema, Median };
+
+  struct Config {
+    Mode mode = Mode::Ema;
+    double alpha = 0.05;
+    uint32_t window_start = 0;
+    uint32_t window_samples = 16;
+    bool to_signed = false;
+    uint16_t offset = 0; // Added back by unsigned subtraction, to keep undershoots.
+  };
+
+  struct Channel {
+    bool initialized = false;
+    double pedestal = 0;
+    double first = 0; // Pedestal after the first event, to measure the drift from.
+  };
+
+  explicit CaenPedestalTracker(const Config &config) : m_config(config) {}
+
+  /// Updates the pedestal of `channel` from `ys` and subtracts it. Channels with no samples in
+  /// the window keep their pedestal; a channel never seen is left as is.
+  const Channel &process(uint16_t channel, uint16_t *ys, size_t n) {
+    if (m_channels.size() <= channel) {
+      m_channels.resize(size_t{channel} + 1);
+    }
+    Channel &state = m_channels[channel];
+    double estimate = 0;
+    if (window(ys, n, estimate)) {
+      if (!state.initialized || m_config.mode == Mode::Median) {
+        state.pedestal = estimate;
+      } else {
+        state.pedestal += m_config.alpha * (estimate - state.pedestal);
+      }
+      if (!state.initialized) {
+        state.first = state.pedestal;
+        state.initialized = true;
+      }
+    }
+    if (state.initialized) {
+      const auto pedestal = static_cast<uint16_t>(std::clamp(std::lround(state.pedestal), 0L, 65535L));
+      if (m_config.to_signed) {
+        subtract_signed(ys, n, pedestal);
+      } else {
+        subtract_unsigned(ys, n, pedestal, m_config.offset);
+      }
+    }
+    return state;
+  }
+
+  /// Forgets all pedestals, e.g. at the start of a run.
+  void reset() { m_channels.clear(); }
+
+  static void subtract_unsigned(uint16_t *ys, size_t n, uint16_t pedestal, uint16_t offset) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i vped = _mm_set1_epi16(static_cast<short>(pedestal));
+    const __m128i voff = _mm_set1_epi16(static_cast<short>(offset));
+    for (; i + 8 <= n; i += 8) {
+      auto *p = reinterpret_cast<__m128i *>(ys + i);
+      _mm_storeu_si128(p, _mm_subs_epu16(_mm_adds_epu16(_mm_loadu_si128(p), voff), vped));
+    }
+#endif
+    for (; i != n; ++i) {
+      const int value = std::min(int{ys[i]} + offset, 65535) - pedestal;
+      ys[i] = static_cast<uint16_t>(std::max(value, 0));
+    }
+  }
+
+  static void subtract_signed(uint16_t *ys, size_t n, uint16_t pedestal) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    // Both biased by 0x8000 into int16: the saturating difference is that of the unbiased values.
+    const __m128i bias = _mm_set1_epi16(static_cast<short>(0x8000));
+    const __m128i vped = _mm_set1_epi16(static_cast<short>(pedestal ^ 0x8000));
+    for (; i + 8 <= n; i += 8) {
+      auto *p = reinterpret_cast<__m128i *>(ys + i);
+      _mm_storeu_si128(p, _mm_subs_epi16(_mm_xor_si128(_mm_loadu_si128(p), bias), vped));
+    }
+#endif
+    for (; i != n; ++i) {
+      const int value = std::clamp(int{ys[i]} - pedestal, -32768, 32767);
+      ys[i] = static_cast<uint16_t>(static_cast<int16_t>(value));
+    }
+  }
+
+  const std::vector<Channel> &channels() const { return m_channels; }
+
+private:
+  bool window(const uint16_t *ys, size_t n, double &estimate) {
+    const size_t begin = std::min<size_t>(m_config.window_start, n);
+    const size_t end = std::min<size_t>(size_t{m_config.window_start} + m_config.window_samples, n);
+    if (begin == end) {
+      return false;
+    }
+    if (m_config.mode == Mode::Median) {
+      m_scratch.assign(ys + begin, ys + end);
+      const auto middle = m_scratch.begin() + static_cast<std::ptrdiff_t>(m_scratch.size() / 2);
+      std::nth_element(m_scratch.begin(), middle, m_scratch.end());
+      estimate = *middle;
+      return true;
+    }
+    uint64_t sum = 0;
+    for (size_t i = begin; i != end; ++i) {
+      sum += ys[i];
+    }
+    estimate = static_cast<double>(sum) / static_cast<double>(end - begin);
+    return true;
+  }
+
+  const Config m_config;
+  std::vector<Channel> m_channels; // By channel number.
+  std::vector<uint16_t> m_scratch;
+};
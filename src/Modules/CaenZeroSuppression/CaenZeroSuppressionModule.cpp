@@ -0,0 +1,149 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CaenZeroSuppressionModule.hpp"
+#include "Common/DataType.hpp"
+#include "Utils/Ers.hpp"
+#include <algorithm>
+#include <utility>
+
+using namespace daqling::module;
+
+CaenZeroSuppressionModule::CaenZeroSuppressionModule(const std::string &n) : DAQProcess(n) {
+  ERS_DEBUG(0, "With config: " << getModuleSettings());
+  const auto &settings = getModuleSettings();
+  m_zs.baseline_start = settings.value("baseline_start", m_zs.baseline_start);
+  m_zs.baseline_samples = settings.value("baseline_samples", m_zs.baseline_samples);
+  m_zs.threshold = settings.value("threshold", m_zs.threshold);
+  m_zs.pre = settings.value("pre_samples", m_zs.pre);
+  m_zs.post = settings.value("post_samples", m_zs.post);
+  const std::string polarity = settings.value("polarity", std::string("positive"));
+  if (polarity == "positive") {
+    m_zs.polarity = CaenZeroSuppressor::Polarity::Positive;
+  } else if (polarity == "negative") {
+    m_zs.polarity = CaenZeroSuppressor::Polarity::Negative;
+  } else if (polarity == "both") {
+    m_zs.polarity = CaenZeroSuppressor::Polarity::Both;
+  } else {
+    throw InvalidParameter(ERS_HERE, polarity, std::string("polarity"));
+  }
+  if (m_zs.baseline_samples == 0)
+    throw InvalidParameter(ERS_HERE, "0", std::string("baseline_samples"));
+  m_drop_empty_events = settings.value("drop_empty_events", m_drop_empty_events);
+  for (uint16_t channel : settings.value("channels", std::vector<uint16_t>{}))
+    m_channel_metrics.try_emplace(channel);
+  for (auto &[channel, metrics] : m_channel_metrics) {
+    if (m_channel_lookup.size() <= channel)
+      m_channel_lookup.resize(size_t{channel} + 1, nullptr);
+    m_channel_lookup[channel] = &metrics;
+  }
+}
+
+void CaenZeroSuppressionModule::configure() {
+  DAQProcess::configure();
+  if (m_statistics) {
+    using daqling::core::metrics::LAST_VALUE;
+    using daqling::core::metrics::RATE;
+    m_statistics->registerMetric<std::atomic<size_t>>(&m_events, "EventRate", RATE);
+    m_statistics->registerMetric<std::atomic<size_t>>(&m_events_dropped, "EventsDropped", LAST_VALUE);
+    m_statistics->registerMetric<std::atomic<size_t>>(&m_samples_in, "SampleRateIn", RATE);
+    m_statistics->registerMetric<std::atomic<size_t>>(&m_samples_out, "SampleRateOut", RATE);
+    m_statistics->registerMetric<std::atomic<size_t>>(&m_bytes_in, "ByteRateIn", RATE);
+    m_statistics->registerMetric<std::atomic<size_t>>(&m_bytes_out, "ByteRateOut", RATE);
+    m_statistics->registerMetric<std::atomic<double>>(&m_reduction, "ReductionFactor", LAST_VALUE);
+    for (auto &[channel, metrics] : m_channel_metrics) {
+      const std::string suffix = "_ch" + std::to_string(channel);
+      m_statistics->registerMetric<std::atomic<size_t>>(&metrics.hits, "HitRate" + suffix, RATE);
+      m_statistics->registerMetric<std::atomic<size_t>>(&metrics.samples_out, "SampleRateOut" + suffix, RATE);
+    }
+  }
+}
+
+void CaenZeroSuppressionModule::start(unsigned run_num) {
+  m_run_bytes_in = 0;
+  m_run_bytes_out = 0;
+  m_reduction = 0;
+  DAQProcess::start(run_num);
+}
+
+void CaenZeroSuppressionModule::stop() { DAQProcess::stop(); }
+
+void CaenZeroSuppressionModule::suppress(EventType &event, CaenZeroSuppressor &suppressor) {
+  size_t samples_in = 0, samples_out = 0;
+  size_t kept = 0;
+  for (size_t i = 0; i != event.ch_data.size(); ++i) {
+    auto &ch = event.ch_data[i];
+    samples_in += ch.ys.size();
+    const size_t count = suppressor.suppress(ch.xs, ch.ys);
+    if (count == 0)
+      continue;
+    samples_out += count;
+    if (ch.channel < m_channel_lookup.size() && m_channel_lookup[ch.channel] != nullptr) {
+      ++m_channel_lookup[ch.channel]->hits;
+      m_channel_lookup[ch.channel]->samples_out += count;
+    }
+    if (kept != i)
+      event.ch_data[kept] = std::move(ch);
+    ++kept;
+  }
+  event.ch_data.resize(kept);
+  m_samples_in += samples_in;
+  m_samples_out += samples_out;
+}
+
+void CaenZeroSuppressionModule::runner() noexcept {
+  CaenZeroSuppressor suppressor(m_zs);
+  ERS_DEBUG(0, "Running...");
+  while (m_run) {
+    DataFragment<EventType> pl;
+    while (!m_connections.sleep_receive(0, pl) && m_run) {
+    }
+    if (!m_run || pl.get() == nullptr)
+      continue;
+    const size_t bytes_in = pl.size();
+    EventType &event = *pl.get();
+    suppress(event, suppressor);
+    ++m_events;
+    // Dropped events count in, with nothing out: they are the most reduced.
+    m_bytes_in += bytes_in;
+    m_run_bytes_in += bytes_in;
+    if (event.ch_data.empty() && m_drop_empty_events) {
+      ++m_events_dropped;
+      continue;
+    }
+    if (!event.serialize()) {
+      ERS_WARNING("Serialization of event #" << event.event_number << " failed. Skipping.");
+      continue;
+    }
+    m_bytes_out += event.size();
+    m_run_bytes_out += event.size();
+    m_reduction = m_run_bytes_out != 0
+                      ? static_cast<double>(m_run_bytes_in) / static_cast<double>(m_run_bytes_out)
+                      : 0.0;
+
+    SharedDataType<EventType> shared(std::move(pl));
+    shared.make_shared();
+    // sleep_send() moves from the message: one per attempt, sharing the event.
+    while (m_run) {
+      SharedDataType<EventType> message(shared);
+      if (m_connections.sleep_send(0, message))
+        break;
+      ERS_WARNING("put() failed. Trying again");
+    }
+  }
+  ERS_DEBUG(0, "Runner stopped");
+}
@@ -0,0 +1,79 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Common/CaenOutputFormat.hpp"
+#include "Core/DAQProcess.hpp"
+#include "ZeroSuppression.hpp"
+
+namespace daqling {
+#include <ers/Issue.h>
+
+ERS_DECLARE_ISSUE(module, InvalidParameter, "Invalid parameter \""<< par <<"\" was provided for "<<target<<".",
+                  ((std::string)par)((std::string)target))
+}
+
+/**
+ * Zero suppression of CAEN events: receives caen_output_data events on channel 0, keeps only
+ * the samples of each channel around the hits (see CaenZeroSuppressor) and sends the events on
+ * on channel 0. Channels without hits are dropped, and so are events left without channels
+ * if "drop_empty_events" is set.
+ */
+class CaenZeroSuppressionModule : public daqling::core::DAQProcess {
+public:
+  using EventType = caen_output_data<uint16_t>;
+
+  CaenZeroSuppressionModule(const std::string & /*n*/);
+
+  void configure() override;
+  void start(unsigned run_num) override;
+  void stop() override;
+  void runner() noexcept override;
+
+private:
+  /// Suppresses the channels of `event` in place.
+  void suppress(EventType &event, CaenZeroSuppressor &suppressor);
+
+  struct ChannelMetrics {
+    std::atomic<size_t> hits = 0;        // Events in which the channel was kept.
+    std::atomic<size_t> samples_out = 0; // Samples kept.
+  };
+
+  CaenZeroSuppressor::Config m_zs;
+  bool m_drop_empty_events = false;
+
+  std::atomic<size_t> m_events = 0;
+  std::atomic<size_t> m_events_dropped = 0;
+  std::atomic<size_t> m_samples_in = 0;
+  std::atomic<size_t> m_samples_out = 0;
+  std::atomic<size_t> m_bytes_in = 0;  // Never reset: RATE metrics difference them.
+  std::atomic<size_t> m_bytes_out = 0;
+  std::atomic<double> m_reduction = 0; // Bytes in over bytes out, since the start of the run.
+  size_t m_run_bytes_in = 0;           // Of the run, for m_reduction.
+  size_t m_run_bytes_out = 0;
+  // Per CAEN channel listed in "channels"; m_channel_lookup is indexed by channel number.
+  std::map<uint16_t, ChannelMetrics> m_channel_metrics;
+  std::vector<ChannelMetrics *> m_channel_lookup;
+};
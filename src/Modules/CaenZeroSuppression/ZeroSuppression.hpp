@@ -0,0 +1,107 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "Common/CaenHitFinder.hpp"
+
+/**
+ * Zero suppression of CAEN waveforms: keeps the regions of samples further than a threshold
+ * from the baseline, plus `pre` samples before and `post` samples after each, and drops the
+ * rest. The x of the kept samples are kept along, so the regions keep their positions.
+ * Hits are found by caen_find_hits(). Not thread safe: ranges are buffered between calls.
+ */
+class CaenZeroSuppressor {
+public:
+  enum class Polarity { Positive, Negative, Both };
+
+  struct Config {
+    uint32_t baseline_start = 0;
+    uint32_t baseline_samples = 16;
+    uint16_t threshold = 50; // ADC counts from the baseline.
+    Polarity polarity = Polarity::Positive;
+    uint32_t pre = 8;
+    uint32_t post = 8;
+  };
+
+  explicit CaenZeroSuppressor(const Config &config) : m_config(config) {}
+
+  /// Mean of the baseline window, or of the samples there are if it extends past them.
+  double baseline(const uint16_t *ys, size_t n) const {
+    const size_t begin = std::min<size_t>(m_config.baseline_start, n);
+    const size_t end = std::min<size_t>(size_t{m_config.baseline_start} + m_config.baseline_samples, n);
+    if (begin == end) {
+      return 0;
+    }
+    uint64_t sum = 0;
+    for (size_t i = begin; i != end; ++i) {
+      sum += ys[i];
+    }
+    return static_cast<double>(sum) / static_cast<double>(end - begin);
+  }
+
+  /// Samples are hits if outside [low, high].
+  void bounds(double baseline, uint16_t &low, uint16_t &high) const {
+    const double threshold = m_config.threshold;
+    const bool positive = m_config.polarity != Polarity::Negative;
+    const bool negative = m_config.polarity != Polarity::Positive;
+    high = positive ? static_cast<uint16_t>(std::clamp(std::floor(baseline + threshold), 0.0, 65535.0)) : UINT16_MAX;
+    low = negative ? static_cast<uint16_t>(std::clamp(std::ceil(baseline - threshold), 0.0, 65535.0)) : 0;
+  }
+
+  /// Suppresses the samples of one channel in place. Missing xs are numbered first. Returns the
+  /// number of samples kept: 0 if there are no hits.
+  size_t suppress(std::vector<uint16_t> &xs, std::vector<uint16_t> &ys) {
+    const size_t n = ys.size();
+    uint16_t low = 0, high = 0;
+    bounds(baseline(ys.data(), n), low, high);
+    caen_find_hits(ys.data(), n, low, high, m_runs);
+    caen_pad_hits(m_runs, n, m_config.pre, m_config.post, m_kept);
+    if (xs.size() != n) {
+      xs.resize(n);
+      for (size_t i = 0; i != n; ++i) {
+        xs[i] = static_cast<uint16_t>(i);
+      }
+    }
+    // Ranges are in order: samples only move towards the front.
+    size_t out = 0;
+    for (const auto &range : m_kept) {
+      const size_t count = range.end - range.begin;
+      if (out != range.begin) {
+        std::memmove(ys.data() + out, ys.data() + range.begin, count * sizeof(uint16_t));
+        std::memmove(xs.data() + out, xs.data() + range.begin, count * sizeof(uint16_t));
+      }
+      out += count;
+    }
+    ys.resize(out);
+    xs.resize(out);
+    return out;
+  }
+
+  const Config &config() const { return m_config; }
+
+private:
+  const Config m_config;
+  std::vector<caen_sample_range> m_runs;
+  std::vector<caen_sample_range> m_kept;
+};
@@ -0,0 +1,296 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FileReaderModule.hpp"
+#include "Common/CaenFileReader.hpp"
+#include "Common/DataType.hpp"
+#include "Common/InterleavedFile.hpp"
+#include "Utils/Common.hpp"
+#include "Utils/Ers.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <utility>
+
+using namespace std::chrono_literals;
+using namespace daqling::module;
+namespace daqutils = daqling::utilities;
+
+FileReaderModule::FileReaderModule(const std::string &n) : DAQProcess(n) {
+  ERS_DEBUG(0, "With config: " << getModuleSettings());
+  const auto &settings = getModuleSettings();
+
+  const std::string format = settings.value("format", std::string("interleaved"));
+  if (format == "interleaved") {
+    m_format = Format::Interleaved;
+  } else if (format == "raw") {
+    m_format = Format::Raw;
+  } else if (format == "caen") {
+    m_format = Format::Caen;
+  } else {
+    throw InvalidParameter(ERS_HERE, format, std::string("format"));
+  }
+  m_files = settings.value("files", m_files);
+  if (m_files.empty())
+    throw InvalidParameter(ERS_HERE, settings.value("files", nlohmann::json()).dump(), std::string("files"));
+  m_loops = settings.value("loops", m_loops);
+  m_read_ahead = std::max<size_t>(settings.value("read_ahead", m_read_ahead), 1);
+  m_chunk_bytes = settings.value("chunk_bytes", m_chunk_bytes);
+  if (m_chunk_bytes == 0)
+    throw InvalidParameter(ERS_HERE, "0", std::string("chunk_bytes"));
+  m_route_by_chid = settings.value("route_by_chid", m_route_by_chid);
+
+  const std::string pacing = settings.value("pacing", std::string("fast"));
+  if (pacing == "fast") {
+    m_pacing = Pacing::Fast;
+  } else if (pacing == "rate") {
+    m_pacing = Pacing::Rate;
+  } else if (pacing == "timestamps" && m_format == Format::Caen) {
+    m_pacing = Pacing::Timestamps;
+  } else {
+    throw InvalidParameter(ERS_HERE, pacing, std::string("pacing"));
+  }
+  m_rate_hz = settings.value("rate_hz", m_rate_hz);
+  m_rate_burst = settings.value("rate_burst", m_rate_burst);
+  m_time_scale = settings.value("time_scale", m_time_scale);
+  if (m_time_scale <= 0)
+    throw InvalidParameter(ERS_HERE, std::to_string(m_time_scale), std::string("time_scale"));
+
+  if (m_format == Format::Caen) {
+    const std::string caen_format = settings.value("file_format", std::string("Binary"));
+    if (auto f = caen_file_format_from_string(caen_format))
+      m_caen_format = *f;
+    else
+      throw InvalidParameter(ERS_HERE, caen_format, std::string("file_format"));
+    const std::string splitting = settings.value("file_splitting", std::string("FilePerDevice"));
+    if (auto s = caen_file_splitting_from_string(splitting))
+      m_caen_splitting = *s;
+    else
+      throw InvalidParameter(ERS_HERE, splitting, std::string("file_splitting"));
+    m_caen_channels = settings.value("channels", m_caen_channels);
+    m_device = settings.value("device", m_name);
+    m_fill_xs = settings.value("fill_xs", m_fill_xs);
+  }
+}
+
+void FileReaderModule::configure() {
+  DAQProcess::configure();
+  m_num_senders = m_config.getNumSenderConnections(m_name);
+  if (m_statistics) {
+    m_statistics->registerMetric<std::atomic<size_t>>(&m_messages_sent, "MessageRate",
+                                                      daqling::core::metrics::RATE);
+    m_statistics->registerMetric<std::atomic<size_t>>(&m_bytes_sent, "ByteRate",
+                                                      daqling::core::metrics::RATE);
+    m_statistics->registerMetric<std::atomic<size_t>>(&m_read_ahead_size, "ReadAheadSize",
+                                                      daqling::core::metrics::LAST_VALUE);
+    m_statistics->registerMetric<std::atomic<size_t>>(&m_read_errors, "ReadErrors",
+                                                      daqling::core::metrics::LAST_VALUE);
+  }
+}
+
+void FileReaderModule::start(unsigned run_num) { DAQProcess::start(run_num); }
+
+void FileReaderModule::stop() { DAQProcess::stop(); }
+
+bool FileReaderModule::push(MessageQueue &queue, Message &&message) {
+  while (!queue.write(std::move(message))) {
+    if (!m_run)
+      return false;
+    std::this_thread::sleep_for(50us);
+  }
+  return true;
+}
+
+bool FileReaderModule::read_interleaved(const std::string &filename, MessageQueue &queue) {
+  interleaved_file_reader file(filename);
+  while (auto record = file.next()) {
+    Message message;
+    message.channel = 0;
+    if (m_route_by_chid) {
+      if (record->chid >= m_num_senders) {
+        ERS_WARNING("No sender channel " << record->chid << " for a record of " << filename
+                                         << ". Skipping.");
+        continue;
+      }
+      message.channel = static_cast<unsigned>(record->chid);
+    }
+    message.size = record->size;
+    message.data = std::make_shared<daqutils::Binary>(record->data, record->size);
+    if (!push(queue, std::move(message)))
+      return false;
+  }
+  if (!file.error().empty()) {
+    ++m_read_errors;
+    ers::error(ReadFail(ERS_HERE, file.error()));
+  }
+  return true;
+}
+
+bool FileReaderModule::read_raw(const std::string &filename, MessageQueue &queue) {
+  caen_mapped_file file(filename);
+  for (size_t offset = 0; offset < file.size(); offset += m_chunk_bytes) {
+    Message message;
+    message.size = std::min(m_chunk_bytes, file.size() - offset);
+    message.data = std::make_shared<daqutils::Binary>(file.data() + offset, message.size);
+    if (!push(queue, std::move(message)))
+      return false;
+  }
+  return true;
+}
+
+bool FileReaderModule::read_caen(MessageQueue &queue) {
+  caen_file_reader<uint16_t> file(m_files, m_caen_format, m_caen_splitting, m_caen_channels);
+  caen_event_view<uint16_t> view;
+  while (file.next(view)) {
+    auto event = std::make_shared<EventType>();
+    event->event_number = static_cast<uint32_t>(view.event_number);
+    event->timestamp = view.timestamp;
+    event->device = view.device.empty() ? m_device : std::string(view.device);
+    event->ch_data.resize(view.channels.size());
+    for (size_t i = 0; i != view.channels.size(); ++i) {
+      const auto &in = view.channels[i];
+      auto &out = event->ch_data[i];
+      out.channel = in.channel;
+      // Samples are not necessarily aligned in the mapping: copied bytewise.
+      out.ys.resize(in.ys.size);
+      std::memcpy(out.ys.data(), in.ys.data, in.ys.size * sizeof(uint16_t));
+      if (in.xs.size != 0) {
+        out.xs.resize(in.xs.size);
+        std::memcpy(out.xs.data(), in.xs.data, in.xs.size * sizeof(uint16_t));
+      } else if (m_fill_xs) {
+        out.xs.resize(in.ys.size);
+        for (size_t x = 0; x != out.xs.size(); ++x)
+          out.xs[x] = static_cast<uint16_t>(x);
+      }
+    }
+    event->serialize();
+    Message message;
+    message.timestamp = event->timestamp;
+    message.size = event->size();
+    message.data = std::move(event);
+    if (!push(queue, std::move(message)))
+      return false;
+  }
+  if (!file.error().empty()) {
+    ++m_read_errors;
+    ers::error(ReadFail(ERS_HERE, file.error()));
+  }
+  return true;
+}
+
+void FileReaderModule::reader(MessageQueue &queue) noexcept {
+  for (unsigned loop = 0; m_run && (m_loops == 0 || loop != m_loops); ++loop) {
+    bool any = false;
+    try {
+      if (m_format == Format::Caen) {
+        any = read_caen(queue);
+      } else {
+        for (const auto &filename : m_files) {
+          try {
+            const bool ok = m_format == Format::Interleaved ? read_interleaved(filename, queue)
+                                                            : read_raw(filename, queue);
+            if (!ok)
+              break;
+            any = true;
+          } catch (const std::runtime_error &e) {
+            ++m_read_errors;
+            ers::error(ReadFail(ERS_HERE, e.what()));
+          }
+        }
+      }
+    } catch (const std::exception &e) {
+      ++m_read_errors;
+      ers::error(ReadFail(ERS_HERE, e.what()));
+    }
+    // Nothing readable: looping would spin on the errors.
+    if (!any)
+      break;
+  }
+  m_reader_done = true;
+}
+
+bool FileReaderModule::send(const Message &message) {
+  while (m_run) {
+    // sleep_send() moves from the message: one per attempt, sharing the data.
+    const bool sent = std::visit(
+        [&](const auto &ptr) {
+          SharedDataType<typename std::decay_t<decltype(ptr)>::element_type> msg(ptr);
+          msg.make_shared();
+          return m_connections.sleep_send(message.channel, msg);
+        },
+        message.data);
+    if (sent)
+      return true;
+    ERS_WARNING("put() failed. Trying again");
+  }
+  return false;
+}
+
+void FileReaderModule::runner() noexcept {
+  // The queue holds one item less than its size.
+  MessageQueue queue(static_cast<uint32_t>(std::min<size_t>(m_read_ahead, UINT32_MAX - 1) + 1));
+  m_reader_done = false;
+  std::thread read_ahead(&FileReaderModule::reader, this, std::ref(queue));
+
+  daqutils::RateLimiter limiter(m_pacing == Pacing::Rate ? m_rate_hz : 0, m_rate_burst);
+  // Timestamps pacing: the time of the recorded timestamp `first` is `start`. Timestamps going
+  // back (next loop, another file) restart from there.
+  std::optional<uint64_t> first;
+  uint64_t previous = 0;
+  auto start = std::chrono::steady_clock::now();
+
+  ERS_DEBUG(0, "Running...");
+  while (m_run) {
+    Message *message = queue.frontPtr();
+    if (message == nullptr) {
+      if (m_reader_done && queue.isEmpty())
+        break;
+      std::this_thread::sleep_for(20us);
+      continue;
+    }
+    m_read_ahead_size = queue.sizeGuess();
+    if (m_pacing == Pacing::Timestamps) {
+      if (!first || message->timestamp < previous) {
+        first = message->timestamp;
+        start = std::chrono::steady_clock::now();
+      }
+      previous = message->timestamp;
+      const auto offset = std::chrono::duration<double, std::micro>(
+          static_cast<double>(message->timestamp - *first) / m_time_scale);
+      // In slices: gaps in the recorded timestamps (between files or runs) may last hours.
+      const auto due = start + std::chrono::duration_cast<std::chrono::nanoseconds>(offset);
+      while (m_run && std::chrono::steady_clock::now() < due)
+        std::this_thread::sleep_until(std::min(due, std::chrono::steady_clock::now() + 10ms));
+      if (!m_run)
+        break;
+    } else {
+      if (!limiter.acquire(1, m_run))
+        break;
+    }
+    if (send(*message)) {
+      ++m_messages_sent;
+      m_bytes_sent += message->size;
+    }
+    queue.popFront();
+  }
+  if (m_run)
+    ERS_INFO("Replay finished after " << m_messages_sent << " messages");
+  read_ahead.join();
+  m_read_ahead_size = 0;
+  ERS_DEBUG(0, "Runner stopped");
+}
@@ -0,0 +1,112 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "Common/CaenFileLayout.hpp"
+#include "Common/CaenOutputFormat.hpp"
+#include "Core/DAQProcess.hpp"
+#include "Utils/Binary.hpp"
+#include "folly/ProducerConsumerQueue.h"
+
+namespace daqling {
+#include <ers/Issue.h>
+
+ERS_DECLARE_ISSUE(module, ReadFail, "Reading input file failed: " << reason, ((std::string)reason))
+
+ERS_DECLARE_ISSUE(module, InvalidParameter, "Invalid parameter \""<< par <<"\" was provided for "<<target<<".",
+                  ((std::string)par)((std::string)target))
+}
+
+/**
+ * Module replaying recorded data: reads the output files of FileWriterModule or
+ * CaenFileWriterModule, memory mapped, and sends their messages again over its sender channels.
+ * - "interleaved" files of FileWriterModule are sent record by record, as-is, on channel 0 or,
+ *   with "route_by_chid", on the channel of the record;
+ * - "raw" files (other FileWriterModule outputs) do not delimit their payloads: they are sent
+ *   in chunks of "chunk_bytes";
+ * - "caen" files, a set as written for one device, are sent as caen_output_data events.
+ * Messages are prepared by a read-ahead thread, up to "read_ahead" of them, and sent by the
+ * runner as fast as possible, at "rate_hz", or at the pace of the recorded timestamps (CAEN
+ * events only) sped up by "time_scale". The files are replayed "loops" times (0: until stopped).
+ */
+class FileReaderModule : public daqling::core::DAQProcess {
+public:
+  using EventType = caen_output_data<uint16_t>;
+
+  FileReaderModule(const std::string & /*n*/);
+
+  void configure() override;
+  void start(unsigned run_num) override;
+  void stop() override;
+  void runner() noexcept override;
+
+private:
+  enum class Format { Interleaved, Raw, Caen };
+  enum class Pacing { Fast, Rate, Timestamps };
+
+  struct Message {
+    unsigned channel = 0;
+    uint64_t timestamp = 0; // us, of CAEN events.
+    size_t size = 0;
+    std::variant<std::shared_ptr<daqling::utilities::Binary>, std::shared_ptr<EventType>> data;
+  };
+  using MessageQueue = folly::ProducerConsumerQueue<Message>;
+
+  /// Reads the files in turn into the queue, until done or stopped.
+  void reader(MessageQueue &queue) noexcept;
+  /// Each returns false if the run stopped while the queue was full.
+  bool read_interleaved(const std::string &filename, MessageQueue &queue);
+  bool read_raw(const std::string &filename, MessageQueue &queue);
+  bool read_caen(MessageQueue &queue);
+  bool push(MessageQueue &queue, Message &&message);
+
+  /// Sends `message` on its channel, retrying until it is accepted or the run stops.
+  bool send(const Message &message);
+
+  Format m_format = Format::Interleaved;
+  Pacing m_pacing = Pacing::Fast;
+  std::vector<std::string> m_files;
+  unsigned m_loops = 1;
+  size_t m_read_ahead = 1024;
+  size_t m_chunk_bytes = 1 << 20;
+  bool m_route_by_chid = false;
+  unsigned m_num_senders = 0;
+  double m_rate_hz = 0;
+  double m_rate_burst = 1;
+  double m_time_scale = 1;
+  // Of "caen" files.
+  caen_file_format m_caen_format = caen_file_format::Binary;
+  caen_file_splitting m_caen_splitting = caen_file_splitting::FilePerDevice;
+  std::vector<uint16_t> m_caen_channels;
+  std::string m_device;
+  bool m_fill_xs = true; // Numbers the samples of "Short" formats, which do not store x.
+
+  std::atomic<bool> m_reader_done{false};
+  std::atomic<size_t> m_messages_sent{0};
+  std::atomic<size_t> m_bytes_sent{0};
+  std::atomic<size_t> m_read_ahead_size{0};
+  std::atomic<size_t> m_read_errors{0};
+};
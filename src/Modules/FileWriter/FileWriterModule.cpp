@@ -17,18 +17,21 @@
 
 #include "FileWriterModule.hpp"
 
+#include "Common/InterleavedFile.hpp"
 #include "Utils/Common.hpp"
 #include "Utils/Ers.hpp"
+#include <cstdio>
+#include <filesystem>
 #include <utility>
 
 using namespace std::chrono_literals;
 namespace daqutils = daqling::utilities;
 using namespace daqling::module;
-std::ofstream FileWriterModule::FileGenerator::next() {
+std::string FileWriterModule::FileGenerator::next() {
 
   const auto handle_arg = [this](char c) -> std::string {
     switch (c) {
-    case 'D': // Full date in YYYY-MM-DD-HH:MM:SS (ISO 8601) format
+    case 'D': // Full date in YYYY-MM-DD-HH:MM:SS (ISO 8601) format, of when the name is generated
     {
       std::time_t t = std::time(nullptr);
       char tstr[32];
@@ -37,12 +40,33 @@ std::ofstream FileWriterModule::FileGenerator::next() {
       }
       return std::string(tstr);
     }
+    case 't': // Full date with microseconds, YYYY-MM-DD-HH:MM:SS.uuuuuu, increasing on every call.
+              // Like %D, the time the name is generated: see OutputFiles.
+    {
+      auto now = std::chrono::time_point_cast<std::chrono::microseconds>(
+          std::chrono::system_clock::now());
+      if (now <= m_last_time) {
+        now = std::chrono::time_point_cast<std::chrono::microseconds>(m_last_time) + 1us;
+      }
+      m_last_time = now;
+      std::time_t t = std::chrono::system_clock::to_time_t(now);
+      char tstr[32];
+      if (std::strftime(tstr, sizeof(tstr), "%F-%T", std::localtime(&t)) == 0u) {
+        throw std::runtime_error("Failed to format timestamp");
+      }
+      char usec[8];
+      std::snprintf(usec, sizeof(usec), ".%06u",
+                    static_cast<unsigned>(now.time_since_epoch() % 1s / 1us));
+      return std::string(tstr) + usec;
+    }
     case 'n': // The nth generated output (equals the number of times called `next()`, minus 1)
       return std::to_string(m_filenum++);
-    case 'c': // The channel id
-      return std::to_string(m_chid);
+    case 'c': // The channel id ("all" in interleaved mode)
+      return m_chid == all_channels ? std::string("all") : std::to_string(m_chid);
     case 'r': // The run number
       return std::to_string(m_run_number);
+    case 'R': // The output root of the file ("." if no output roots are configured)
+      return m_roots ? (*m_roots)[m_root].path : std::string(".");
     default:
       std::stringstream ss;
       ss << "Unknown output file argument '" << c << "'";
@@ -50,6 +74,10 @@ std::ofstream FileWriterModule::FileGenerator::next() {
     }
   };
 
+  if (m_roots) {
+    m_root = m_roots->select(m_chid);
+  }
+
   // Append every character until we hit a '%' (control character),
   // where the next character denotes an argument.
   std::stringstream ss;
@@ -61,13 +89,22 @@ std::ofstream FileWriterModule::FileGenerator::next() {
     }
   }
 
-  ERS_DEBUG(0, "Next generated filename is: " << ss.str());
+  std::filesystem::path path = ss.str();
+  if (m_roots && path.is_relative() && m_pattern.find("%R") == std::string::npos) {
+    path = std::filesystem::path((*m_roots)[m_root].path) / path;
+  }
+  if (m_roots && path.has_parent_path()) {
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+  }
 
-  return std::ofstream(ss.str(), std::ios::binary);
+  ERS_DEBUG(0, "Next generated filename is: " << path.string());
+  return path.string();
 }
 
-bool FileWriterModule::FileGenerator::yields_unique(const std::string &pattern) {
-  std::map<char, bool> fields{{'n', false}, {'c', false}, {'D', false}, {'r', false}};
+bool FileWriterModule::FileGenerator::yields_unique(const std::string &pattern,
+                                                   const bool per_channel) {
+  std::map<char, bool> fields{{'n', false}, {'D', false}, {'r', false}, {'t', false}, {'c', false}};
 
   for (auto c = pattern.cbegin(); c != pattern.cend(); c++) {
     if (*c == '%' && c + 1 != pattern.cend()) {
@@ -80,11 +117,71 @@ bool FileWriterModule::FileGenerator::yields_unique(const std::string &pattern)
   }
 
   /*
-   * While %D can conceptually yield unique files it has a resolution of 1s;
-   * if FileGenerator::next() is called too often files will be overwritten.
-   * Just to be sure, make sure every field is specified.
+   * %D has a resolution of 1s, so it only tells runs apart; %t never repeats.
+   * Within a run either %n or %t is needed, and across runs one of %r, %D and %t.
    */
-  return std::all_of(fields.cbegin(), fields.cend(), [](const auto &f) { return f.second; });
+  const bool within_run = fields['n'] || fields['t'];
+  const bool across_runs = fields['r'] || fields['D'] || fields['t'];
+  return within_run && across_runs && (fields['c'] || !per_channel);
+}
+
+FileWriterModule::OutputFiles::OutputFiles(FileGenerator fg, daqutils::IoBackend::Config io)
+    : m_fg(std::move(fg)), m_io(std::move(io)) {
+  m_next = m_worker.submit([this]() { return prepare(); });
+}
+
+FileWriterModule::OutputFiles::Prepared FileWriterModule::OutputFiles::prepare() {
+  Prepared file;
+  file.filenum = m_fg.filenum();
+  file.path = m_fg.next();
+  file.root = m_fg.root();
+  file.backend = daqutils::IoBackend::create(m_io);
+  file.backend->open(file.path, false);
+  return file;
+}
+
+std::unique_ptr<daqutils::IoBackend> FileWriterModule::OutputFiles::next() {
+  check_closed(false);
+  Prepared file;
+  try {
+    file = m_next.get();
+  } catch (const std::system_error &e) {
+    throw WriteFail(ERS_HERE, e.what());
+  }
+  ERS_DEBUG(0, "Switching to output file " << file.path);
+  m_root = file.root;
+  m_next = m_worker.submit([this]() { return prepare(); });
+  return std::move(file.backend);
+}
+
+void FileWriterModule::OutputFiles::retire(std::unique_ptr<daqutils::IoBackend> file) {
+  m_closing.push_back(m_worker.submit([f = std::move(file)]() { f->close(); }));
+}
+
+unsigned FileWriterModule::OutputFiles::finish() {
+  check_closed(true);
+  try {
+    Prepared file = m_next.get();
+    file.backend->close();
+    std::filesystem::remove(file.path);
+    return file.filenum;
+  } catch (const std::exception &e) {
+    ERS_WARNING("Could not remove unused output file: " << e.what());
+    return m_fg.filenum();
+  }
+}
+
+void FileWriterModule::OutputFiles::check_closed(const bool wait) {
+  while (!m_closing.empty() &&
+         (wait || m_closing.front().wait_for(0s) == std::future_status::ready)) {
+    auto closing = std::move(m_closing.front());
+    m_closing.pop_front();
+    try {
+      closing.get();
+    } catch (const std::system_error &e) {
+      throw WriteFail(ERS_HERE, e.what());
+    }
+  }
 }
 
 FileWriterModule::FileWriterModule(const std::string &n) : DAQProcess(n), m_stopWriters{false} {
@@ -98,39 +195,190 @@ void FileWriterModule::configure() {
   // Read out required and optional configurations
   m_max_filesize = getModuleSettings().value("max_filesize", 1 * daqutils::Constant::Giga);
   m_buffer_size = getModuleSettings().value("buffer_size", 4 * daqutils::Constant::Kilo);
+  m_split_payloads = getModuleSettings().value("split_payloads", false);
+  m_max_file_age = std::chrono::seconds(getModuleSettings().value("max_file_seconds", 0u));
+  m_align_rotation = getModuleSettings().value("align_rotation", false);
+  m_interleaved = getModuleSettings().value("interleaved", false);
   m_channels = m_config.getNumReceiverConnections(m_name);
-  m_pattern = getModuleSettings()["filename_pattern"];
   ERS_INFO("Configuration --> Maximum filesize: " << m_max_filesize << "B"
                                                   << " | Buffer size: " << m_buffer_size << "B"
-                                                  << " | channels: " << m_channels);
+                                                  << " | channels: " << m_channels
+                                                  << (m_interleaved ? " (interleaved)" : ""));
+  if (m_max_filesize == 0) {
+    throw InvalidParameter(ERS_HERE, "0", "max_filesize");
+  }
 
-  if (!FileGenerator::yields_unique(m_pattern)) {
-    ERS_WARNING("Configured file name pattern '"
-                << m_pattern
-                << "' may not yield unique output file on rotation; your files may be silently "
-                   "overwritten. Ensure the pattern contains all fields ('%c', '%n' and '%D').");
-    throw InvalidFileName(ERS_HERE);
+  const std::string io_backend = getModuleSettings().value("io_backend", "Buffered");
+  if (auto kind = daqutils::IoBackend::kind_from_string(io_backend)) {
+    m_io.kind = *kind;
+  } else {
+    throw InvalidParameter(ERS_HERE, io_backend, "io_backend");
+  }
+  m_io.buffer_size = getModuleSettings().value("io_buffer_size", m_io.buffer_size);
+  m_io.queue_depth = getModuleSettings().value("io_queue_depth", m_io.queue_depth);
+  m_io.direct = getModuleSettings().value("io_direct", m_io.direct);
+  m_io = daqutils::IoBackend::available(m_io);
+  ERS_INFO("I/O backend: " << daqutils::IoBackend::to_string(m_io.kind));
+
+  daqutils::Writeback::Policy writeback;
+  writeback.range_bytes = getModuleSettings().value("writeback_bytes", writeback.range_bytes);
+  writeback.sync_interval =
+      std::chrono::milliseconds(getModuleSettings().value("sync_interval_ms", 0u));
+  writeback.sync_on_close = getModuleSettings().value("sync_on_rotation", writeback.sync_on_close);
+  writeback.drop_cache = getModuleSettings().value("drop_cache", writeback.drop_cache);
+  m_io.writeback = writeback.enabled()
+                       ? std::make_shared<daqutils::Writeback>(writeback, &m_writebackStats)
+                       : nullptr;
+
+  m_outputRoots.reset();
+  if (getModuleSettings().contains("output_roots")) {
+    std::vector<std::string> roots = getModuleSettings()["output_roots"];
+    std::string str = getModuleSettings().value("root_placement", "RoundRobin");
+    auto placement = daqutils::OutputRoots::placement_from_string(str);
+    if (!placement) {
+      throw InvalidParameter(ERS_HERE, str, "root_placement");
+    }
+    if (!roots.empty()) {
+      m_outputRoots = std::make_shared<daqutils::OutputRoots>(roots, *placement);
+    }
+  }
+
+  if (m_interleaved && m_split_payloads) {
+    ERS_WARNING("split_payloads is ignored in interleaved mode; records are never split.");
+  }
+
+  const auto parse_policy = [](const std::string &str) {
+    if (auto policy = PayloadQueue::policy_from_string(str)) {
+      return *policy;
+    }
+    throw InvalidParameter(ERS_HERE, str, "overflow_policy");
+  };
+  InputSettings default_input;
+  if (getModuleSettings().contains("overflow_policy")) {
+    default_input.overflow_policy = parse_policy(getModuleSettings()["overflow_policy"]);
+  }
+  default_input.spill_directory =
+      getModuleSettings().value("spill_directory", default_input.spill_directory);
+  default_input.spill_max_bytes =
+      getModuleSettings().value("spill_max_bytes", default_input.spill_max_bytes);
+  m_inputSettings.clear();
+  if (getModuleSettings().contains("inputs")) {
+    for (auto &[key, elem] : getModuleSettings()["inputs"].items()) {
+      uint64_t chid = elem.at("chid");
+      InputSettings &input = m_inputSettings[chid] = default_input;
+      if (elem.contains("overflow_policy")) {
+        input.overflow_policy = parse_policy(elem["overflow_policy"]);
+      }
+      input.spill_directory = elem.value("spill_directory", default_input.spill_directory);
+      input.spill_max_bytes = elem.value("spill_max_bytes", default_input.spill_max_bytes);
+    }
+  }
+
+  // Every payload is written to each destination, by default the single filename_pattern.
+  m_destinations.clear();
+  if (getModuleSettings().contains("destinations")) {
+    for (const auto &elem : getModuleSettings()["destinations"]) {
+      DestinationSettings &dest = m_destinations.emplace_back();
+      dest.pattern = elem.at("filename_pattern");
+      dest.queue_size = elem.value("queue_size", dest.queue_size);
+      if (elem.contains("overflow_policy")) {
+        dest.overflow_policy = parse_policy(elem["overflow_policy"]);
+      }
+      if (elem.contains("spill_directory")) {
+        dest.spill_directory = elem["spill_directory"];
+      }
+      if (elem.contains("spill_max_bytes")) {
+        dest.spill_max_bytes = elem["spill_max_bytes"];
+      }
+    }
+  } else {
+    m_destinations.emplace_back().pattern = getModuleSettings()["filename_pattern"];
+  }
+  for (size_t i = 0; i != m_destinations.size(); ++i) {
+    const DestinationSettings &dest = m_destinations[i];
+    if (m_outputRoots && std::filesystem::path(dest.pattern).is_absolute() &&
+        dest.pattern.find("%R") == std::string::npos) {
+      ERS_WARNING("Absolute file name pattern '" << dest.pattern
+                                                 << "' has no '%R'; output_roots are not used.");
+    }
+    if (!FileGenerator::yields_unique(dest.pattern, !m_interleaved)) {
+      ERS_WARNING("Configured file name pattern '"
+                  << dest.pattern
+                  << "' may not yield unique output file on rotation; your files may be silently "
+                     "overwritten. Ensure the pattern contains '%t', or '%n' and one of '%r' and "
+                     "'%D' (and '%c' unless interleaved).");
+      throw InvalidFileName(ERS_HERE);
+    }
+    for (size_t j = 0; j != i; ++j) {
+      if (m_destinations[j].pattern == dest.pattern) {
+        throw InvalidParameter(ERS_HERE, dest.pattern, "destinations");
+      }
+    }
+    if (m_destinations.size() > 1 && dest.overflow_policy.value_or(default_input.overflow_policy) ==
+                                         PayloadQueue::Policy::Block) {
+      ERS_WARNING("Destination '" << dest.pattern
+                                  << "' blocks its inputs once it falls behind by queue_size "
+                                     "payloads, holding back the other destinations; consider "
+                                     "the Spill or Drop overflow policies.");
+    }
   }
 
   ERS_DEBUG(0, "setup finished");
 
-  // Contruct variables for metrics
+  // Contruct variables for metrics and missing input settings
   for (uint64_t chid = 0; chid < m_channels; chid++) {
-    m_channelMetrics[chid];
+    for (size_t dest = 0; dest != m_destinations.size(); ++dest) {
+      m_channelMetrics[chid].destinations[dest];
+    }
+    m_inputSettings.emplace(chid, default_input);
   }
 
   if (m_statistics) {
+    if (m_outputRoots) {
+      for (size_t i = 0; i != m_outputRoots->size(); ++i) {
+        m_statistics->registerMetric<std::atomic<size_t>>(
+            &(*m_outputRoots)[i].bytes_written, "BytesWritten_root" + std::to_string(i),
+            daqling::core::metrics::RATE);
+        m_statistics->registerMetric<std::atomic<size_t>>(
+            &(*m_outputRoots)[i].write_latency_us, "WriteLatency_us_root" + std::to_string(i),
+            daqling::core::metrics::AVERAGE);
+      }
+    }
+    if (m_io.writeback) {
+      m_statistics->registerMetric<std::atomic<size_t>>(&m_writebackStats.range_latency_us,
+                                                        "WritebackLatency_us",
+                                                        daqling::core::metrics::AVERAGE);
+      m_statistics->registerMetric<std::atomic<size_t>>(&m_writebackStats.sync_latency_us,
+                                                        "SyncLatency_us",
+                                                        daqling::core::metrics::AVERAGE);
+    }
     // Register statistical variables
     for (auto & [ chid, metrics ] : m_channelMetrics) {
-      m_statistics->registerMetric<std::atomic<size_t>>(&metrics.bytes_written,
-                                                        "BytesWritten_chid" + std::to_string(chid),
-                                                        daqling::core::metrics::RATE);
-      m_statistics->registerMetric<std::atomic<size_t>>(
-          &metrics.payload_queue_size, "PayloadQueueSize_chid" + std::to_string(chid),
-          daqling::core::metrics::LAST_VALUE);
       m_statistics->registerMetric<std::atomic<size_t>>(&metrics.payload_size,
                                                         "PayloadSize_chid" + std::to_string(chid),
                                                         daqling::core::metrics::AVERAGE);
+      for (auto & [ dest, dm ] : metrics.destinations) {
+        const std::string suffix = metric_suffix(chid, dest);
+        m_statistics->registerMetric<std::atomic<size_t>>(
+            &dm.bytes_written, "BytesWritten" + suffix, daqling::core::metrics::RATE);
+        m_statistics->registerMetric<std::atomic<size_t>>(
+            &dm.payload_queue_size, "PayloadQueueSize" + suffix, daqling::core::metrics::LAST_VALUE);
+        m_statistics->registerMetric<std::atomic<size_t>>(
+            &dm.overflow.blocked_us, "OverflowBlockedTime_us" + suffix, daqling::core::metrics::RATE);
+        m_statistics->registerMetric<std::atomic<size_t>>(&dm.overflow.dropped_newest,
+                                                          "OverflowDroppedNewest" + suffix,
+                                                          daqling::core::metrics::LAST_VALUE);
+        m_statistics->registerMetric<std::atomic<size_t>>(&dm.overflow.dropped_oldest,
+                                                          "OverflowDroppedOldest" + suffix,
+                                                          daqling::core::metrics::LAST_VALUE);
+        m_statistics->registerMetric<std::atomic<size_t>>(
+            &dm.overflow.spilled, "OverflowSpilled" + suffix, daqling::core::metrics::LAST_VALUE);
+        m_statistics->registerMetric<std::atomic<size_t>>(
+            &dm.overflow.unspilled, "OverflowUnspilled" + suffix, daqling::core::metrics::LAST_VALUE);
+        m_statistics->registerMetric<std::atomic<size_t>>(&dm.overflow.spill_bytes,
+                                                          "OverflowSpillBytes" + suffix,
+                                                          daqling::core::metrics::LAST_VALUE);
+      }
     }
     ERS_DEBUG(0, "Metrics are setup");
   }
@@ -141,26 +389,60 @@ void FileWriterModule::start(unsigned run_num) {
   DAQProcess::start(run_num);
 
   m_stopWriters.store(false);
-  unsigned int threadid = 11111;       // XXX: magic
-  constexpr size_t queue_size = 10000; // XXX: magic
+  // Files are numbered from 0 in every run; restarting the same run continues the numbering.
+  if (m_fileNumbersRun != m_run_number) {
+    m_fileNumbers.clear();
+    m_fileNumbersRun = m_run_number;
+  }
+  unsigned int threadid = 11111; // XXX: magic
 
   for (uint64_t chid = 0; chid < m_channels; chid++) {
-    // For each channel, construct a context of a payload queue, a consumer thread, and a producer
-    // thread.
-    std::array<unsigned int, 2> tids = {{threadid++, threadid++}};
-    const auto & [ it, success ] =
-        m_channelContexts.emplace(chid, std::forward_as_tuple(queue_size, tids));
+    // For each channel, construct a context of a producer thread and, for each destination, a
+    // payload queue and a consumer thread.
+    const auto & [ it, success ] = m_channelContexts.emplace(chid, threadid++);
     ERS_DEBUG(0, " success: " << success);
     assert(success);
-
-    // Start the context's consumer thread.
-    std::get<ThreadContext>(it->second)
-        .consumer.set_work(&FileWriterModule::flusher, this, it->first,
-                           std::ref(std::get<PayloadQueue>(it->second)), m_buffer_size,
-                           FileGenerator(m_pattern, it->first, m_run_number));
+    const InputSettings &input = m_inputSettings.at(chid);
+    for (size_t dest = 0; dest != m_destinations.size(); ++dest) {
+      const DestinationSettings &settings = m_destinations[dest];
+      PayloadQueue::Config queue_config;
+      queue_config.capacity = settings.queue_size;
+      queue_config.policy = settings.overflow_policy.value_or(input.overflow_policy);
+      queue_config.spill_filename =
+          (std::filesystem::path(settings.spill_directory.value_or(input.spill_directory)) /
+           (m_name + metric_suffix(chid, dest) + ".spill"))
+              .string();
+      queue_config.spill_max_bytes = settings.spill_max_bytes.value_or(input.spill_max_bytes);
+      queue_config.counters = &m_channelMetrics.at(chid).destinations.at(dest).overflow;
+      auto &ctx = *it->second.destinations.emplace_back(
+          std::make_unique<DestinationContext>(queue_config, threadid++));
+
+      // Start the destination's consumer thread.
+      if (!m_interleaved) {
+        ctx.consumer.set_work(&FileWriterModule::flusher, this, chid, dest, std::ref(ctx.queue),
+                              m_buffer_size,
+                              FileGenerator(settings.pattern, chid, m_run_number, m_outputRoots,
+                                            m_fileNumbers[{chid, dest}]));
+      }
+    }
   }
   assert(m_channelContexts.size() == m_channels);
 
+  if (m_interleaved && !m_channelContexts.empty()) {
+    // A single consumer thread per destination, that of the first context, writes the payload
+    // queues of the destination of all channels.
+    for (size_t dest = 0; dest != m_destinations.size(); ++dest) {
+      std::vector<std::pair<uint64_t, PayloadQueue *>> queues;
+      for (auto & [ chid, ctx ] : m_channelContexts) {
+        queues.emplace_back(chid, &ctx.destinations[dest]->queue);
+      }
+      m_channelContexts.begin()->second.destinations[dest]->consumer.set_work(
+          &FileWriterModule::interleaved_flusher, this, dest, queues, m_buffer_size,
+          FileGenerator(m_destinations[dest].pattern, FileGenerator::all_channels, m_run_number,
+                        m_outputRoots, m_fileNumbers[{FileGenerator::all_channels, dest}]));
+    }
+  }
+
   m_monitor_thread = std::thread(&FileWriterModule::monitor_runner, this);
 
   m_start_completed.store(true);
@@ -171,8 +453,10 @@ void FileWriterModule::stop() {
   m_stopWriters.store(true);
   for (auto & [ chid, ctx ] : m_channelContexts) {
     ERS_DEBUG(0, " stopping context[" << chid << "]");
-    while (!std::get<ThreadContext>(ctx).consumer.get_readiness()) {
-      std::this_thread::sleep_for(1ms);
+    for (auto &dest : ctx.destinations) {
+      while (!dest->consumer.get_readiness()) {
+        std::this_thread::sleep_for(1ms);
+      }
     }
   }
   m_channelContexts.clear();
@@ -191,26 +475,41 @@ void FileWriterModule::runner() noexcept {
 
   // Start the producer thread of each context
   for (auto &it : m_channelContexts) {
-    std::get<ThreadContext>(it.second).producer.set_work([&]() {
+    it.second.producer.set_work([&]() {
       addTag();
-      auto &pq = std::get<PayloadQueue>(it.second);
+      auto &destinations = it.second.destinations;
+      auto &metrics = m_channelMetrics.at(it.first);
+      const auto update_lag = [&]() {
+        if (m_statistics) {
+          for (size_t dest = 0; dest != destinations.size(); ++dest) {
+            metrics.destinations.at(dest).payload_queue_size = destinations[dest]->queue.sizeGuess();
+          }
+        }
+      };
 
       while (m_run) {
         DataFragment<daqling::utilities::Binary> pl;
         while (!m_connections.sleep_receive(it.first, pl) && m_run) {
-          if (m_statistics) {
-            m_channelMetrics.at(it.first).payload_queue_size = pq.sizeGuess();
+          for (auto &dest : destinations) {
+            dest->queue.service(); // feed back payloads held back by the overflow policy
           }
+          update_lag();
         }
         size_t size = pl.size();
         ERS_DEBUG(0, " Received " << size << "B payload on channel: " << it.first);
         SharedDataType<daqling::utilities::Binary> pl_shared(std::move(pl));
         pl_shared.make_shared();
-        while (!pq.write(pl_shared) && m_run) {
-        } // try until successful append
+        // Every destination references the same payload; overflow is handled according to the
+        // policy of each.
+        for (size_t dest = 0; dest + 1 < destinations.size(); ++dest) {
+          SharedDataType<daqling::utilities::Binary> reference(pl_shared);
+          destinations[dest]->queue.push(std::move(reference), m_run);
+        }
+        destinations.back()->queue.push(std::move(pl_shared), m_run);
         if (m_statistics) {
-          m_channelMetrics.at(it.first).payload_size = size;
+          metrics.payload_size = size;
         }
+        update_lag();
       }
     });
   }
@@ -222,96 +521,207 @@ void FileWriterModule::runner() noexcept {
   ERS_DEBUG(0, " Runner stopped");
 }
 
-void FileWriterModule::flusher(const uint64_t chid, PayloadQueue &pq, const size_t max_buffer_size,
-                               FileGenerator fg) const {
+std::string FileWriterModule::metric_suffix(const uint64_t chid, const size_t dest) const {
+  // With a single destination, names are those of the module without destinations.
+  std::string suffix = "_chid" + std::to_string(chid);
+  if (m_destinations.size() > 1) {
+    suffix += "_dest" + std::to_string(dest);
+  }
+  return suffix;
+}
+
+std::chrono::system_clock::time_point FileWriterModule::rotation_deadline() const {
+  const auto now = std::chrono::system_clock::now();
+  if (m_max_file_age.count() == 0) {
+    return std::chrono::system_clock::time_point::max();
+  }
+  if (m_align_rotation) {
+    return now - now.time_since_epoch() % m_max_file_age + m_max_file_age;
+  }
+  return now + m_max_file_age;
+}
+
+void FileWriterModule::flusher(const uint64_t chid, const size_t dest, PayloadQueue &pq,
+                               const size_t max_buffer_size, FileGenerator fg) const {
   addTag();
-  size_t bytes_written = 0;
-  std::ofstream out = fg.next();
-  auto buffer = SharedDataType<daqling::utilities::Binary>();
-
-  const auto flush = [&](SharedDataType<daqling::utilities::Binary> &data) {
-    out.write(data->data<char *>(), static_cast<std::streamsize>(data.size()));
-    if (out.fail()) {
-      ERS_WARNING(" Write operation for channel " << chid << " of size " << data.size()
-                                                  << "B failed!");
-      throw OfstreamFail(ERS_HERE);
-    }
-    m_channelMetrics.at(chid).bytes_written += data.size();
-    bytes_written += data.size();
-    data = SharedDataType<daqling::utilities::Binary>();
+  // Payloads are moved out of the queue into the writer and written from where they are.
+  OutputFiles files(std::move(fg), m_io);
+  Writer writer(files.next());
+
+  // Writes up to `limit` pending bytes to the current file.
+  const auto flush = [&](size_t limit) {
+    const size_t size = std::min(limit, writer.pending());
+    const auto write_start = std::chrono::steady_clock::now();
+    try {
+      writer.write(size);
+    } catch (const std::system_error &e) {
+      ERS_WARNING(" Write operation for channel " << chid << " of size " << size << "B failed!");
+      throw WriteFail(ERS_HERE, e.what());
+    }
+    files.record_write(size, std::chrono::steady_clock::now() - write_start);
+    m_channelMetrics.at(chid).destinations.at(dest).bytes_written += size;
+  };
+
+  auto deadline = rotation_deadline();
+  const auto rotate = [&]() {
+    ERS_INFO(" Rotating output files for channel "
+             << chid << (m_destinations.size() > 1 ? " of destination " + std::to_string(dest) : ""));
+    files.retire(writer.swap(files.next()));
+    deadline = rotation_deadline();
+  };
+  // Rotates a file past its max_file_seconds deadline; empty files are kept.
+  const auto rotate_if_old = [&]() {
+    if (std::chrono::system_clock::now() < deadline) {
+      return;
+    }
+    if (writer.offset() + writer.pending() == 0) {
+      deadline = rotation_deadline();
+      return;
+    }
+    flush(SIZE_MAX);
+    rotate();
   };
 
   while (!m_stopWriters) {
     while (pq.isEmpty() && !m_stopWriters) { // wait until we have something to write
+      rotate_if_old();
       std::this_thread::sleep_for(1ms);
     };
     if (m_stopWriters) {
-      flush(buffer);
-      return;
-    }
-
-    if (bytes_written + buffer.size() > m_max_filesize) { // Rotate output files
-      ERS_INFO(" Rotating output files for channel " << chid);
-      flush(buffer);
-      out.flush();
-      out.close();
-      out = fg.next();
-      bytes_written = 0;
+      break;
     }
 
     auto payload = pq.frontPtr();
+    if (payload == nullptr) { // Everything queued was dropped by the overflow policy
+      continue;
+    }
+    const size_t payload_size = payload->size();
+    writer.append(std::move(*payload));
+    pq.popFront();
 
-    if (payload->size() + buffer.size() <= max_buffer_size) {
-      buffer += *payload;
-    } else {
-      ERS_DEBUG(0, "Processing buffer split.");
-      const size_t split_offset = max_buffer_size - buffer.size();
-      size_t tail_len = buffer.size() + payload->size() - max_buffer_size;
-      assert(tail_len > 0);
-
-      // Split the payload into a head and a tail
-      SharedDataType<daqling::utilities::Binary> head(payload->data(), split_offset);
-      SharedDataType<daqling::utilities::Binary> tail((*payload)->data<char *>() + split_offset,
-                                                      tail_len);
-      ERS_DEBUG(0, " -> head length: " << head.size() << "; tail length: " << tail.size());
-      assert(head.size() + tail.size() == payload->size());
-
-      buffer += head;
-      flush(buffer);
-
-      // Flush the tail until it is small enough to fit in the buffer
-      while (tail_len > max_buffer_size) {
-        SharedDataType<daqling::utilities::Binary> body(tail.data(), max_buffer_size);
-        SharedDataType<daqling::utilities::Binary> next_tail(tail->data<char *>() + max_buffer_size,
-                                                             tail_len - max_buffer_size);
-        assert(body.size() + next_tail.size() == tail.size());
-        flush(body);
-
-        tail = next_tail;
-        tail_len = next_tail.size();
-        ERS_DEBUG(0, " -> head of tail flushed; new tail length: " << tail_len);
+    if (m_split_payloads) {
+      // Fill every file up to exactly max_filesize, splitting payloads between files.
+      while (writer.offset() + writer.pending() > m_max_filesize) {
+        flush(m_max_filesize - writer.offset());
+        rotate();
       }
+    } else if (writer.offset() + writer.pending() > m_max_filesize &&
+               writer.offset() + writer.pending() > payload_size) {
+      // Start the next file with this payload. A payload larger than max_filesize gets a file
+      // of its own.
+      flush(writer.pending() - payload_size);
+      rotate();
+    }
 
-      buffer = std::move(tail);
-      assert(buffer.size() <= max_buffer_size);
+    if (writer.pending() >= max_buffer_size) {
+      ERS_DEBUG(0, "Writing " << writer.pending() << "B for channel " << chid);
+      flush(SIZE_MAX);
     }
+    rotate_if_old();
+  }
+  flush(SIZE_MAX);
+  try {
+    writer.close();
+  } catch (const std::system_error &e) {
+    throw WriteFail(ERS_HERE, e.what());
+  }
+  m_fileNumbers.at({chid, dest}) = files.finish();
+}
 
-    // We are done with the payload; destruct it.
-    pq.popFront();
+void FileWriterModule::interleaved_flusher(
+    const size_t dest, const std::vector<std::pair<uint64_t, PayloadQueue *>> &queues,
+    const size_t max_buffer_size, FileGenerator fg) const {
+  addTag();
+  static_assert(sizeof(interleaved_record_header) <= Writer::max_copied);
+  OutputFiles files(std::move(fg), m_io);
+  Writer writer(files.next());
+
+  const auto flush = [&]() {
+    const size_t size = writer.pending();
+    const auto write_start = std::chrono::steady_clock::now();
+    try {
+      writer.write();
+    } catch (const std::system_error &e) {
+      ERS_WARNING(" Write operation of interleaved channels of size " << size << "B failed!");
+      throw WriteFail(ERS_HERE, e.what());
+    }
+    files.record_write(size, std::chrono::steady_clock::now() - write_start);
+  };
+
+  auto deadline = rotation_deadline();
+  const auto rotate = [&]() {
+    ERS_INFO(" Rotating interleaved output files"
+             << (m_destinations.size() > 1 ? " of destination " + std::to_string(dest) : ""));
+    flush();
+    files.retire(writer.swap(files.next()));
+    deadline = rotation_deadline();
+  };
+
+  while (!m_stopWriters) {
+    bool idle = true;
+    for (const auto & [ chid, pq ] : queues) {
+      // Take up to a buffer's worth from each channel in turn.
+      size_t taken = 0;
+      while (taken < max_buffer_size && !pq->isEmpty()) {
+        auto payload = pq->frontPtr();
+        if (payload == nullptr) { // Everything queued was dropped by the overflow policy
+          break;
+        }
+        idle = false;
+        const interleaved_record_header header{interleaved_record_header::magic_value, 0, chid,
+                                               payload->size()};
+        const size_t record_size = sizeof(header) + payload->size();
+        // Records are never split between files; one larger than max_filesize gets its own.
+        const size_t file_size = writer.offset() + writer.pending();
+        if (file_size != 0 && file_size + record_size > m_max_filesize) {
+          rotate();
+        }
+        writer.append(&header, sizeof(header));
+        writer.append(std::move(*payload));
+        pq->popFront();
+        m_channelMetrics.at(chid).destinations.at(dest).bytes_written += record_size;
+        taken += record_size;
+        if (writer.pending() >= max_buffer_size) {
+          flush();
+        }
+      }
+    }
+
+    if (std::chrono::system_clock::now() >= deadline) {
+      if (writer.offset() + writer.pending() != 0) {
+        rotate();
+      } else {
+        deadline = rotation_deadline();
+      }
+    }
+    if (idle) {
+      std::this_thread::sleep_for(1ms);
+    }
+  }
+  flush();
+  try {
+    writer.close();
+  } catch (const std::system_error &e) {
+    throw WriteFail(ERS_HERE, e.what());
   }
+  m_fileNumbers.at({FileGenerator::all_channels, dest}) = files.finish();
 }
 
 void FileWriterModule::monitor_runner() {
   addTag();
-  std::map<uint64_t, uint64_t> prev_value;
+  std::map<std::pair<uint64_t, size_t>, uint64_t> prev_value;
   while (m_run) {
     std::this_thread::sleep_for(1s);
     for (auto & [ chid, metrics ] : m_channelMetrics) {
-      ERS_INFO("Bytes written (channel "
-               << chid
-               << "): " << static_cast<double>(metrics.bytes_written - prev_value[chid]) / 1000000
-               << " MBytes/s");
-      prev_value[chid] = metrics.bytes_written;
+      for (auto & [ dest, dm ] : metrics.destinations) {
+        uint64_t &prev = prev_value[{chid, dest}];
+        ERS_INFO("Bytes written (channel "
+                 << chid
+                 << (m_destinations.size() > 1 ? ", destination " + std::to_string(dest) : "")
+                 << "): " << static_cast<double>(dm.bytes_written - prev) / 1000000
+                 << " MBytes/s");
+        prev = dm.bytes_written;
+      }
     }
   }
 }
@@ -18,19 +18,33 @@
 #pragma once
 
 #include "Core/DAQProcess.hpp"
+#include "Utils/BackgroundWorker.hpp"
 #include "Utils/Binary.hpp"
+#include "Utils/GatherWriter.hpp"
+#include "Utils/IoBackend.hpp"
+#include "Utils/OutputRoots.hpp"
+#include "Utils/OverflowQueue.hpp"
 #include "Utils/ReusableThread.hpp"
-#include "folly/ProducerConsumerQueue.h"
-#include <fstream>
+#include "Utils/Writeback.hpp"
+#include <chrono>
+#include <deque>
+#include <future>
 #include <map>
+#include <memory>
+#include <optional>
 #include <tuple>
+#include <vector>
 
 namespace daqling {
 #include <ers/Issue.h>
 
 ERS_DECLARE_ISSUE(module, InvalidFileName, "Invalid File name pattern", ERS_EMPTY)
 
-ERS_DECLARE_ISSUE(module, OfstreamFail, "std::ofstream::fail()", ERS_EMPTY)
+ERS_DECLARE_ISSUE(module, WriteFail, "Writing output file failed: " << reason,
+                  ((std::string)reason))
+
+ERS_DECLARE_ISSUE(module, InvalidParameter, "Invalid parameter \""<< par <<"\" was provided for "<<target<<".",
+                  ((std::string)par)((std::string)target))
 }
 /**
  * Module for writing your acquired data to file.
@@ -47,22 +61,52 @@ public:
   void monitor_runner();
 
 private:
-  struct ThreadContext {
-    ThreadContext(std::array<unsigned int, 2> tids) : consumer(tids[0]), producer(tids[1]) {}
+  using PayloadQueue = daqling::utilities::OverflowQueue<SharedDataType<daqling::utilities::Binary>>;
+  // Payload queue and writing thread of one destination of a channel.
+  struct DestinationContext {
+    DestinationContext(const PayloadQueue::Config &queue_config, unsigned int tid)
+        : queue(queue_config), consumer(tid) {}
+    PayloadQueue queue;
     daqling::utilities::ReusableThread consumer;
-    daqling::utilities::ReusableThread producer;
   };
-  using PayloadQueue = folly::ProducerConsumerQueue<SharedDataType<daqling::utilities::Binary>>;
-  using Context = std::tuple<PayloadQueue, ThreadContext>;
+  // The receiving thread of a channel, which passes every payload to all its destinations.
+  struct Context {
+    Context(unsigned int tid) : producer(tid) {}
+    std::vector<std::unique_ptr<DestinationContext>> destinations;
+    daqling::utilities::ReusableThread producer; // Destroyed before the destinations it feeds.
+  };
+  using Writer = daqling::utilities::GatherWriter<SharedDataType<daqling::utilities::Binary>>;
+
+  // Per-input settings, defaulting to the module-wide ones.
+  struct InputSettings {
+    // What the receiving thread does when the payload queue is full.
+    PayloadQueue::Policy overflow_policy = PayloadQueue::Policy::Block;
+    std::string spill_directory = "/tmp";
+    size_t spill_max_bytes = SIZE_MAX;
+  };
 
-  struct Metrics {
+  // An output of every channel, written independently of the others. Unset overflow settings
+  // are those of the input.
+  struct DestinationSettings {
+    std::string pattern;
+    size_t queue_size = 10000; // Payloads the destination may fall behind by.
+    std::optional<PayloadQueue::Policy> overflow_policy;
+    std::optional<std::string> spill_directory;
+    std::optional<size_t> spill_max_bytes;
+  };
+
+  struct DestinationMetrics {
     std::atomic<size_t> bytes_written = 0;
-    std::atomic<size_t> payload_queue_size = 0;
+    std::atomic<size_t> payload_queue_size = 0; // The lag of the destination, in payloads.
+    daqling::utilities::OverflowCounters overflow;
+  };
+
+  struct Metrics {
     std::atomic<size_t> payload_size = 0;
+    std::map<size_t, DestinationMetrics> destinations;
   };
 
   size_t m_buffer_size{};
-  std::string m_pattern;
   std::atomic<bool> m_start_completed{};
 
   /**
@@ -70,34 +114,117 @@ private:
    */
   class FileGenerator {
   public:
-    FileGenerator(std::string pattern, const uint64_t chid, const unsigned run_number)
-        : m_pattern(std::move(pattern)), m_chid(chid), m_run_number(run_number) {}
+    // Channel id of the files of interleaved mode, which hold all channels ('%c' is "all").
+    static constexpr uint64_t all_channels = UINT64_MAX;
+
+    FileGenerator(std::string pattern, const uint64_t chid, const unsigned run_number,
+                  std::shared_ptr<daqling::utilities::OutputRoots> roots = nullptr,
+                  const unsigned first_filenum = 0)
+        : m_pattern(std::move(pattern)), m_chid(chid), m_filenum(first_filenum),
+          m_run_number(run_number), m_roots(std::move(roots)) {}
 
     /**
-     * Generates the next output file in the sequence.
+     * Generates the next output file name in the sequence, creating its directory if needed.
      *
      * @warning Silently overwrites files if they already exists
      * @warning Silently overwrites previous output files if specified pattern does not generate
      * unique file names.
      */
-    std::ofstream next();
+    std::string next();
 
     /**
-     * Returns whether `pattern` yields unique output files on rotation.
-     * Effectively checks whether the pattern contains %n.
+     * Returns whether `pattern` yields unique output files on rotation and across runs.
+     * Effectively checks whether the pattern contains %t, or %n and one of %r and %D (and %c
+     * with `per_channel` files).
      */
-    static bool yields_unique(const std::string &pattern);
+    static bool yields_unique(const std::string &pattern, bool per_channel = true);
+
+    /// The value of %n of the next file.
+    unsigned filenum() const { return m_filenum; }
+
+    /// The output root of the last generated file.
+    size_t root() const { return m_root; }
+
+    /**
+     * Reports a write to output root `root`, if output roots are used.
+     */
+    void record_write(size_t root, size_t bytes, std::chrono::nanoseconds latency) const {
+      if (m_roots) {
+        m_roots->record(root, bytes, latency);
+      }
+    }
 
   private:
     const std::string m_pattern;
     const uint64_t m_chid;
     unsigned m_filenum = 0;
     const unsigned m_run_number;
+    std::shared_ptr<daqling::utilities::OutputRoots> m_roots;
+    size_t m_root = SIZE_MAX;
+    std::chrono::system_clock::time_point m_last_time; // Of %t, which strictly increases.
+  };
+
+  /**
+   * Output files of a flusher. The next file is created and opened on a background thread while
+   * the current one is written, so that rotating only swaps the backends; rotated files are
+   * closed on that thread as well. Errors are thrown as WriteFail.
+   * Names are generated when the files are prepared: %D and %t of a file are the time the
+   * previous one was opened (the start of the run for the first two), not when it is written.
+   */
+  class OutputFiles {
+  public:
+    OutputFiles(FileGenerator fg, daqling::utilities::IoBackend::Config io);
+
+    /// Returns the next file, open, and starts preparing the one after it.
+    std::unique_ptr<daqling::utilities::IoBackend> next();
+
+    /// Closes a rotated file in the background. Errors are thrown by the next call to next().
+    void retire(std::unique_ptr<daqling::utilities::IoBackend> file);
+
+    /// Waits for rotated files to be closed and removes the prepared file, which was not used.
+    /// Returns the value of %n it had, that of the file to follow these.
+    unsigned finish();
+
+    /// Reports a write to the current file.
+    void record_write(size_t bytes, std::chrono::nanoseconds latency) const {
+      m_fg.record_write(m_root, bytes, latency);
+    }
+
+  private:
+    struct Prepared {
+      std::unique_ptr<daqling::utilities::IoBackend> backend;
+      std::string path;
+      size_t root;
+      unsigned filenum; // Of the file.
+    };
+    Prepared prepare();
+    void check_closed(bool wait);
+
+    FileGenerator m_fg; // Used by the background thread only, once constructed.
+    const daqling::utilities::IoBackend::Config m_io;
+    size_t m_root = SIZE_MAX; // Of the current file.
+    std::future<Prepared> m_next;
+    std::deque<std::future<void>> m_closing;
+    daqling::utilities::BackgroundWorker m_worker; // Last: finishes its tasks before the above go.
   };
 
   // Configs
   size_t m_max_filesize{};
+  bool m_split_payloads = false; // Rotate at exactly max_filesize rather than between payloads.
+  std::chrono::seconds m_max_file_age{}; // Rotate files open this long, unless 0.
+  bool m_align_rotation = false; // Rotate at wall-clock multiples of m_max_file_age instead.
+  bool m_interleaved = false; // Write all channels into one file as framed records.
+  daqling::utilities::Writeback::Stats m_writebackStats; // Outlives the Writeback of m_io.
+  daqling::utilities::IoBackend::Config m_io;
   uint64_t m_channels = 0;
+  std::shared_ptr<daqling::utilities::OutputRoots> m_outputRoots;
+  std::map<uint64_t, InputSettings> m_inputSettings;
+  std::vector<DestinationSettings> m_destinations;
+
+  // Value of %n of the next file per channel (all_channels in interleaved mode) and destination,
+  // continued by the flushers of the next start() of the same run.
+  mutable std::map<std::pair<uint64_t, size_t>, unsigned> m_fileNumbers;
+  std::optional<unsigned> m_fileNumbersRun;
 
   // Thread control
   std::atomic<bool> m_stopWriters;
@@ -106,7 +233,12 @@ private:
   mutable std::map<uint64_t, Metrics> m_channelMetrics;
 
   // Internals
-  void flusher(uint64_t chid, PayloadQueue &pq, size_t max_buffer_size, FileGenerator fg) const;
+  std::chrono::system_clock::time_point rotation_deadline() const;
+  void flusher(uint64_t chid, size_t dest, PayloadQueue &pq, size_t max_buffer_size,
+               FileGenerator fg) const;
+  void interleaved_flusher(size_t dest, const std::vector<std::pair<uint64_t, PayloadQueue *>> &queues,
+                           size_t max_buffer_size, FileGenerator fg) const;
+  std::string metric_suffix(uint64_t chid, size_t dest) const;
   std::map<uint64_t, Context> m_channelContexts;
   std::thread m_monitor_thread;
 };
@@ -18,7 +18,10 @@
 #include "ReadoutInterfaceModule.hpp"
 #include "Common/DataFormat.hpp"
 #include "Utils/Ers.hpp"
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstring>
 #include <random>
 #include <utility>
 using namespace std::chrono_literals;
@@ -28,16 +31,79 @@ using namespace daqling::module;
 ReadoutInterfaceModule::ReadoutInterfaceModule(const std::string &n) : DAQProcess(n) {
   ERS_DEBUG(0, "With config: " << getModuleSettings());
   m_board_id = getModuleSettings()["board_id"];
-  m_delay_us = std::chrono::microseconds(getModuleSettings()["delay_us"]);
+  // "delay_us" between fragments is the former way of setting the rate.
+  const double delay_us = getModuleSettings().value("delay_us", 0.0);
+  m_rate_hz = getModuleSettings().value("rate_hz", delay_us > 0 ? 1e6 / delay_us : 0.0);
+  m_rate_burst = getModuleSettings().value("rate_burst", m_rate_burst);
   m_min_payload = getModuleSettings()["payload"]["min"];
   m_max_payload = getModuleSettings()["payload"]["max"];
+  m_ring_slots = getModuleSettings().value("ring_slots", m_ring_slots);
+  m_batch_size = getModuleSettings().value("batch_size", m_batch_size);
+  m_batch_latency_us = getModuleSettings().value("batch_latency_us", m_batch_latency_us);
+  if (m_max_payload > sizeof(data_t::payload) || m_min_payload > m_max_payload)
+    throw InvalidParameter(ERS_HERE, getModuleSettings()["payload"].dump(), std::string("payload"));
+  if (m_ring_slots != 0 && (m_batch_size == 0 || m_batch_size > m_ring_slots))
+    throw InvalidParameter(ERS_HERE, std::to_string(m_batch_size), std::string("batch_size"));
+  read_traffic(getModuleSettings().value("traffic", nlohmann::json()));
   m_pause = false;
   registerCommand("pause", "pausing", "paused", &ReadoutInterfaceModule::pause, this);
   registerCommand("resume", "resuming", "running", &ReadoutInterfaceModule::resume, this);
 }
 
+void ReadoutInterfaceModule::read_traffic(const nlohmann::json &settings) {
+  if (settings.is_null())
+    return;
+  TrafficModel::Config config;
+  const std::string model = settings.value("model", std::string("fixed"));
+  if (auto arrivals = TrafficModel::arrivals_from_string(model))
+    config.arrivals = *arrivals;
+  else
+    throw InvalidParameter(ERS_HERE, model, std::string("traffic.model"));
+  config.rate_hz = settings.value("rate_hz", m_rate_hz);
+  config.on_rate_hz = settings.value("on_rate_hz", config.on_rate_hz);
+  config.on_ms = settings.value("on_ms", config.on_ms);
+  config.off_ms = settings.value("off_ms", config.off_ms);
+  config.on_size_scale = settings.value("on_size_scale", config.on_size_scale);
+  config.time_scale = settings.value("time_scale", config.time_scale);
+  config.min_size = static_cast<uint16_t>(m_min_payload);
+  config.max_size = static_cast<uint16_t>(m_max_payload);
+  config.histogram_file = settings.value("size_histogram", config.histogram_file);
+  config.trace_file = settings.value("trace", config.trace_file);
+  config.seed = settings.contains("seed") ? settings["seed"].get<uint64_t>()
+                                          : (uint64_t{std::random_device()()} << 32) ^ std::random_device()();
+  if (config.arrivals == TrafficModel::Arrivals::Poisson && config.rate_hz <= 0)
+    throw InvalidParameter(ERS_HERE, std::to_string(config.rate_hz), std::string("traffic.rate_hz"));
+  if (config.arrivals == TrafficModel::Arrivals::OnOff &&
+      (config.on_rate_hz <= 0 || config.on_ms <= 0 || config.off_ms <= 0))
+    throw InvalidParameter(ERS_HERE, settings.dump(), std::string("traffic.on_rate_hz/on_ms/off_ms"));
+  if (config.time_scale <= 0 || config.on_size_scale < 0)
+    throw InvalidParameter(ERS_HERE, settings.dump(), std::string("traffic.time_scale/on_size_scale"));
+  try {
+    m_traffic.emplace(config);
+  } catch (const std::runtime_error &e) {
+    throw InvalidParameter(ERS_HERE, e.what(), std::string("traffic"));
+  }
+}
+
 void ReadoutInterfaceModule::configure() {
   DAQProcess::configure();
+  if (m_ring_slots != 0 && m_ring.size() != m_ring_slots) {
+    // The payload is the same in all fragments: written once, here.
+    std::shared_ptr<data_t> slab(new data_t[m_ring_slots], std::default_delete<data_t[]>());
+    m_ring.clear();
+    for (size_t i = 0; i != m_ring_slots; ++i) {
+      memset(slab.get()[i].payload, 0xFE, sizeof(data_t::payload));
+      m_ring.emplace_back(slab.get() + i, [slab](data_t * /*unused*/) {});
+    }
+  }
+  if (m_statistics) {
+    m_statistics->registerMetric<std::atomic<size_t>>(&m_fragments_sent, "FragmentRate",
+                                                      daqling::core::metrics::RATE);
+    if (m_ring_slots != 0) {
+      m_statistics->registerMetric<std::atomic<size_t>>(&m_ring_stalls, "RingStalls",
+                                                        daqling::core::metrics::LAST_VALUE);
+    }
+  }
   std::this_thread::sleep_for(2s); // some sleep to demonstrate transition states
 }
 
@@ -50,7 +116,10 @@ void ReadoutInterfaceModule::start(unsigned run_num) { DAQProcess::start(run_num
 void ReadoutInterfaceModule::stop() { DAQProcess::stop(); }
 
 void ReadoutInterfaceModule::runner() noexcept {
-  
+  if (!m_ring.empty()) {
+    ring_runner();
+    return;
+  }
   uint32_t sequence_number = 0;
   microseconds timestamp{};
 
@@ -58,6 +127,10 @@ void ReadoutInterfaceModule::runner() noexcept {
   std::mt19937 gen(rd());
   std::uniform_int_distribution<> dis(static_cast<int>(m_min_payload),
                                       static_cast<int>(m_max_payload));
+  daqling::utilities::RateLimiter limiter(m_rate_hz, m_rate_burst);
+  // Each run replays the traffic from its start.
+  std::optional<TrafficModel> traffic(m_traffic);
+  TrafficPacer pacer;
   ERS_DEBUG(0, "Running...");
   while (m_run) {
     if (m_pause) {
@@ -65,9 +138,17 @@ void ReadoutInterfaceModule::runner() noexcept {
       while (m_pause && m_run) {
         std::this_thread::sleep_for(10ms);
       }
+      if (traffic)
+        traffic->skip_to(pacer.now());
+    }
+    TrafficArrival arrival{};
+    if (traffic) {
+      arrival = traffic->next();
+      if (!pacer.wait_until(arrival.time_ns, m_run))
+        break;
     }
     timestamp = duration_cast<microseconds>(system_clock::now().time_since_epoch());
-    const auto payload_size = static_cast<unsigned>(dis(gen));
+    const auto payload_size = traffic ? arrival.size : static_cast<unsigned>(dis(gen));
 
     ERS_DEBUG(0, "sequence number " << sequence_number << " | timestamp " << std::hex << "0x"
                                     << timestamp.count() << std::dec << " | payload size "
@@ -79,15 +160,112 @@ void ReadoutInterfaceModule::runner() noexcept {
     dataFrag->header.source_id = m_board_id;
     dataFrag->header.timestamp = static_cast<uint64_t>(timestamp.count());
     memset(dataFrag->payload, 0xFE, payload_size);
+    if (!traffic && !limiter.acquire(1, m_run))
+      break;
     while ((!m_connections.sleep_send(0, dataFrag)) && m_run) {
       ERS_WARNING("put() failed. Trying again");
     };
+    ++m_fragments_sent;
 
     sequence_number++;
     if (sequence_number == UINT32_MAX) {
       ers::fatal(SequenceLimitReached(ERS_HERE));
     }
-    std::this_thread::sleep_for(m_delay_us);
+  }
+  ERS_DEBUG(0, "Runner stopped");
+}
+
+void ReadoutInterfaceModule::ring_runner() noexcept {
+  uint32_t sequence_number = 0;
+  size_t cursor = 0; // Next slot of the ring.
+
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  std::uniform_int_distribution<> dis(static_cast<int>(m_min_payload),
+                                      static_cast<int>(m_max_payload));
+  daqling::utilities::RateLimiter limiter(m_rate_hz, m_rate_burst);
+  // When rate limited, a batch is what arrives within the latency, if that is fewer.
+  size_t batch_size = m_batch_size;
+  if (limiter.limited() && m_batch_latency_us > 0) {
+    const double arriving = std::floor(limiter.rate_hz() * m_batch_latency_us * 1e-6);
+    batch_size = std::clamp(static_cast<size_t>(std::max(arriving, 1.0)), size_t{1}, m_batch_size);
+  }
+  // With a traffic model, fragments are instead batched as they arrive, until the batch is full
+  // or the next one arrives more than the latency after the first.
+  std::optional<TrafficModel> traffic(m_traffic);
+  TrafficPacer pacer;
+  const auto latency_ns = static_cast<uint64_t>(m_batch_latency_us * 1e3);
+  TrafficArrival pending{};
+  if (traffic) {
+    batch_size = m_batch_size;
+    pending = traffic->next();
+  }
+  ERS_DEBUG(0, "Running with a ring of " << m_ring.size() << " fragments, in batches of "
+                                         << batch_size);
+  while (m_run) {
+    if (m_pause) {
+      ERS_INFO("Paused at sequence number " << sequence_number);
+      while (m_pause && m_run) {
+        std::this_thread::sleep_for(10ms);
+      }
+      if (traffic) {
+        traffic->skip_to(pacer.now());
+        pending = traffic->next();
+      }
+    }
+    if (!traffic && !limiter.acquire(static_cast<double>(batch_size), m_run))
+      break;
+    // Fragments of a batch arrive together, like the completion of a DMA transfer.
+    auto timestamp = duration_cast<microseconds>(system_clock::now().time_since_epoch());
+    const uint64_t batch_start = pending.time_ns;
+    const size_t first = cursor;
+    size_t filled = 0;
+    for (; filled != batch_size && m_run; ++filled) {
+      uint16_t payload_size = 0;
+      if (traffic) {
+        if (filled != 0 && pending.time_ns > batch_start + latency_ns)
+          break;
+        if (!pacer.wait_until(pending.time_ns, m_run))
+          break;
+        timestamp = duration_cast<microseconds>(system_clock::now().time_since_epoch());
+        payload_size = pending.size;
+        pending = traffic->next();
+      } else {
+        payload_size = static_cast<uint16_t>(dis(gen));
+      }
+      std::shared_ptr<data_t> &slot = m_ring[cursor];
+      if (slot.use_count() != 1) {
+        ++m_ring_stalls;
+        while (slot.use_count() != 1 && m_run) {
+          std::this_thread::sleep_for(1us);
+        }
+        if (!m_run)
+          break;
+      }
+      // Pairs with the release of the last reference by the connection.
+      std::atomic_thread_fence(std::memory_order_acquire);
+      slot->header.payload_size = payload_size;
+      slot->header.seq_number = sequence_number;
+      slot->header.source_id = m_board_id;
+      slot->header.timestamp = static_cast<uint64_t>(timestamp.count());
+      cursor = (cursor + 1) % m_ring.size();
+      sequence_number++;
+      if (sequence_number == UINT32_MAX) {
+        ers::fatal(SequenceLimitReached(ERS_HERE));
+      }
+    }
+    for (size_t i = 0; i != filled && m_run; ++i) {
+      // sleep_send() moves from the message: one per attempt.
+      while (m_run) {
+        SharedDataType<data_t> message(m_ring[(first + i) % m_ring.size()]);
+        message.make_shared();
+        if (m_connections.sleep_send(0, message)) {
+          ++m_fragments_sent;
+          break;
+        }
+        ERS_WARNING("put() failed. Trying again");
+      }
+    }
   }
   ERS_DEBUG(0, "Runner stopped");
 }
@@ -17,15 +17,25 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <optional>
 #include <string>
+#include <vector>
 
 #include "Core/DAQProcess.hpp"
+#include "TrafficModel.hpp"
+#include "Utils/Common.hpp"
 
 namespace daqling {
 
 ERS_DECLARE_ISSUE(module, SequenceLimitReached,
                   "Reached maximum sequence number! That's enough for an example...", ERS_EMPTY)
+ERS_DECLARE_ISSUE(module, InvalidParameter, "Invalid parameter \""<< par <<"\" was provided for "<<target<<".",
+                  ((std::string)par)((std::string)target))
 }
+struct data_t;
+
 
 class ReadoutInterfaceModule : public daqling::core::DAQProcess {
   void pause();
@@ -40,8 +50,30 @@ public:
   void runner() noexcept override;
 
 private:
+  /// Runner of the ring mode: fills fragments in place in the ring and sends them in batches.
+  void ring_runner() noexcept;
+
+  /// Reads the "traffic" settings into m_traffic, if present.
+  void read_traffic(const nlohmann::json &settings);
+
   unsigned m_board_id;
-  std::chrono::microseconds m_delay_us{};
+  // Fragments sent per second (unlimited if 0), of which up to m_rate_burst at once after a pause.
+  double m_rate_hz = 0;
+  double m_rate_burst = 1;
+  std::atomic<size_t> m_fragments_sent{0};
   size_t m_min_payload, m_max_payload;
   bool m_pause;
+
+  // Arrivals and sizes of the fragments, replacing the rate and payload settings, if set.
+  std::optional<TrafficModel> m_traffic;
+
+  // Ring mode, if m_ring_slots is not 0: like a DMA ring, fragments are carved from a slab of
+  // m_ring_slots preallocated data_t, filled in place and sent m_batch_size at a time, or as many
+  // as arrive at the rate within m_batch_latency_us. A slot is reused once the connection frees
+  // the fragment it sent from it; until then the ring is full and the runner waits.
+  size_t m_ring_slots = 0;
+  size_t m_batch_size = 1;
+  double m_batch_latency_us = 0;
+  std::vector<std::shared_ptr<data_t>> m_ring; // Slots of the slab, which each keeps alive.
+  std::atomic<size_t> m_ring_stalls{0};        // Times the next slot was still in flight.
 };
@@ -0,0 +1,308 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Arrival of a fragment: when, in nanoseconds since the start of the traffic, and its payload size.
+struct TrafficArrival {
+  uint64_t time_ns;
+  uint16_t size;
+};
+
+/**
+ * Arrival times and payload sizes of the fragments of ReadoutInterfaceModule.
+ * Arrivals:
+ * - Fixed: every 1 / rate;
+ * - Poisson: exponential intervals of mean 1 / rate;
+ * - OnOff: Poisson at on_rate during on periods and at rate (background, possibly 0) during off
+ *   periods, the lengths of which are exponential of means on_ms and off_ms. Sizes are scaled by
+ *   on_size_scale during on periods, as triggers come with larger events;
+ * - Trace: the intervals and sizes of a recorded trace, sped up by time_scale, looped over.
+ * Sizes are uniform between min and max, drawn from a histogram, or those of the trace.
+ * Random numbers come from a seeded mt19937_64 through explicit transforms, so that the same
+ * seed gives the same traffic on every platform.
+ */
+class TrafficModel {
+public:
+  enum class Arrivals { Fixed, Poisson, OnOff, Trace };
+
+  struct Config {
+    Arrivals arrivals = Arrivals::Fixed;
+    double rate_hz = 0; // 0: as fast as possible, with Fixed.
+    double on_rate_hz = 0;
+    double on_ms = 0;
+    double off_ms = 0;
+    double on_size_scale = 1;
+    double time_scale = 1;
+    uint16_t min_size = 0;
+    uint16_t max_size = 0;
+    std::string histogram_file; // Sizes from a histogram instead of uniform, if not empty.
+    std::string trace_file;
+    uint64_t seed = 0;
+  };
+
+  struct Bin {
+    uint16_t size;
+    double cumulative; // Sum of the weights up to this bin, normalized to 1 at the last.
+  };
+
+  struct TracePoint {
+    uint64_t interval_ns; // Since the previous point.
+    uint16_t size;
+  };
+
+  static std::optional<Arrivals> arrivals_from_string(const std::string &str) {
+    if (str == "fixed") {
+      return Arrivals::Fixed;
+    } else if (str == "poisson") {
+      return Arrivals::Poisson;
+    } else if (str == "onoff") {
+      return Arrivals::OnOff;
+    } else if (str == "trace") {
+      return Arrivals::Trace;
+    }
+    return std::nullopt;
+  }
+
+  /// Reads the files of the config. Throws std::runtime_error if one cannot be read or is empty.
+  explicit TrafficModel(const Config &config)
+      : m_config(config), m_rng(config.seed), m_off_rate(config.rate_hz) {
+    if (!m_config.histogram_file.empty()) {
+      m_histogram = read_histogram(m_config.histogram_file, m_config.max_size);
+    }
+    if (m_config.arrivals == Arrivals::Trace) {
+      m_trace = read_trace(m_config.trace_file, m_config.max_size, m_config.time_scale);
+    }
+    if (m_config.arrivals == Arrivals::OnOff) {
+      m_phase_end = exponential(1e-6 / m_config.off_ms);
+    }
+  }
+
+  /// The next arrival, at or after the previous one.
+  TrafficArrival next() {
+    switch (m_config.arrivals) {
+    case Arrivals::Fixed:
+      if (m_config.rate_hz > 0) {
+        m_time = m_origin + static_cast<double>(m_count) * 1e9 / m_config.rate_hz;
+      }
+      break;
+    case Arrivals::Poisson:
+      m_time += exponential(m_config.rate_hz * 1e-9);
+      break;
+    case Arrivals::OnOff:
+      next_on_off();
+      break;
+    case Arrivals::Trace: {
+      const TracePoint &point = m_trace[m_count % m_trace.size()];
+      m_time += static_cast<double>(point.interval_ns);
+      ++m_count;
+      return {static_cast<uint64_t>(m_time), point.size};
+    }
+    }
+    ++m_count;
+    return {static_cast<uint64_t>(m_time), draw_size(m_on ? m_config.on_size_scale : 1)};
+  }
+
+  /// Moves the time of the next arrivals to `time_ns`, if later, e.g. after a pause.
+  void skip_to(uint64_t time_ns) {
+    const double time = static_cast<double>(time_ns);
+    if (time <= m_time) {
+      return;
+    }
+    m_time = time;
+    if (m_config.arrivals == Arrivals::Fixed) {
+      m_origin = m_time;
+      m_count = 0;
+    }
+  }
+
+  static std::vector<Bin> read_histogram(const std::string &filename, uint16_t max_size) {
+    // Lines of "size weight"; '#' starts a comment.
+    std::vector<Bin> bins;
+    double total = 0;
+    for_each_line(filename, [&](std::istringstream &line) {
+      double size = 0;
+      double weight = 0;
+      if (!(line >> size >> weight) || size < 0 || weight < 0) {
+        return false;
+      }
+      if (weight > 0) {
+        total += weight;
+        bins.push_back({clamp_size(size, max_size), total});
+      }
+      return true;
+    });
+    if (bins.empty()) {
+      throw std::runtime_error("no bins in size histogram " + filename);
+    }
+    for (auto &bin : bins) {
+      bin.cumulative /= total;
+    }
+    return bins;
+  }
+
+  static std::vector<TracePoint> read_trace(const std::string &filename, uint16_t max_size,
+                                            double time_scale) {
+    // Lines of "timestamp_us size", in order of time; '#' starts a comment. The trace loops
+    // back with the interval between its first two points.
+    std::vector<TracePoint> trace;
+    double previous_us = 0;
+    for_each_line(filename, [&](std::istringstream &line) {
+      double timestamp_us = 0;
+      double size = 0;
+      if (!(line >> timestamp_us >> size) || size < 0) {
+        return false;
+      }
+      const double interval_us = trace.empty() ? 0 : std::max(timestamp_us - previous_us, 0.0);
+      trace.push_back({static_cast<uint64_t>(interval_us * 1e3 / time_scale), clamp_size(size, max_size)});
+      previous_us = timestamp_us;
+      return true;
+    });
+    if (trace.empty()) {
+      throw std::runtime_error("no points in trace " + filename);
+    }
+    if (trace.size() > 1) {
+      trace[0].interval_ns = trace[1].interval_ns;
+    }
+    return trace;
+  }
+
+private:
+  template <class F> static void for_each_line(const std::string &filename, F &&parse) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+      throw std::runtime_error("cannot open " + filename);
+    }
+    std::string text;
+    for (size_t number = 1; std::getline(file, text); ++number) {
+      text = text.substr(0, text.find('#'));
+      if (text.find_first_not_of(" \t\r") == std::string::npos) {
+        continue;
+      }
+      std::istringstream line(text);
+      if (!parse(line)) {
+        throw std::runtime_error(filename + ":" + std::to_string(number) + ": invalid line");
+      }
+    }
+  }
+
+  static uint16_t clamp_size(double size, uint16_t max_size) {
+    return static_cast<uint16_t>(std::min(std::lround(size), static_cast<long>(max_size)));
+  }
+
+  /// Uniform in [0, 1).
+  double uniform() { return static_cast<double>(m_rng() >> 11) * 0x1.0p-53; }
+
+  /// Exponential of rate `rate` (per ns): infinite if 0.
+  double exponential(double rate) {
+    if (rate <= 0) {
+      return INFINITY;
+    }
+    return -std::log1p(-uniform()) / rate;
+  }
+
+  void next_on_off() {
+    for (;;) {
+      const double rate = m_on ? m_config.on_rate_hz : m_off_rate;
+      const double arrival = m_time + exponential(rate * 1e-9);
+      if (arrival < m_phase_end) {
+        m_time = arrival;
+        return;
+      }
+      // Exponential intervals are memoryless: the next phase starts afresh.
+      m_time = m_phase_end;
+      m_on = !m_on;
+      m_phase_end = m_time + exponential(1e-6 / (m_on ? m_config.on_ms : m_config.off_ms));
+    }
+  }
+
+  uint16_t draw_size(double scale) {
+    double size = 0;
+    if (!m_histogram.empty()) {
+      const double u = uniform();
+      auto bin = std::upper_bound(m_histogram.begin(), m_histogram.end(), u,
+                                  [](double value, const Bin &b) { return value < b.cumulative; });
+      size = bin == m_histogram.end() ? m_histogram.back().size : bin->size;
+    } else {
+      const auto span = static_cast<double>(m_config.max_size - m_config.min_size) + 1;
+      size = m_config.min_size + std::floor(uniform() * span);
+    }
+    return clamp_size(size * scale, m_config.max_size);
+  }
+
+  const Config m_config;
+  std::mt19937_64 m_rng;
+  const double m_off_rate;
+  std::vector<Bin> m_histogram;
+  std::vector<TracePoint> m_trace;
+  double m_time = 0;   // ns
+  double m_origin = 0; // ns: of the fixed arrivals.
+  uint64_t m_count = 0;
+  bool m_on = false;
+  double m_phase_end = INFINITY;
+};
+
+/// Waits for the arrivals of a TrafficModel in real time: sleeps, then spins the last `spin`.
+class TrafficPacer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit TrafficPacer(std::chrono::nanoseconds spin = std::chrono::microseconds(50))
+      : m_spin(spin), m_origin(Clock::now()) {}
+
+  /// Nanoseconds since the start.
+  uint64_t now() const {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_origin).count());
+  }
+
+  /// Waits until `time_ns` since the start. Returns at once if it is past: late arrivals are
+  /// not dropped, so that queues see the backlog as they would from a detector.
+  /// Sleeps in slices of at most 10 ms, as gaps (off periods, traces) may be long, and returns
+  /// false as soon as `run` is cleared.
+  bool wait_until(uint64_t time_ns, const std::atomic<bool> &run) const {
+    const auto deadline = m_origin + std::chrono::nanoseconds(time_ns);
+    for (auto now = Clock::now(); deadline - now > m_spin; now = Clock::now()) {
+      if (!run) {
+        return false;
+      }
+      std::this_thread::sleep_for(std::min<Clock::duration>(deadline - now - m_spin, std::chrono::milliseconds(10)));
+    }
+    while (Clock::now() < deadline) {
+      // spin
+    }
+    return run;
+  }
+
+private:
+  const std::chrono::nanoseconds m_spin;
+  const Clock::time_point m_origin;
+};
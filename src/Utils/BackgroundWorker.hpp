@@ -0,0 +1,107 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DAQLING_UTILITIES_BACKGROUNDWORKER_HPP
+#define DAQLING_UTILITIES_BACKGROUNDWORKER_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+/********************************
+ * BackgroundWorker
+ * Description: Thread executing submitted tasks one after another, in submission order.
+ *   Intended for slow blocking work (e.g. filesystem metadata operations) which should be kept
+ *   off a data path. Tasks still queued on destruction are executed before the thread is joined.
+ * Date: October 2026
+ *********************************/
+
+namespace daqling {
+namespace utilities {
+
+class BackgroundWorker {
+public:
+  BackgroundWorker() : m_thread(&BackgroundWorker::thread_worker, this) {}
+
+  ~BackgroundWorker() {
+    {
+      std::lock_guard<std::mutex> lock(m_mtx);
+      m_quit = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+  }
+
+  BackgroundWorker(const BackgroundWorker &) = delete;
+  BackgroundWorker &operator=(const BackgroundWorker &) = delete;
+  BackgroundWorker(BackgroundWorker &&) = delete;
+  BackgroundWorker &operator=(BackgroundWorker &&) = delete;
+
+  /// Queues `f` for execution. The returned future holds its result (or exception).
+  template <typename Function> std::future<std::invoke_result_t<Function>> submit(Function &&f) {
+    using Result = std::invoke_result_t<Function>;
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(f));
+    std::future<Result> result = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(m_mtx);
+      m_tasks.emplace_back([task]() { (*task)(); });
+    }
+    m_cv.notify_one();
+    return result;
+  }
+
+  /// Number of tasks not yet finished.
+  size_t pending() {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_tasks.size() + (m_busy ? 1 : 0);
+  }
+
+private:
+  std::mutex m_mtx;
+  std::condition_variable m_cv;
+  std::deque<std::function<void()>> m_tasks;
+  bool m_quit = false;
+  bool m_busy = false;
+  std::thread m_thread;
+
+  void thread_worker() {
+    std::unique_lock<std::mutex> lock(m_mtx);
+    while (true) {
+      m_cv.wait(lock, [this] { return m_quit || !m_tasks.empty(); });
+      if (m_tasks.empty()) {
+        return; // m_quit and nothing left to do
+      }
+      std::function<void()> task = std::move(m_tasks.front());
+      m_tasks.pop_front();
+      m_busy = true;
+      lock.unlock();
+      task();
+      lock.lock();
+      m_busy = false;
+    }
+  }
+};
+
+} // namespace utilities
+} // namespace daqling
+
+#endif // DAQLING_UTILITIES_BACKGROUNDWORKER_HPP
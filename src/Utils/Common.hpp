@@ -18,8 +18,13 @@
 #ifndef DAQLING_UTILITIES_COMMON_HPP
 #define DAQLING_UTILITIES_COMMON_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <climits>
+#include <cstdint>
 #include <thread>
+#include <time.h>
 #include <unistd.h>
 
 namespace daqling {
@@ -43,32 +48,118 @@ public:
   static const u_long Giga = 1024 * Mega;
 };
 
-/* RateLimiter usage:
- *
- *  auto limit = RateLimiter();
- *  timestamp_t period_ts = cfg.period * us;
- *  timestamp_t max_overshoot_ts = cfg.max_overshoot * ms;
- *  timestamp_t duration_ts = cfg.duration * s;
+/*
+ * RateLimiter
+ * Token bucket on CLOCK_MONOTONIC: tokens accrue at rate_hz, up to burst of them, and
+ * acquire() waits until the requested ones are available. Implemented as the equivalent
+ * virtual scheduling: m_tat is the time at which the bucket would be full again, advanced by
+ * exactly 1/rate_hz per token, so that the achieved rate does not drift with the time spent
+ * between calls. Waits sleep until `spin` before the deadline, then spin, which keeps
+ * spacings below the timer resolution (~10 us and less) accurate.
  *
- *  if (now > deadline + max_overshoot_ts) {
- *   deadline = now + period_ts;
- *  } else {
- *    while (now < deadline) {
- *      now = limit.gettime();
- *    }
- *    now = limit.gettime();
- *    deadline += period_ts;
+ *  RateLimiter limit(rate_hz, burst);
+ *  while (running) {
+ *    if (!limit.acquire(1, running))
+ *      break;
+ *    send();
  *  }
  *
- */
+ * Default-constructed (or with rate_hz 0), it does not limit. Not thread safe.
+ * */
 class RateLimiter {
 public:
   RateLimiter() = default;
+  explicit RateLimiter(double rate_hz, double burst = 1, timestamp_t spin = 50 * us)
+      : m_interval(rate_hz > 0 ? static_cast<double>(s) / rate_hz : 0),
+        m_tolerance(m_interval * (std::max(burst, 1.0) - 1)), m_spin(spin), m_origin(gettime()) {}
+
   timestamp_t gettime() {
     ::timespec ts{};
     ::clock_gettime(CLOCK_MONOTONIC, &ts);
     return timestamp_t(ts.tv_sec) * s + timestamp_t(ts.tv_nsec) * ns;
   }
+
+  bool limited() const { return m_interval > 0; }
+
+  double rate_hz() const { return limited() ? static_cast<double>(s) / m_interval : 0; }
+
+  /// Nanoseconds until `n` tokens are available.
+  timestamp_t wait_time(double n = 1) {
+    if (!limited()) {
+      return 0;
+    }
+    const double now = elapsed();
+    const double ready = std::max(m_tat, now) + m_interval * (n - 1) - m_tolerance;
+    return ready > now ? static_cast<timestamp_t>(ready - now) : 0;
+  }
+
+  /// Takes `n` tokens if they are available now.
+  bool try_acquire(double n = 1) {
+    if (wait_time(n) != 0) {
+      return false;
+    }
+    take(n);
+    return true;
+  }
+
+  /// Takes `n` tokens, waiting until they are available.
+  void acquire(double n = 1) {
+    wait(n, nullptr);
+    take(n);
+  }
+
+  /// Takes `n` tokens, waiting until they are available unless `run` is cleared first: then
+  /// returns false without taking them. Sleeps in slices, so low rates do not delay a stop.
+  bool acquire(double n, const std::atomic<bool> &run) {
+    if (!wait(n, &run)) {
+      return false;
+    }
+    take(n);
+    return true;
+  }
+
+private:
+  bool wait(double n, const std::atomic<bool> *run) {
+    const timestamp_t wait = wait_time(n);
+    if (wait == 0) {
+      return true;
+    }
+    const timestamp_t deadline = gettime() + wait;
+    for (timestamp_t now = gettime(); now + m_spin < deadline; now = gettime()) {
+      if (run != nullptr && !*run) {
+        return false;
+      }
+      // Bounded only when there is a flag to check.
+      const timestamp_t sleep = deadline - now - m_spin;
+      std::this_thread::sleep_for(std::chrono::nanoseconds(run != nullptr ? std::min(sleep, 10 * ms) : sleep));
+    }
+    while (gettime() < deadline) {
+      // spin
+    }
+    return run == nullptr || *run;
+  }
+
+  // Nanoseconds since m_origin, which is moved up while the bucket is full to keep them small.
+  double elapsed() {
+    const timestamp_t now = gettime();
+    if (m_tat + m_tolerance < static_cast<double>(now - m_origin) - static_cast<double>(s)) {
+      m_origin = now - s;
+      m_tat = 0;
+    }
+    return static_cast<double>(now - m_origin);
+  }
+
+  void take(double n) {
+    if (limited()) {
+      m_tat = std::max(m_tat, elapsed()) + m_interval * n;
+    }
+  }
+
+  double m_interval = 0;  // ns per token
+  double m_tolerance = 0; // ns: burst - 1 tokens
+  timestamp_t m_spin = 0;
+  timestamp_t m_origin = 0;
+  double m_tat = 0; // Theoretical arrival time of the next token, ns since m_origin.
 };
 
 template <class DT> class Timer {
@@ -0,0 +1,177 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DAQLING_UTILITIES_GATHERWRITER_HPP
+#define DAQLING_UTILITIES_GATHERWRITER_HPP
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <optional>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <sys/uio.h>
+
+#include "Utils/IoBackend.hpp"
+
+/********************************
+ * GatherWriter
+ * Description: Writes payloads to a file without copying them. Appended payloads are kept
+ *   (moved in, not copied) until written, and write() hands them to the I/O backend in as few
+ *   calls as possible (with the Buffered backend, pwritev() straight from the payloads). A write
+ *   may stop at any byte offset within a payload, the rest of which is written by the next
+ *   write(), possibly to the next file. Small pieces of data between payloads, such as record
+ *   headers, are appended by copy.
+ *   Payload must be movable and provide `void *data()` and `size_t size() const`.
+ *   Not thread safe.
+ * Date: October 2026
+ *********************************/
+
+namespace daqling {
+namespace utilities {
+
+template <class Payload> class GatherWriter {
+public:
+  explicit GatherWriter(std::unique_ptr<IoBackend> backend) : m_backend(std::move(backend)) {}
+  GatherWriter(const GatherWriter &) = delete;
+  GatherWriter &operator=(const GatherWriter &) = delete;
+  ~GatherWriter() {
+    try {
+      close();
+    } catch (const std::system_error &) {
+      // Errors are reported by explicit close() calls.
+    }
+  }
+
+  /// Opens (truncates) `path` and writes from its beginning. Pending payloads are kept.
+  /// Throws std::system_error.
+  void open(const std::string &path) {
+    m_backend->open(path, false);
+    m_offset = 0;
+  }
+
+  /// Continues with the file opened by `backend` and returns the previous backend, its file
+  /// still open, to be closed by the caller. Pending payloads are kept.
+  std::unique_ptr<IoBackend> swap(std::unique_ptr<IoBackend> backend) {
+    m_backend.swap(backend);
+    m_offset = m_backend->size();
+    return backend;
+  }
+
+  /// Closes the current file. Pending payloads are kept. Throws std::system_error.
+  void close() { m_backend->close(); }
+
+  bool is_open() const { return m_backend->is_open(); }
+
+  static constexpr size_t max_copied = 32;
+
+  void append(Payload &&payload) {
+    const size_t size = payload.size();
+    if (size != 0) {
+      m_entries.emplace_back().payload.emplace(std::move(payload));
+      m_entries.back().size = size;
+      m_pending += size;
+    }
+  }
+
+  /// Appends a copy of `size` (at most max_copied) bytes.
+  void append(const void *bytes, size_t size) {
+    assert(size <= max_copied);
+    if (size != 0) {
+      Entry &entry = m_entries.emplace_back();
+      std::memcpy(entry.bytes.data(), bytes, size);
+      entry.size = size;
+      m_pending += size;
+    }
+  }
+
+  /// Bytes appended but not yet written.
+  size_t pending() const { return m_pending; }
+
+  /// Bytes written to the current file.
+  size_t offset() const { return m_offset; }
+
+  /**
+   * Writes up to `limit` pending bytes to the current file. Returns the number of bytes written.
+   * Throws std::system_error if the file cannot be written.
+   */
+  size_t write(size_t limit = SIZE_MAX) {
+    limit = std::min(limit, m_pending);
+    size_t done = 0;
+    while (done != limit) {
+      m_iov.clear();
+      size_t batch = 0;
+      for (auto &entry : m_entries) {
+        if (m_iov.size() == max_iov || done + batch == limit) {
+          break;
+        }
+        const size_t len = std::min(entry.size - entry.written, limit - done - batch);
+        m_iov.push_back({entry.data() + entry.written, len});
+        batch += len;
+      }
+      m_backend->write(m_iov.data(), m_iov.size());
+      consume(batch);
+      done += batch;
+    }
+    return done;
+  }
+
+private:
+  struct Entry {
+    std::optional<Payload> payload;
+    std::array<char, max_copied> bytes; // Copied data, unless there is a payload.
+    size_t size = 0;
+    size_t written = 0; // Bytes already written.
+
+    char *data() { return payload ? static_cast<char *>(payload->data()) : bytes.data(); }
+  };
+
+  // Releases the payloads (or parts of them) covered by `bytes` just written.
+  void consume(size_t bytes) {
+    m_offset += bytes;
+    m_pending -= bytes;
+    while (bytes != 0) {
+      Entry &front = m_entries.front();
+      const size_t left = front.size - front.written;
+      if (bytes < left) {
+        front.written += bytes;
+        return;
+      }
+      bytes -= left;
+      m_entries.pop_front();
+    }
+  }
+
+  static constexpr size_t max_iov = IOV_MAX;
+
+  std::unique_ptr<IoBackend> m_backend;
+  std::deque<Entry> m_entries;
+  std::vector<iovec> m_iov;
+  size_t m_offset = 0;
+  size_t m_pending = 0;
+};
+
+} // namespace utilities
+} // namespace daqling
+
+#endif // DAQLING_UTILITIES_GATHERWRITER_HPP
@@ -0,0 +1,494 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DAQLING_UTILITIES_IOBACKEND_HPP
+#define DAQLING_UTILITIES_IOBACKEND_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "Utils/Ers.hpp"
+#include "Utils/IoUring.hpp"
+#include "Utils/Writeback.hpp"
+
+/********************************
+ * IoBackend
+ * Description: Low-level output of the file writers. Data is appended to one open file at a
+ *   time; the caller's buffers are not referenced after write() returns. Implementations:
+ *   - Buffered: pwritev() through the page cache, without copies;
+ *   - Direct:   O_DIRECT, data is staged in an aligned buffer and written in whole buffers,
+ *               the last partial block padded and truncated away on close();
+ *   - Uring:    like Direct (or through the page cache with `direct` false), with up to
+ *               `queue_depth` buffers written asynchronously through io_uring.
+ *   Uring falls back to Direct or Buffered where io_uring is not available, and the O_DIRECT
+ *   backends to page cache writes on filesystems without O_DIRECT support.
+ *   With a Writeback in the configuration, its durability policy is applied to every file.
+ *   Errors are thrown as std::system_error. Not thread safe.
+ * Date: October 2026
+ *********************************/
+
+namespace daqling {
+namespace utilities {
+
+class IoBackend {
+public:
+  enum class Kind {
+    Buffered,
+    Direct,
+    Uring,
+  };
+
+  struct Config {
+    Kind kind = Kind::Buffered;
+    size_t buffer_size = 1024 * 1024; // Staging buffer of Direct and Uring.
+    size_t queue_depth = 8;           // Uring: buffers written at the same time.
+    bool direct = true;               // Uring: bypass the page cache.
+    std::shared_ptr<Writeback> writeback; // Durability policy, shared by the files of a writer.
+  };
+
+  static std::optional<Kind> kind_from_string(const std::string &str) {
+    if (str == "Buffered" || str == "buffered" || str == "pwrite") {
+      return Kind::Buffered;
+    }
+    if (str == "Direct" || str == "direct" || str == "O_DIRECT") {
+      return Kind::Direct;
+    }
+    if (str == "Uring" || str == "uring" || str == "io_uring") {
+      return Kind::Uring;
+    }
+    return std::nullopt;
+  }
+
+  static std::string to_string(Kind kind) {
+    switch (kind) {
+    case Kind::Buffered:
+      return "Buffered";
+    case Kind::Direct:
+      return "Direct";
+    case Kind::Uring:
+      return "Uring";
+    }
+    return "";
+  }
+
+  /// Returns `config` with a kind available on this system, warning if it differs.
+  /// Intended to be called once at configuration, so that create() does not fall back per file.
+  static Config available(Config config);
+
+  static std::unique_ptr<IoBackend> create(const Config &config);
+
+  virtual ~IoBackend() = default;
+
+  /// Opens `path` for writing, truncated unless `append`. A file still open is closed first.
+  virtual void open(const std::string &path, bool append) = 0;
+
+  /// Appends the data of `iov`.
+  virtual void write(const iovec *iov, size_t count) = 0;
+
+  void write(const void *data, size_t size) {
+    iovec iov{const_cast<void *>(data), size};
+    write(&iov, 1);
+  }
+
+  /// Completes all writes and closes the file, which then holds exactly the bytes written.
+  virtual void close() = 0;
+
+  virtual bool is_open() const = 0;
+
+  /// Bytes written to the file, including those still on their way to it.
+  virtual size_t size() const = 0;
+
+  virtual Kind kind() const = 0;
+
+protected:
+  explicit IoBackend(std::shared_ptr<Writeback> writeback) : m_writeback(std::move(writeback)) {}
+
+  /// `flags` include the access mode.
+  static int open_file(const std::string &path, bool append, int flags) {
+    const int fd = ::open(path.c_str(), O_CREAT | O_CLOEXEC | (append ? 0 : O_TRUNC) | flags, 0666);
+    if (fd < 0) {
+      throw std::system_error(errno, std::generic_category(), "open " + path);
+    }
+    return fd;
+  }
+
+  static size_t file_size(int fd) {
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+      throw std::system_error(errno, std::generic_category(), "fstat");
+    }
+    return static_cast<size_t>(st.st_size);
+  }
+
+  /// Writes all of `iov` at `offset`, continuing after short writes.
+  static void pwritev_all(int fd, const iovec *iov, size_t count, uint64_t offset) {
+    std::vector<iovec> rest;
+    while (count != 0) {
+      const int n = static_cast<int>(std::min<size_t>(count, IOV_MAX));
+      const ssize_t ret = ::pwritev(fd, iov, n, static_cast<off_t>(offset));
+      if (ret < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::system_error(errno, std::generic_category(), "pwritev");
+      }
+      if (ret == 0) {
+        throw std::system_error(EIO, std::generic_category(), "pwritev wrote nothing");
+      }
+      offset += static_cast<uint64_t>(ret);
+      // Skip what was written; a partly written entry continues from a copy of it.
+      auto written = static_cast<size_t>(ret);
+      while (count != 0 && written >= iov->iov_len) {
+        written -= iov->iov_len;
+        ++iov;
+        --count;
+      }
+      if (written != 0) {
+        rest.assign(iov, iov + count);
+        rest[0].iov_base = static_cast<char *>(rest[0].iov_base) + written;
+        rest[0].iov_len -= written;
+        iov = rest.data();
+      }
+    }
+  }
+
+  std::shared_ptr<Writeback> m_writeback;
+  Writeback::File m_writeback_file;
+};
+
+/// pwritev() through the page cache.
+class BufferedIoBackend final : public IoBackend {
+public:
+  explicit BufferedIoBackend(const Config &config) : IoBackend(config.writeback) {}
+
+  ~BufferedIoBackend() override {
+    if (m_fd >= 0) {
+      ::close(m_fd);
+    }
+  }
+
+  void open(const std::string &path, bool append) override {
+    close();
+    m_fd = open_file(path, append, O_WRONLY);
+    m_size = append ? file_size(m_fd) : 0;
+    m_writeback_file.open(m_writeback.get(), m_fd, m_size);
+  }
+
+  void write(const iovec *iov, size_t count) override {
+    pwritev_all(m_fd, iov, count, m_size);
+    for (size_t i = 0; i != count; ++i) {
+      m_size += iov[i].iov_len;
+    }
+    m_writeback_file.written(m_size);
+  }
+
+  void close() override {
+    if (m_fd >= 0) {
+      m_writeback_file.close();
+      const int fd = m_fd;
+      m_fd = -1;
+      if (::close(fd) != 0) {
+        throw std::system_error(errno, std::generic_category(), "close");
+      }
+    }
+  }
+
+  bool is_open() const override { return m_fd >= 0; }
+  size_t size() const override { return m_size; }
+  Kind kind() const override { return Kind::Buffered; }
+
+private:
+  int m_fd = -1;
+  size_t m_size = 0;
+};
+
+/// Data staged in aligned buffers, written in whole buffers at aligned offsets.
+class StagedIoBackend : public IoBackend {
+public:
+  static constexpr size_t alignment = 4096; // Covers 512 B and 4 KiB logical blocks.
+
+  ~StagedIoBackend() override {
+    if (m_fd >= 0) {
+      ::close(m_fd);
+    }
+  }
+
+  void open(const std::string &path, bool append) override {
+    close();
+    m_direct = m_want_direct;
+    // Appending reads back the last partial block.
+    const int access = append ? O_RDWR : O_WRONLY;
+    try {
+      m_fd = open_file(path, append, access | (m_direct ? O_DIRECT : 0));
+    } catch (const std::system_error &e) {
+      if (!m_direct || e.code().value() != EINVAL) {
+        throw;
+      }
+      ERS_WARNING("O_DIRECT is not supported for '" << path << "'; writing through the page cache.");
+      m_direct = false;
+      m_fd = open_file(path, append, access);
+    }
+    m_current = next_buffer();
+    m_used = 0;
+    m_offset = 0;
+    if (append) {
+      // Continue from the block holding the end of the file.
+      const size_t size = file_size(m_fd);
+      m_offset = size / alignment * alignment;
+      m_used = size - m_offset;
+      if (m_used != 0) {
+        const ssize_t ret = ::pread(m_fd, m_buffers[m_current].get(), alignment, static_cast<off_t>(m_offset));
+        if (ret < 0 || static_cast<size_t>(ret) < m_used) {
+          throw std::system_error(ret < 0 ? errno : EIO, std::generic_category(), "pread " + path);
+        }
+      }
+    }
+    m_writeback_file.open(m_writeback.get(), m_fd, m_offset + m_used);
+  }
+
+  void write(const iovec *iov, size_t count) override {
+    for (size_t i = 0; i != count; ++i) {
+      const char *data = static_cast<const char *>(iov[i].iov_base);
+      size_t len = iov[i].iov_len;
+      while (len != 0) {
+        const size_t n = std::min(len, m_buffer_size - m_used);
+        std::memcpy(m_buffers[m_current].get() + m_used, data, n);
+        m_used += n;
+        data += n;
+        len -= n;
+        if (m_used == m_buffer_size) {
+          submit(m_current, m_buffer_size, m_offset);
+          m_offset += m_buffer_size;
+          m_used = 0;
+          m_current = next_buffer();
+          m_writeback_file.written(m_offset);
+        }
+      }
+    }
+  }
+
+  void close() override {
+    if (m_fd < 0) {
+      return;
+    }
+    const size_t size = m_offset + m_used;
+    try {
+      if (m_used != 0) {
+        // O_DIRECT writes whole blocks; the padding is truncated away below.
+        const size_t len = m_direct ? (m_used + alignment - 1) / alignment * alignment : m_used;
+        std::memset(m_buffers[m_current].get() + m_used, 0, len - m_used);
+        submit(m_current, len, m_offset);
+        m_used = 0;
+      }
+      drain();
+      if (::ftruncate(m_fd, static_cast<off_t>(size)) != 0) {
+        throw std::system_error(errno, std::generic_category(), "ftruncate");
+      }
+    } catch (...) {
+      m_writeback_file.close();
+      ::close(m_fd);
+      m_fd = -1;
+      throw;
+    }
+    m_writeback_file.close();
+    const int fd = m_fd;
+    m_fd = -1;
+    if (::close(fd) != 0) {
+      throw std::system_error(errno, std::generic_category(), "close");
+    }
+  }
+
+  bool is_open() const override { return m_fd >= 0; }
+  size_t size() const override { return m_offset + m_used; }
+
+protected:
+  StagedIoBackend(const Config &config, size_t buffers, bool direct)
+      : IoBackend(config.writeback),
+        m_buffer_size(std::max(alignment, (config.buffer_size + alignment - 1) / alignment * alignment)),
+        m_want_direct(direct) {
+    for (size_t i = 0; i != buffers; ++i) {
+      void *ptr = nullptr;
+      if (::posix_memalign(&ptr, alignment, m_buffer_size) != 0) {
+        throw std::bad_alloc();
+      }
+      m_buffers.emplace_back(static_cast<char *>(ptr));
+    }
+  }
+
+  /// Writes `size` bytes of buffer `i` at `offset`. The buffer is not reused before it is
+  /// returned by next_buffer().
+  virtual void submit(size_t i, size_t size, uint64_t offset) = 0;
+  /// Returns a buffer that is not being written, waiting for one as needed.
+  virtual size_t next_buffer() = 0;
+  /// Waits for all writes.
+  virtual void drain() = 0;
+
+  struct Free {
+    void operator()(char *ptr) const { std::free(ptr); }
+  };
+
+  const size_t m_buffer_size;
+  std::vector<std::unique_ptr<char, Free>> m_buffers;
+  int m_fd = -1;
+
+private:
+  const bool m_want_direct;
+  bool m_direct = false;
+  size_t m_current = 0;
+  size_t m_used = 0;     // Bytes in the current buffer.
+  uint64_t m_offset = 0; // Of the current buffer in the file.
+};
+
+/// Synchronous O_DIRECT writes from a single buffer.
+class DirectIoBackend final : public StagedIoBackend {
+public:
+  explicit DirectIoBackend(const Config &config) : StagedIoBackend(config, 1, true) {}
+  Kind kind() const override { return Kind::Direct; }
+
+private:
+  void submit(size_t i, size_t size, uint64_t offset) override {
+    iovec iov{m_buffers[i].get(), size};
+    pwritev_all(m_fd, &iov, 1, offset);
+  }
+  size_t next_buffer() override { return 0; }
+  void drain() override {}
+};
+
+/// Asynchronous writes of up to queue_depth buffers through io_uring.
+class UringIoBackend final : public StagedIoBackend {
+public:
+  explicit UringIoBackend(const Config &config)
+      : StagedIoBackend(config, std::max<size_t>(1, config.queue_depth), config.direct),
+        m_ring(static_cast<unsigned>(m_buffers.size())), m_writes(m_buffers.size()) {}
+
+  ~UringIoBackend() override {
+    try {
+      drain();
+    } catch (const std::system_error &) {
+      // The file is closed by the base class.
+    }
+  }
+
+  Kind kind() const override { return Kind::Uring; }
+
+private:
+  struct Write {
+    iovec iov;
+    uint64_t offset;
+    bool busy = false;
+  };
+
+  void submit(size_t i, size_t size, uint64_t offset) override {
+    Write &w = m_writes[i];
+    w.iov = {m_buffers[i].get(), size};
+    w.offset = offset;
+    w.busy = true;
+    m_ring.writev(m_fd, &w.iov, 1, offset, i);
+    ++m_in_flight;
+  }
+
+  // Buffers are used in turn, so the oldest write is waited for when all are busy.
+  size_t next_buffer() override {
+    m_next = (m_next + 1) % m_writes.size();
+    while (m_writes[m_next].busy) {
+      reap(1);
+    }
+    return m_next;
+  }
+
+  void drain() override {
+    while (m_in_flight != 0) {
+      reap(1);
+    }
+  }
+
+  void reap(unsigned min_complete) {
+    int error = 0;
+    m_ring.reap(min_complete, [&](uint64_t i, int32_t res) {
+      Write &w = m_writes[i];
+      w.busy = false;
+      --m_in_flight;
+      if (res < 0) {
+        error = error != 0 ? error : -res;
+      } else if (static_cast<size_t>(res) < w.iov.iov_len) {
+        // Short write: complete it synchronously.
+        iovec rest{static_cast<char *>(w.iov.iov_base) + res, w.iov.iov_len - static_cast<size_t>(res)};
+        // May throw: the ring still consumes the remaining completions (see IoUring::reap).
+        pwritev_all(m_fd, &rest, 1, w.offset + static_cast<uint64_t>(res));
+      }
+    });
+    if (error != 0) {
+      throw std::system_error(error, std::generic_category(), "io_uring write");
+    }
+  }
+
+  IoUring m_ring;
+  std::vector<Write> m_writes; // Per buffer.
+  size_t m_next = 0;
+  size_t m_in_flight = 0;
+};
+
+inline IoBackend::Config IoBackend::available(Config config) {
+  if (config.kind == Kind::Uring) {
+    try {
+      IoUring ring(1);
+    } catch (const std::system_error &e) {
+      const Kind fallback = config.direct ? Kind::Direct : Kind::Buffered;
+      ERS_WARNING("io_uring is not available (" << e.what() << "); using the "
+                                                << to_string(fallback) << " I/O backend.");
+      config.kind = fallback;
+    }
+  }
+  return config;
+}
+
+inline std::unique_ptr<IoBackend> IoBackend::create(const Config &config) {
+  switch (config.kind) {
+  case Kind::Direct:
+    return std::make_unique<DirectIoBackend>(config);
+  case Kind::Uring:
+    try {
+      return std::make_unique<UringIoBackend>(config);
+    } catch (const std::system_error &) {
+      if (config.direct) {
+        return std::make_unique<DirectIoBackend>(config);
+      }
+    }
+    break;
+  case Kind::Buffered:
+    break;
+  }
+  return std::make_unique<BufferedIoBackend>(config);
+}
+
+} // namespace utilities
+} // namespace daqling
+
+#endif // DAQLING_UTILITIES_IOBACKEND_HPP
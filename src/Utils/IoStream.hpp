@@ -0,0 +1,182 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DAQLING_UTILITIES_IOSTREAM_HPP
+#define DAQLING_UTILITIES_IOSTREAM_HPP
+
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "Utils/IoBackend.hpp"
+
+/********************************
+ * IoStream
+ * Description: std::ostream writing a file through an IoBackend, as a movable replacement of
+ *   std::ofstream for writers formatting their output with stream operations.
+ *   flush() hands the buffered data to the backend; tellp() is the size of the file.
+ *   Failures set failbit, error() describes them.
+ * Date: October 2026
+ *********************************/
+
+namespace daqling {
+namespace utilities {
+
+class IoStreamBuf : public std::streambuf {
+public:
+  explicit IoStreamBuf(std::unique_ptr<IoBackend> backend, size_t buffer_size = 64 * 1024)
+      : m_backend(std::move(backend)), m_buffer(buffer_size) {
+    setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+  }
+
+  // The put area stays valid as moving a vector keeps its storage.
+  IoStreamBuf(IoStreamBuf &&other) noexcept
+      : std::streambuf(other), m_backend(std::move(other.m_backend)),
+        m_buffer(std::move(other.m_buffer)), m_error(std::move(other.m_error)) {
+    other.setp(nullptr, nullptr);
+  }
+
+  IoStreamBuf(const IoStreamBuf &) = delete;
+  IoStreamBuf &operator=(const IoStreamBuf &) = delete;
+  IoStreamBuf &operator=(IoStreamBuf &&) = delete;
+
+  ~IoStreamBuf() override { close(); }
+
+  bool open(const std::string &path, bool append) {
+    return attempt([&]() {
+      m_backend->open(path, append);
+      setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+    });
+  }
+
+  bool close() {
+    if (!m_backend || !m_backend->is_open()) {
+      return true;
+    }
+    const bool flushed = sync() == 0;
+    return attempt([&]() { m_backend->close(); }) && flushed;
+  }
+
+  bool is_open() const { return m_backend && m_backend->is_open(); }
+
+  const std::string &error() const { return m_error; }
+
+protected:
+  int_type overflow(int_type ch) override {
+    if (sync() != 0) {
+      return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(ch);
+      pbump(1);
+    }
+    return traits_type::not_eof(ch);
+  }
+
+  std::streamsize xsputn(const char *s, std::streamsize n) override {
+    const auto size = static_cast<size_t>(n);
+    if (size > static_cast<size_t>(epptr() - pptr())) {
+      if (sync() != 0) {
+        return 0;
+      }
+      if (size >= m_buffer.size()) { // Large writes go to the backend directly.
+        return attempt([&]() { m_backend->write(s, size); }) ? n : 0;
+      }
+    }
+    std::memcpy(pptr(), s, size);
+    pbump(static_cast<int>(n));
+    return n;
+  }
+
+  int sync() override {
+    const auto size = static_cast<size_t>(pptr() - pbase());
+    if (size == 0) {
+      return 0;
+    }
+    setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+    return attempt([&]() { m_backend->write(m_buffer.data(), size); }) ? 0 : -1;
+  }
+
+  // Only tells the position (the size of the file), seeking is not supported.
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+    if (off != 0 || dir != std::ios_base::cur || (which & std::ios_base::out) == 0 || !is_open()) {
+      return pos_type(off_type(-1));
+    }
+    return pos_type(static_cast<off_type>(m_backend->size()) + (pptr() - pbase()));
+  }
+
+private:
+  template <class F> bool attempt(F &&f) {
+    try {
+      f();
+      return true;
+    } catch (const std::system_error &e) {
+      m_error = e.what();
+      return false;
+    }
+  }
+
+  std::unique_ptr<IoBackend> m_backend;
+  std::vector<char> m_buffer;
+  std::string m_error;
+};
+
+class IoStream : public std::ostream {
+public:
+  explicit IoStream(std::unique_ptr<IoBackend> backend)
+      : std::ostream(nullptr), m_buf(std::move(backend)) {
+    rdbuf(&m_buf);
+  }
+
+  IoStream(IoStream &&other) noexcept : std::ostream(std::move(other)), m_buf(std::move(other.m_buf)) {
+    set_rdbuf(&m_buf);
+  }
+
+  IoStream(const IoStream &) = delete;
+  IoStream &operator=(const IoStream &) = delete;
+  IoStream &operator=(IoStream &&) = delete;
+
+  void open(const std::string &path, bool append = false) {
+    if (m_buf.open(path, append)) {
+      clear();
+    } else {
+      setstate(std::ios_base::failbit);
+    }
+  }
+
+  void close() {
+    if (!m_buf.close()) {
+      setstate(std::ios_base::failbit);
+    }
+  }
+
+  bool is_open() const { return m_buf.is_open(); }
+
+  const std::string &error() const { return m_buf.error(); }
+
+private:
+  IoStreamBuf m_buf;
+};
+
+} // namespace utilities
+} // namespace daqling
+
+#endif // DAQLING_UTILITIES_IOSTREAM_HPP
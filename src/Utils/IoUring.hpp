@@ -0,0 +1,206 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DAQLING_UTILITIES_IOURING_HPP
+#define DAQLING_UTILITIES_IOURING_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <system_error>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define DAQLING_HAVE_IO_URING 1
+#else
+#define DAQLING_HAVE_IO_URING 0
+#endif
+
+/********************************
+ * IoUring
+ * Description: Minimal io_uring submission/completion ring for asynchronous file writes, set up
+ *   with the raw system calls so that liburing is not required. Construction throws
+ *   std::system_error where io_uring is not available (old kernels, seccomp filters, or
+ *   DAQLING_HAVE_IO_URING is 0); callers fall back to synchronous writes.
+ *   Single producer and consumer: not thread safe.
+ * Date: October 2026
+ *********************************/
+
+namespace daqling {
+namespace utilities {
+
+#if DAQLING_HAVE_IO_URING
+
+class IoUring {
+public:
+  explicit IoUring(unsigned entries) {
+    io_uring_params params{};
+    const long fd = ::syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) {
+      throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+    }
+    m_fd = static_cast<int>(fd);
+    m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+    }
+    m_sq = map(m_sq_size, IORING_OFF_SQ_RING);
+    m_cq = single_mmap ? m_sq : map(m_cq_size, IORING_OFF_CQ_RING);
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = static_cast<io_uring_sqe *>(map(m_sqes_size, IORING_OFF_SQES));
+
+    m_sq_tail = field<unsigned>(m_sq, params.sq_off.tail);
+    m_sq_mask = *field<unsigned>(m_sq, params.sq_off.ring_mask);
+    m_sq_array = field<unsigned>(m_sq, params.sq_off.array);
+    m_cq_head = field<unsigned>(m_cq, params.cq_off.head);
+    m_cq_tail = field<unsigned>(m_cq, params.cq_off.tail);
+    m_cq_mask = *field<unsigned>(m_cq, params.cq_off.ring_mask);
+    m_cqes = field<io_uring_cqe>(m_cq, params.cq_off.cqes);
+  }
+
+  ~IoUring() { release(); }
+
+  IoUring(const IoUring &) = delete;
+  IoUring &operator=(const IoUring &) = delete;
+
+  /// Submits a write of `iov` (which must stay valid until completion) at `offset` of `fd`.
+  /// At most `entries` writes may be in flight.
+  void writev(int fd, const iovec *iov, unsigned count, uint64_t offset, uint64_t user_data) {
+    const unsigned tail = *m_sq_tail;
+    const unsigned i = tail & m_sq_mask;
+    io_uring_sqe &sqe = m_sqes[i];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_WRITEV;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<uint64_t>(iov);
+    sqe.len = count;
+    sqe.off = offset;
+    sqe.user_data = user_data;
+    m_sq_array[i] = i;
+    __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    enter(1, 0, 0);
+  }
+
+  /// Waits for at least `min_complete` completions, then calls f(user_data, result) for every
+  /// completion available, where result is the number of bytes written or -errno.
+  /// All of them are consumed even if `f` throws; the first exception is rethrown afterwards.
+  template <class F> void reap(unsigned min_complete, F &&f) {
+    if (min_complete != 0) {
+      enter(0, min_complete, IORING_ENTER_GETEVENTS);
+    }
+    std::exception_ptr error;
+    unsigned head = *m_cq_head;
+    const unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      const io_uring_cqe &cqe = m_cqes[head & m_cq_mask];
+      try {
+        f(cqe.user_data, cqe.res);
+      } catch (...) {
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+    }
+    __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+private:
+  void *map(size_t size, off_t offset) {
+    void *ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, offset);
+    if (ptr == MAP_FAILED) { // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+      const int err = errno;
+      release();
+      throw std::system_error(err, std::generic_category(), "io_uring mmap");
+    }
+    return ptr;
+  }
+
+  template <class T> static T *field(void *base, uint32_t offset) {
+    return reinterpret_cast<T *>(static_cast<char *>(base) + offset);
+  }
+
+  void enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    while (::syscall(__NR_io_uring_enter, m_fd, to_submit, min_complete, flags, nullptr, 0) < 0) {
+      if (errno != EINTR && errno != EAGAIN) {
+        throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+      }
+    }
+  }
+
+  void release() {
+    if (m_sqes != nullptr) {
+      ::munmap(m_sqes, m_sqes_size);
+    }
+    if (m_cq != nullptr && m_cq != m_sq) {
+      ::munmap(m_cq, m_cq_size);
+    }
+    if (m_sq != nullptr) {
+      ::munmap(m_sq, m_sq_size);
+    }
+    m_sqes = nullptr;
+    m_cq = m_sq = nullptr;
+    if (m_fd >= 0) {
+      ::close(m_fd);
+      m_fd = -1;
+    }
+  }
+
+  int m_fd = -1;
+  void *m_sq = nullptr;
+  void *m_cq = nullptr;
+  io_uring_sqe *m_sqes = nullptr;
+  size_t m_sq_size = 0;
+  size_t m_cq_size = 0;
+  size_t m_sqes_size = 0;
+  unsigned *m_sq_tail = nullptr;
+  unsigned m_sq_mask = 0;
+  unsigned *m_sq_array = nullptr;
+  unsigned *m_cq_head = nullptr;
+  unsigned *m_cq_tail = nullptr;
+  unsigned m_cq_mask = 0;
+  io_uring_cqe *m_cqes = nullptr;
+};
+
+#else
+
+class IoUring {
+public:
+  explicit IoUring(unsigned /*entries*/) {
+    throw std::system_error(ENOSYS, std::generic_category(), "io_uring");
+  }
+  void writev(int /*fd*/, const iovec * /*iov*/, unsigned /*count*/, uint64_t /*offset*/,
+              uint64_t /*user_data*/) {}
+  template <class F> void reap(unsigned /*min_complete*/, F && /*f*/) {}
+};
+
+#endif
+
+} // namespace utilities
+} // namespace daqling
+
+#endif // DAQLING_UTILITIES_IOURING_HPP
@@ -0,0 +1,136 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DAQLING_UTILITIES_OUTPUTROOTS_HPP
+#define DAQLING_UTILITIES_OUTPUTROOTS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+/********************************
+ * OutputRoots
+ * Description: Set of output root directories (typically one per disk) which file writers
+ *   stripe their output files across. Each new file (or set of files written together) is
+ *   placed on a root chosen by the placement policy:
+ *   - RoundRobin: the next root on every call, i.e. on every rotation;
+ *   - PerChannel: a fixed root for each channel id;
+ *   - Throughput: the root with the lowest observed write latency per byte,
+ *                 the least recently chosen one among equals or not yet measured ones.
+ *   Writers report bytes and latencies of their writes, which are exposed for metrics.
+ *   Thread safe.
+ * Date: October 2026
+ *********************************/
+
+namespace daqling {
+namespace utilities {
+
+class OutputRoots {
+public:
+  enum class Placement {
+    RoundRobin,
+    PerChannel,
+    Throughput,
+  };
+
+  struct Root {
+    Root(std::string root_path) : path(std::move(root_path)) {}
+    const std::string path;
+    std::atomic<size_t> bytes_written = 0;
+    std::atomic<size_t> write_latency_us = 0; // Latency of the last reported write.
+    std::atomic<double> ns_per_byte = 0.;     // Moving average of the write cost.
+    std::atomic<uint64_t> last_selected = 0;
+  };
+
+  static std::optional<Placement> placement_from_string(const std::string &str) {
+    if (str == "RoundRobin" || str == "round robin" || str == "rotation") {
+      return Placement::RoundRobin;
+    } else if (str == "PerChannel" || str == "per channel" || str == "channel") {
+      return Placement::PerChannel;
+    } else if (str == "Throughput" || str == "throughput" || str == "least loaded") {
+      return Placement::Throughput;
+    }
+    return std::nullopt;
+  }
+
+  OutputRoots(const std::vector<std::string> &paths, Placement placement)
+      : m_placement(placement) {
+    for (const auto &p : paths) {
+      m_roots.emplace_back(p);
+    }
+  }
+
+  size_t size() const { return m_roots.size(); }
+  Root &operator[](size_t i) { return m_roots[i]; }
+
+  /// Chooses the root for the next file of channel `chid`.
+  size_t select(uint64_t chid) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    size_t ret = 0;
+    switch (m_placement) {
+    case Placement::RoundRobin:
+      ret = m_next++ % m_roots.size();
+      break;
+    case Placement::PerChannel:
+      ret = chid % m_roots.size();
+      break;
+    case Placement::Throughput:
+      for (size_t i = 1; i < m_roots.size(); ++i) {
+        const double cost = m_roots[i].ns_per_byte, best = m_roots[ret].ns_per_byte;
+        // Within 10% counts as equal, so that similar disks share the load.
+        if (cost < 0.9 * best ||
+            (cost <= 1.1 * best && m_roots[i].last_selected < m_roots[ret].last_selected)) {
+          ret = i;
+        }
+      }
+      break;
+    }
+    m_roots[ret].last_selected = ++m_selections;
+    return ret;
+  }
+
+  /// Reports a write of `bytes` to root `i` which took `latency`.
+  void record(size_t i, size_t bytes, std::chrono::nanoseconds latency) {
+    if (i >= m_roots.size() || bytes == 0) {
+      return;
+    }
+    Root &root = m_roots[i];
+    root.bytes_written += bytes;
+    root.write_latency_us =
+        static_cast<size_t>(std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+    const double cost = static_cast<double>(latency.count()) / static_cast<double>(bytes);
+    const double prev = root.ns_per_byte;
+    root.ns_per_byte = prev == 0. ? cost : prev + 0.05 * (cost - prev);
+  }
+
+private:
+  std::mutex m_mtx;
+  std::deque<Root> m_roots; // Not a vector: roots are registered as metrics and must not move.
+  const Placement m_placement;
+  size_t m_next = 0;
+  uint64_t m_selections = 0;
+};
+
+} // namespace utilities
+} // namespace daqling
+
+#endif // DAQLING_UTILITIES_OUTPUTROOTS_HPP
@@ -0,0 +1,308 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DAQLING_UTILITIES_OVERFLOWQUEUE_HPP
+#define DAQLING_UTILITIES_OVERFLOWQUEUE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Utils/Ers.hpp"
+#include "folly/ProducerConsumerQueue.h"
+
+/********************************
+ * OverflowQueue
+ * Description: Single-producer single-consumer payload queue with an explicit policy
+ *   for what the producer does when the queue is full:
+ *   - Block:      wait for a free slot, backing off from yielding to sleeping;
+ *   - DropNewest: discard the payload which did not fit;
+ *   - DropOldest: keep the payload and make the consumer discard the oldest queued one;
+ *   - Spill:      append the payload to a local overflow file which is fed back into
+ *                 the queue (in order) as soon as there is room again.
+ *   T must provide size(), data() and construction from (const void *, size_t),
+ *   i.e. SharedDataType<> of any serializable type.
+ * Date: October 2026
+ *********************************/
+
+namespace daqling {
+namespace utilities {
+
+/// Counters of an OverflowQueue. Owned by the user so that they may be registered as metrics
+/// before the queue itself is created.
+struct OverflowCounters {
+  std::atomic<size_t> blocked_us = 0;     // Total time the producer waited for a free slot.
+  std::atomic<size_t> dropped_newest = 0; // Payloads discarded on arrival.
+  std::atomic<size_t> dropped_oldest = 0; // Queued payloads discarded to make room.
+  std::atomic<size_t> spilled = 0;        // Payloads written to the overflow file.
+  std::atomic<size_t> unspilled = 0;      // Payloads read back from the overflow file.
+  std::atomic<size_t> spill_bytes = 0;    // Current size of the overflow file.
+};
+
+template <class T> class OverflowQueue {
+public:
+  enum class Policy {
+    Block,
+    DropNewest,
+    DropOldest,
+    Spill,
+  };
+
+  struct Config {
+    size_t capacity = 100;
+    Policy policy = Policy::Block;
+    std::string spill_filename;            // Only used by Policy::Spill.
+    size_t spill_max_bytes = SIZE_MAX;     // Payloads are dropped once the spill file is this big.
+    OverflowCounters *counters = nullptr;
+  };
+
+  static std::optional<Policy> policy_from_string(const std::string &str) {
+    if (str == "Block" || str == "block" || str == "wait") {
+      return Policy::Block;
+    } else if (str == "DropNewest" || str == "drop newest" || str == "drop") {
+      return Policy::DropNewest;
+    } else if (str == "DropOldest" || str == "drop oldest") {
+      return Policy::DropOldest;
+    } else if (str == "Spill" || str == "spill" || str == "spill to file") {
+      return Policy::Spill;
+    }
+    return std::nullopt;
+  }
+
+  OverflowQueue(const Config &config)
+      : m_queue(static_cast<uint32_t>(config.capacity + 1)), m_config(config),
+        m_counters(config.counters != nullptr ? config.counters : &m_own_counters) {}
+
+  ~OverflowQueue() {
+    if (m_spill.is_open()) {
+      m_spill.close();
+      if (m_spill_records != 0) {
+        ERS_WARNING(m_spill_records << " spilled payloads were not written and are discarded");
+      }
+      std::remove(m_config.spill_filename.c_str());
+    }
+    m_counters->dropped_newest += m_staging.size() + m_spill_records;
+  }
+
+  OverflowQueue(const OverflowQueue &) = delete;
+  OverflowQueue &operator=(const OverflowQueue &) = delete;
+  OverflowQueue(OverflowQueue &&) = delete;
+  OverflowQueue &operator=(OverflowQueue &&) = delete;
+
+  /// Producer side. Appends `item`, applying the overflow policy if the queue is full.
+  /// Returns false only if the payload was dropped, or `run` was cleared while blocking (it is
+  /// then counted as dropped too).
+  bool push(T &&item, const std::atomic<bool> &run) {
+    service();
+    switch (m_config.policy) {
+    case Policy::Block:
+      return push_blocking(std::move(item), run);
+    case Policy::DropNewest:
+      if (m_queue.write(std::move(item))) {
+        return true;
+      }
+      ++m_counters->dropped_newest;
+      return false;
+    case Policy::DropOldest:
+      if (m_staging.empty() && m_queue.write(std::move(item))) {
+        return true;
+      }
+      return stage(std::move(item));
+    case Policy::Spill:
+      if (m_spill_records == 0 && m_queue.write(std::move(item))) {
+        return true;
+      }
+      return spill(item);
+    }
+    return false;
+  }
+
+  /// Producer side. Moves staged or spilled payloads into the queue while there is room.
+  /// Should also be called periodically while no new payloads arrive.
+  void service() {
+    while (!m_staging.empty() && !m_queue.isFull()) {
+      m_queue.write(std::move(m_staging.front()));
+      m_staging.pop_front();
+    }
+    while (m_spill_records != 0 && !m_queue.isFull()) {
+      if (!unspill()) {
+        break;
+      }
+    }
+  }
+
+  /// Producer side. Number of staged and spilled payloads, not yet in the queue.
+  size_t held() const { return m_staging.size() + m_spill_records; }
+
+  /// Consumer side. Returns the oldest payload or nullptr if there is none.
+  T *frontPtr() {
+    // Discard what the producer has asked to be dropped in favour of newer payloads.
+    for (size_t owed = m_drops_owed.load(); owed != 0 && !m_queue.isEmpty(); --owed) {
+      m_queue.popFront();
+      --m_drops_owed;
+      ++m_counters->dropped_oldest;
+    }
+    return m_queue.frontPtr();
+  }
+
+  /// Consumer side. Discards the payload returned by frontPtr().
+  void popFront() { m_queue.popFront(); }
+
+  /// Consumer side. Note that frontPtr() may still return nullptr after the oldest payloads
+  /// are dropped.
+  bool isEmpty() const { return m_queue.isEmpty(); }
+
+  /// Producer side. Number of payloads waiting to be written, including staged and spilled ones.
+  size_t sizeGuess() const { return m_queue.sizeGuess() + m_staging.size() + m_spill_records; }
+
+  Policy policy() const { return m_config.policy; }
+
+private:
+  bool push_blocking(T &&item, const std::atomic<bool> &run) {
+    if (m_queue.write(std::move(item))) {
+      return true;
+    }
+    // Spin briefly in case the consumer is about to pop, then back off to sleeping
+    // so that a stalled consumer does not cost a whole core.
+    const auto start = std::chrono::steady_clock::now();
+    auto backoff = std::chrono::microseconds(1);
+    unsigned tries = 0;
+    bool written = false;
+    while (!(written = m_queue.write(std::move(item))) && run) {
+      if (++tries < 64) {
+        std::this_thread::yield();
+      } else {
+        std::this_thread::sleep_for(backoff);
+        backoff = std::min(backoff * 2, std::chrono::microseconds(1000));
+      }
+    }
+    m_counters->blocked_us += static_cast<size_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                              start)
+            .count());
+    if (!written) {
+      ++m_counters->dropped_newest;
+    }
+    return written;
+  }
+
+  bool stage(T &&item) {
+    // The consumer drops one queued payload for each staged one, so that what is
+    // eventually written are always the newest `capacity` payloads.
+    if (m_drops_owed.load() < m_config.capacity) {
+      ++m_drops_owed;
+    } else {
+      m_staging.pop_front();
+      ++m_counters->dropped_oldest;
+    }
+    m_staging.push_back(std::move(item));
+    return true;
+  }
+
+  bool spill(T &item) {
+    const uint64_t size = item.size();
+    if (m_spill_write_pos + sizeof(size) + size > m_config.spill_max_bytes) {
+      ++m_counters->dropped_newest;
+      return false;
+    }
+    if (!m_spill.is_open()) {
+      m_spill.open(m_config.spill_filename,
+                   std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+      if (!m_spill.is_open()) {
+        ERS_WARNING("Could not open overflow file '" << m_config.spill_filename
+                                                     << "'. Payload is dropped.");
+        ++m_counters->dropped_newest;
+        return false;
+      }
+    }
+    m_spill.seekp(static_cast<std::streamoff>(m_spill_write_pos));
+    m_spill.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    m_spill.write(static_cast<const char *>(item.data()), static_cast<std::streamsize>(size));
+    if (m_spill.fail()) {
+      ERS_WARNING("Write to overflow file '" << m_config.spill_filename
+                                             << "' failed. Payload is dropped.");
+      m_spill.clear();
+      ++m_counters->dropped_newest;
+      return false;
+    }
+    m_spill_write_pos += sizeof(size) + size;
+    ++m_spill_records;
+    ++m_counters->spilled;
+    m_counters->spill_bytes = m_spill_write_pos - m_spill_read_pos;
+    return true;
+  }
+
+  bool unspill() {
+    uint64_t size = 0;
+    m_spill.flush();
+    m_spill.seekg(static_cast<std::streamoff>(m_spill_read_pos));
+    m_spill.read(reinterpret_cast<char *>(&size), sizeof(size));
+    m_spill_buffer.resize(size);
+    m_spill.read(m_spill_buffer.data(), static_cast<std::streamsize>(size));
+    if (m_spill.fail()) {
+      ERS_WARNING("Read from overflow file '" << m_config.spill_filename << "' failed. "
+                                              << m_spill_records << " payloads are lost.");
+      m_counters->dropped_newest += m_spill_records;
+      reset_spill();
+      return false;
+    }
+    m_queue.write(T(m_spill_buffer.data(), size));
+    ++m_counters->unspilled;
+    m_spill_read_pos += sizeof(size) + size;
+    if (--m_spill_records == 0) {
+      reset_spill(); // Drained: start over from the beginning of the file.
+    }
+    m_counters->spill_bytes = m_spill_write_pos - m_spill_read_pos;
+    return true;
+  }
+
+  void reset_spill() {
+    m_spill_records = 0;
+    m_spill_read_pos = m_spill_write_pos = 0;
+    m_counters->spill_bytes = 0;
+    m_spill.close();
+    m_spill.open(m_config.spill_filename,
+                 std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+  }
+
+  folly::ProducerConsumerQueue<T> m_queue;
+  const Config m_config;
+  OverflowCounters m_own_counters;
+  OverflowCounters *m_counters;
+  std::atomic<size_t> m_drops_owed{0};
+
+  // Producer-only state
+  std::deque<T> m_staging;
+  std::fstream m_spill;
+  std::vector<char> m_spill_buffer;
+  size_t m_spill_records = 0;
+  size_t m_spill_read_pos = 0;
+  size_t m_spill_write_pos = 0;
+};
+
+} // namespace utilities
+} // namespace daqling
+
+#endif // DAQLING_UTILITIES_OVERFLOWQUEUE_HPP
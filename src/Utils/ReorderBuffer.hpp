@@ -0,0 +1,187 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DAQLING_UTILITIES_REORDERBUFFER_HPP
+#define DAQLING_UTILITIES_REORDERBUFFER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/********************************
+ * ReorderBuffer
+ * Description: Releases items pushed in any order in the order of their keys (event numbers),
+ *   holding back at most `window` of them in a ring indexed by key modulo the window. Items
+ *   wait for a missing key until either
+ *   - an item with a key `window` or more ahead of it arrives (window by event count), or
+ *   - the gap has blocked the ring for `timeout`, if not 0 (window by time; see poll()).
+ *   The missing keys are then skipped. Items behind the released ones (late) are released at
+ *   once, out of order; items whose key is already held back (duplicates) are dropped. A key
+ *   more than a window behind or two windows ahead is taken as a restart of the numbering:
+ *   the held back items are released and ordering restarts from it.
+ *   Memory is allocated once, at construction. Not thread safe.
+ * Date: October 2026
+ *********************************/
+
+namespace daqling {
+namespace utilities {
+
+/// Counters of a ReorderBuffer. Owned by the user so that they may be registered as metrics
+/// before the buffer itself is created.
+struct ReorderCounters {
+  std::atomic<size_t> late = 0;      // Items released out of order, their key already passed.
+  std::atomic<size_t> duplicate = 0; // Items dropped, their key already held back.
+  std::atomic<size_t> skipped = 0;   // Keys given up waiting for.
+  std::atomic<size_t> restarts = 0;  // Discontinuities of the keys.
+  std::atomic<size_t> held = 0;      // Items currently held back.
+};
+
+template <class T> class ReorderBuffer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Config {
+    size_t window = 1024;
+    std::chrono::milliseconds timeout{}; // 0: wait for missing keys until the window is full.
+    ReorderCounters *counters = nullptr;
+  };
+
+  explicit ReorderBuffer(const Config &config)
+      : m_window(config.window != 0 ? config.window : 1), m_timeout(config.timeout),
+        m_counters(config.counters != nullptr ? *config.counters : m_own_counters), m_slots(m_window) {}
+
+  ReorderBuffer(const ReorderBuffer &) = delete;
+  ReorderBuffer &operator=(const ReorderBuffer &) = delete;
+
+  /// Items currently held back.
+  size_t size() const { return m_held; }
+
+  /// Adds `item` with `key`, calling `release(T &&)` for every item which is due, in order.
+  template <class Release> void push(uint64_t key, T &&item, Clock::time_point now, Release &&release) {
+    if (!m_started) {
+      m_started = true;
+      m_next = key;
+    }
+    int64_t ahead = static_cast<int64_t>(key - m_next);
+    if (ahead < 0 && static_cast<uint64_t>(-ahead) <= m_window) {
+      ++m_counters.late;
+      release(std::move(item));
+      return;
+    }
+    if (ahead < 0 || static_cast<uint64_t>(ahead) >= 2 * m_window) {
+      flush(release);
+      ++m_counters.restarts;
+      m_next = key;
+      ahead = 0;
+    }
+    // Make room: give up waiting for the keys falling out of the window.
+    while (static_cast<uint64_t>(ahead) >= m_window) {
+      advance(release);
+      --ahead;
+    }
+    Slot &slot = m_slots[key % m_window];
+    if (slot.item) {
+      ++m_counters.duplicate;
+      return;
+    }
+    slot.item.emplace(std::move(item));
+    ++m_held;
+    release_ready(release);
+    if (m_held != 0 && !m_blocked_since) {
+      m_blocked_since = now;
+    }
+    m_counters.held = m_held;
+  }
+
+  /// Skips the missing key blocking the ring if it was waited for longer than the timeout,
+  /// releasing the items which are then due. To be called periodically, e.g. while idle.
+  template <class Release> void poll(Clock::time_point now, Release &&release) {
+    if (m_held == 0 || m_timeout.count() == 0 || !m_blocked_since || now - *m_blocked_since < m_timeout) {
+      return;
+    }
+    while (!m_slots[m_next % m_window].item) {
+      ++m_counters.skipped;
+      ++m_next;
+    }
+    release_ready(release);
+    if (m_held != 0) {
+      m_blocked_since = now;
+    }
+    m_counters.held = m_held;
+  }
+
+  /// Releases all items held back, in order, skipping the missing keys.
+  template <class Release> void flush(Release &&release) {
+    while (m_held != 0) {
+      advance(release);
+    }
+    m_blocked_since.reset();
+    m_counters.held = 0;
+  }
+
+private:
+  struct Slot {
+    std::optional<T> item;
+  };
+
+  // Moves past the next key, releasing its item or giving up on it.
+  template <class Release> void advance(Release &release) {
+    Slot &slot = m_slots[m_next % m_window];
+    if (slot.item) {
+      take(slot, release);
+    } else {
+      ++m_counters.skipped;
+    }
+    ++m_next;
+  }
+
+  template <class Release> void release_ready(Release &release) {
+    bool released = false;
+    for (Slot *slot = &m_slots[m_next % m_window]; slot->item; slot = &m_slots[m_next % m_window]) {
+      take(*slot, release);
+      ++m_next;
+      released = true;
+    }
+    if (released) {
+      m_blocked_since.reset();
+    }
+  }
+
+  template <class Release> void take(Slot &slot, Release &release) {
+    T item(std::move(*slot.item));
+    slot.item.reset();
+    --m_held;
+    release(std::move(item));
+  }
+
+  const size_t m_window;
+  const std::chrono::milliseconds m_timeout;
+  ReorderCounters m_own_counters;
+  ReorderCounters &m_counters;
+  std::vector<Slot> m_slots;
+  size_t m_held = 0;
+  bool m_started = false;
+  uint64_t m_next = 0; // Key of the next item to be released.
+  std::optional<Clock::time_point> m_blocked_since;
+};
+
+} // namespace utilities
+} // namespace daqling
+
+#endif // DAQLING_UTILITIES_REORDERBUFFER_HPP
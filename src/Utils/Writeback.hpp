@@ -0,0 +1,242 @@
+/**
+ * Copyright (C) 2019-2021 CERN
+ *
+ * DAQling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DAQling is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DAQling. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DAQLING_UTILITIES_WRITEBACK_HPP
+#define DAQLING_UTILITIES_WRITEBACK_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+/********************************
+ * Writeback
+ * Description: Durability policy of a file writer, controlling when written data reaches the
+ *   disk instead of leaving it to bursts of kernel writeback:
+ *   - range_bytes:   every range_bytes written, writeback of the range is started with
+ *                    sync_file_range() and the previous range is waited for, so that at most
+ *                    two ranges of dirty pages are outstanding per file;
+ *   - sync_interval: open files are fdatasync()ed periodically on a background thread;
+ *   - sync_on_close: closed (rotated) files are fdatasync()ed on the background thread;
+ *   - drop_cache:    written back ranges and closed files are evicted from the page cache
+ *                    with posix_fadvise(POSIX_FADV_DONTNEED).
+ *   Latencies of the waits are reported in Stats for metrics. Files are tracked by the I/O
+ *   backends through Writeback::File. Thread safe.
+ * Date: October 2026
+ *********************************/
+
+namespace daqling {
+namespace utilities {
+
+class Writeback {
+public:
+  struct Policy {
+    size_t range_bytes = 0;                   // 0: no incremental writeback.
+    std::chrono::milliseconds sync_interval{}; // 0: no periodic fdatasync.
+    bool sync_on_close = false;
+    bool drop_cache = false;
+
+    bool enabled() const {
+      return range_bytes != 0 || sync_interval.count() != 0 || sync_on_close || drop_cache;
+    }
+  };
+
+  struct Stats {
+    std::atomic<size_t> range_latency_us = 0; // Of the last wait for a written range.
+    std::atomic<size_t> sync_latency_us = 0;  // Of the last fdatasync().
+  };
+
+  /// Writeback of one open file. `written()` is called by the writing thread only.
+  class File {
+  public:
+    File() = default;
+    File(const File &) = delete;
+    File &operator=(const File &) = delete;
+    ~File() { close(); }
+
+    /// Starts tracking `fd`, of which the first `size` bytes are already written.
+    void open(Writeback *writeback, int fd, uint64_t size) {
+      close();
+      if (writeback == nullptr || !writeback->m_policy.enabled()) {
+        return;
+      }
+      m_writeback = writeback;
+      m_fd = fd;
+      m_started = m_waited = size;
+      if (writeback->m_background) {
+        m_dup = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (m_dup >= 0) {
+          writeback->add(m_dup);
+        }
+      }
+    }
+
+    /// Reports that the file is written up to `end`.
+    void written(uint64_t end) {
+      if (m_writeback == nullptr || m_writeback->m_policy.range_bytes == 0 ||
+          end - m_started < m_writeback->m_policy.range_bytes) {
+        return;
+      }
+      ::sync_file_range(m_fd, static_cast<off_t>(m_started), static_cast<off_t>(end - m_started),
+                        SYNC_FILE_RANGE_WRITE);
+      if (m_started != m_waited) {
+        const auto start = std::chrono::steady_clock::now();
+        ::sync_file_range(m_fd, static_cast<off_t>(m_waited), static_cast<off_t>(m_started - m_waited),
+                          SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        m_writeback->report(m_writeback->m_stats.range_latency_us, start);
+        if (m_writeback->m_policy.drop_cache) {
+          ::posix_fadvise(m_fd, static_cast<off_t>(m_waited), static_cast<off_t>(m_started - m_waited),
+                          POSIX_FADV_DONTNEED);
+        }
+        m_waited = m_started;
+      }
+      m_started = end;
+    }
+
+    /// Stops tracking the file before its descriptor is closed. The rest is completed in the
+    /// background.
+    void close() {
+      if (m_dup >= 0) {
+        m_writeback->remove(m_dup);
+      }
+      m_writeback = nullptr;
+      m_fd = m_dup = -1;
+    }
+
+  private:
+    Writeback *m_writeback = nullptr;
+    int m_fd = -1;
+    int m_dup = -1;          // Owned by the background thread once registered.
+    uint64_t m_started = 0;  // End of the range whose writeback was started.
+    uint64_t m_waited = 0;   // End of the range written back.
+  };
+
+  Writeback(Policy policy, Stats *stats)
+      : m_policy(policy), m_stats(stats != nullptr ? *stats : m_own_stats),
+        m_background(policy.sync_interval.count() != 0 || policy.sync_on_close || policy.drop_cache) {
+    if (m_background) {
+      m_thread = std::thread(&Writeback::thread_worker, this);
+    }
+  }
+
+  ~Writeback() {
+    if (m_thread.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_quit = true;
+      }
+      m_cv.notify_all();
+      m_thread.join();
+    }
+  }
+
+  Writeback(const Writeback &) = delete;
+  Writeback &operator=(const Writeback &) = delete;
+
+  const Policy &policy() const { return m_policy; }
+
+private:
+  void add(int fd) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_open.insert(fd);
+  }
+
+  void remove(int fd) {
+    {
+      std::lock_guard<std::mutex> lock(m_mtx);
+      m_open.erase(fd);
+      m_closed.push_back(fd);
+    }
+    m_cv.notify_all();
+  }
+
+  void report(std::atomic<size_t> &latency_us, std::chrono::steady_clock::time_point start) {
+    latency_us = static_cast<size_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start)
+            .count());
+  }
+
+  void sync(int fd) {
+    const auto start = std::chrono::steady_clock::now();
+    ::fdatasync(fd);
+    report(m_stats.sync_latency_us, start);
+  }
+
+  void thread_worker() {
+    auto next_sync = std::chrono::steady_clock::now() + m_policy.sync_interval;
+    std::unique_lock<std::mutex> lock(m_mtx);
+    while (!m_quit || !m_closed.empty()) {
+      const auto woken = [&]() { return m_quit || !m_closed.empty(); };
+      if (m_policy.sync_interval.count() != 0) {
+        m_cv.wait_until(lock, next_sync, woken);
+      } else {
+        m_cv.wait(lock, woken);
+      }
+      // Closed files: final sync and eviction.
+      while (!m_closed.empty()) {
+        const int fd = m_closed.front();
+        m_closed.pop_front();
+        lock.unlock();
+        if (m_policy.sync_on_close) {
+          sync(fd);
+        }
+        if (m_policy.drop_cache) {
+          // Only clean pages are dropped; write the rest back first.
+          ::sync_file_range(fd, 0, 0,
+                            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+          ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+        ::close(fd);
+        lock.lock();
+      }
+      // Open files: periodic sync. Descriptors are only closed by this thread, above.
+      if (m_policy.sync_interval.count() != 0 && std::chrono::steady_clock::now() >= next_sync) {
+        const std::vector<int> open(m_open.begin(), m_open.end());
+        lock.unlock();
+        for (const int fd : open) {
+          sync(fd);
+        }
+        lock.lock();
+        next_sync = std::chrono::steady_clock::now() + m_policy.sync_interval;
+      }
+    }
+  }
+
+  const Policy m_policy;
+  Stats m_own_stats;
+  Stats &m_stats;
+  const bool m_background;
+
+  std::mutex m_mtx;
+  std::condition_variable m_cv;
+  std::set<int> m_open;     // Duplicated descriptors of open files.
+  std::deque<int> m_closed; // Duplicated descriptors of closed files, to be completed.
+  bool m_quit = false;
+  std::thread m_thread;
+};
+
+} // namespace utilities
+} // namespace daqling
+
+#endif // DAQLING_UTILITIES_WRITEBACK_HPP
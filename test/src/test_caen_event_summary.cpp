@@ -0,0 +1,85 @@
+#include "Common/CaenEventSummary.hpp"
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Compares the vectorized reductions with plain loops, for all lengths around the vector width.
+static void check_reductions() {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> sample(0, 65535);
+  for (std::size_t n = 1; n < 70; ++n) {
+    std::vector<uint16_t> ys(n);
+    for (auto &y : ys) {
+      y = static_cast<uint16_t>(sample(rng));
+    }
+    const auto rec = caen_summarize(3, ys.data(), ys.size(), 0, 4);
+    uint16_t min = UINT16_MAX, max = 0;
+    uint64_t sum = 0;
+    for (auto y : ys) {
+      min = std::min(min, y);
+      max = std::max(max, y);
+      sum += y;
+    }
+    assert(rec.channel == 3 && rec.samples == n);
+    assert(rec.min == min && rec.max == max && rec.sum == sum);
+    assert(ys[rec.argmax] == max);
+    assert(std::find(ys.begin(), ys.end(), max) - ys.begin() == rec.argmax);
+    assert(((rec.flags & caen_event_summary_record::BaselineTruncated) != 0) == (n < 4));
+  }
+  // Long waveforms of extreme values, which would overflow 32-bit sums.
+  std::vector<uint16_t> high(1 << 18, 65535);
+  high[12345] = 0;
+  auto rec = caen_summarize(0, high.data(), high.size(), 0, 4);
+  assert(rec.sum == uint64_t{65535} * (high.size() - 1));
+  assert(rec.min == 0 && rec.max == 65535 && rec.argmax == 0);
+}
+
+static void check_baseline() {
+  const std::vector<uint16_t> ys = {100, 102, 98, 100, 500, 900, 300};
+  auto rec = caen_summarize(0, ys.data(), ys.size(), 0, 4);
+  assert(rec.flags == 0);
+  assert(std::fabs(rec.baseline_mean - 100.f) < 1e-6f);
+  assert(std::fabs(rec.baseline_rms - std::sqrt(2.f)) < 1e-6f);
+  assert(rec.argmax == 5);
+  rec = caen_summarize(0, ys.data(), ys.size(), 5, 4);
+  assert(rec.flags == caen_event_summary_record::BaselineTruncated);
+  assert(std::fabs(rec.baseline_mean - 600.f) < 1e-6f);
+  rec = caen_summarize(0, ys.data(), 0, 0, 4);
+  assert(rec.flags == caen_event_summary_record::Empty && rec.samples == 0);
+}
+
+static void check_file() {
+  const std::string filename = "test_caen_event_summary.dat";
+  caen_event_summary summary(2, 3);
+  const std::vector<uint16_t> ys = {1, 2, 3, 4, 5, 6};
+  for (uint64_t ev = 0; ev < 5; ++ev) {
+    summary.add(ev, 1000 + ev, 0, ys.data(), ys.size());
+    summary.add(ev, 1000 + ev, 1, ys.data(), ys.size() - ev);
+  }
+  {
+    std::ofstream out(filename + ".sum", std::ios::binary | std::ios::trunc);
+    summary.write(out);
+  }
+  auto read = caen_event_summary::read(filename);
+  assert(read.has_value());
+  assert(read->baseline_start == 2 && read->baseline_samples == 3);
+  assert(read->records.size() == 10);
+  assert(read->records[9].event_number == 4 && read->records[9].channel == 1);
+  assert(read->records[9].samples == 2 && read->records[9].max == 2);
+  assert(read->records[9].flags == caen_event_summary_record::BaselineTruncated);
+  std::remove((filename + ".sum").c_str());
+
+  // No sidecar
+  assert(!caen_event_summary::read(filename).has_value());
+}
+
+int main(int /*unused*/, char * /*unused*/ []) {
+  static_assert(sizeof(caen_event_summary_record) == 48, "fixed-width records");
+  check_reductions();
+  check_baseline();
+  check_file();
+}
@@ -0,0 +1,69 @@
+#include "Common/CaenFileIndex.hpp"
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+static void write_file(const std::string &filename, bool footer) {
+  caen_file_index index;
+  std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+  for (uint64_t ev = 10; ev < 20; ++ev) {
+    const std::string record = "event" + std::to_string(ev) + ";";
+    out << record;
+    index.add(ev, 1000 + 10 * ev, record.size());
+  }
+  if (footer) {
+    index.write(out);
+  } else {
+    std::ofstream sidecar(filename + ".idx", std::ios::binary | std::ios::trunc);
+    index.write(sidecar);
+  }
+}
+
+static void check_file(const std::string &filename) {
+  auto index = caen_file_index::read(filename);
+  assert(index.has_value());
+  assert(index->entries.size() == 10 && index->timestamps_sorted);
+  assert(index->timestamp_min == 1100 && index->timestamp_max == 1190);
+  assert(!index->find_event(9).has_value());
+  assert(!index->find_event(20).has_value());
+
+  std::ifstream in(filename, std::ios::binary);
+  std::string record;
+  assert(index->seek_event(in, 15));
+  std::getline(in, record, ';');
+  assert(record == "event15");
+  assert(index->seek_timestamp(in, 1171)); // first event at or after is 18
+  std::getline(in, record, ';');
+  assert(record == "event18");
+  assert(!index->seek_timestamp(in, 1191));
+}
+
+// Out of order timestamps are searched in file order.
+static void check_unordered() {
+  caen_file_index index;
+  for (uint64_t ts : {100, 300, 200, 400}) {
+    index.add(ts, ts, 10);
+  }
+  assert(!index.timestamps_sorted);
+  assert(index.find_timestamp(150)->event_number == 300);
+  assert(index.find_timestamp(400)->event_number == 400);
+  assert(!index.find_timestamp(401).has_value());
+}
+
+int main(int /*unused*/, char * /*unused*/ []) {
+  const std::string with_footer = "test_caen_file_index.bin";
+  const std::string with_sidecar = "test_caen_file_index.txt";
+  write_file(with_footer, true);
+  write_file(with_sidecar, false);
+  check_file(with_footer);
+  check_file(with_sidecar);
+  std::remove(with_footer.c_str());
+  std::remove(with_sidecar.c_str());
+  std::remove((with_sidecar + ".idx").c_str());
+
+  check_unordered();
+
+  // Not an indexed file
+  assert(!caen_file_index::read("test_caen_file_index.missing").has_value());
+}
@@ -0,0 +1,67 @@
+#include "Modules/CaenPedestal/PedestalSubtraction.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Compares the vectorized subtractions with the scalar formulas of their tail loops, for all
+// lengths around the vector width and pedestals and offsets at the ends of the range.
+static void check_subtraction() {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> sample(0, 65535);
+  const std::vector<uint16_t> values = {0, 1, 100, 32767, 32768, 65534, 65535};
+  for (std::size_t n = 0; n < 40; ++n) {
+    std::vector<uint16_t> ys(n);
+    for (auto &y : ys) {
+      y = static_cast<uint16_t>(sample(rng));
+    }
+    for (uint16_t pedestal : values) {
+      for (uint16_t offset : values) {
+        auto out = ys;
+        CaenPedestalTracker::subtract_unsigned(out.data(), out.size(), pedestal, offset);
+        for (std::size_t i = 0; i != n; ++i) {
+          const int expected = std::max(std::min(int{ys[i]} + offset, 65535) - pedestal, 0);
+          assert(out[i] == expected);
+        }
+      }
+      auto out = ys;
+      CaenPedestalTracker::subtract_signed(out.data(), out.size(), pedestal);
+      for (std::size_t i = 0; i != n; ++i) {
+        const int expected = std::clamp(int{ys[i]} - pedestal, -32768, 32767);
+        assert(static_cast<int16_t>(out[i]) == expected);
+      }
+    }
+  }
+}
+
+static void check_tracking() {
+  CaenPedestalTracker::Config config;
+  config.window_samples = 4;
+  config.alpha = 0.5;
+  CaenPedestalTracker tracker(config);
+  std::vector<uint16_t> ys = {100, 100, 100, 100, 500};
+  auto state = tracker.process(2, ys.data(), ys.size());
+  assert(state.initialized && state.pedestal == 100 && state.first == 100);
+  assert(ys[0] == 0 && ys[4] == 400);
+  // Half way to the new window mean.
+  ys = {200, 200, 200, 200, 300};
+  state = tracker.process(2, ys.data(), ys.size());
+  assert(std::fabs(state.pedestal - 150) < 1e-9 && state.first == 100);
+  assert(ys[0] == 50 && ys[4] == 150);
+  // No samples in the window: left as is.
+  ys.clear();
+  tracker.process(7, ys.data(), 0);
+  assert(!tracker.channels()[7].initialized);
+
+  config.mode = CaenPedestalTracker::Mode::Median;
+  CaenPedestalTracker median(config);
+  ys = {100, 4000, 102, 98, 500};
+  state = median.process(0, ys.data(), ys.size());
+  assert(state.pedestal == 102);
+}
+
+int main(int /*unused*/, char * /*unused*/ []) {
+  check_subtraction();
+  check_tracking();
+}
@@ -0,0 +1,84 @@
+#include "Common/CaenFeatureFormat.hpp"
+#include "Common/CaenHitFinder.hpp"
+#include <cassert>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Compares the vectorized hit finding with a plain loop, for all lengths around the vector width.
+static void check_hits() {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> sample(0, 65535);
+  std::vector<caen_sample_range> runs;
+  for (std::size_t n = 0; n < 70; ++n) {
+    for (int round = 0; round != 20; ++round) {
+      std::vector<uint16_t> ys(n);
+      for (auto &y : ys) {
+        // Mostly in the band, with runs out of it on both sides and at the extremes.
+        const int r = sample(rng);
+        y = static_cast<uint16_t>(r % 4 != 0 ? 1000 + r % 100 : r);
+      }
+      const uint16_t low = 990, high = 1089;
+      caen_find_hits(ys.data(), ys.size(), low, high, runs);
+      std::vector<caen_sample_range> expected;
+      for (std::size_t i = 0; i != n; ++i) {
+        if (ys[i] > high || ys[i] < low) {
+          if (!expected.empty() && expected.back().end == i) {
+            ++expected.back().end;
+          } else {
+            expected.push_back({static_cast<uint32_t>(i), static_cast<uint32_t>(i + 1)});
+          }
+        }
+      }
+      assert(runs.size() == expected.size());
+      for (std::size_t i = 0; i != runs.size(); ++i) {
+        assert(runs[i].begin == expected[i].begin && runs[i].end == expected[i].end);
+      }
+    }
+  }
+}
+
+static void check_padding() {
+  const std::vector<caen_sample_range> runs = {{1, 3}, {6, 7}, {12, 14}, {18, 20}, {25, 26}};
+  std::vector<caen_sample_range> kept;
+  caen_pad_hits(runs, 27, 2, 2, kept);
+  // Clamped to the samples; runs overlapping or touching once padded are merged.
+  assert(kept.size() == 3);
+  assert(kept[0].begin == 0 && kept[0].end == 9);
+  assert(kept[1].begin == 10 && kept[1].end == 22);
+  assert(kept[2].begin == 23 && kept[2].end == 27);
+}
+
+static void check_serialization() {
+  caen_feature_data features;
+  features.event_number = 42;
+  features.timestamp = 123456789;
+  features.device = "digitizer";
+  for (uint16_t ch = 0; ch != 3; ++ch) {
+    caen_pulse_record rec{};
+    rec.channel = ch;
+    rec.flags = caen_pulse_record::Saturated;
+    rec.peak = 100u + ch;
+    rec.amplitude = 10.5f * ch;
+    rec.time = 99.25f;
+    features.pulses.push_back(rec);
+  }
+  assert(features.serialize());
+  caen_feature_data copy;
+  assert(copy.deserialize(features.data(), features.size()));
+  assert(copy.event_number == 42 && copy.timestamp == 123456789 && copy.device == "digitizer");
+  assert(copy.pulses.size() == 3);
+  assert(std::memcmp(copy.pulses.data(), features.pulses.data(), 3 * sizeof(caen_pulse_record)) == 0);
+
+  // No pulses: the header only.
+  features.pulses.clear();
+  assert(features.serialize());
+  assert(copy.deserialize(features.data(), features.size()));
+  assert(copy.pulses.empty() && copy.event_number == 42);
+}
+
+int main(int /*unused*/, char * /*unused*/ []) {
+  check_hits();
+  check_padding();
+  check_serialization();
+}
@@ -0,0 +1,87 @@
+#include "Common/DataType.hpp"
+#include "Utils/Binary.hpp"
+#include "Utils/GatherWriter.hpp"
+#include "Utils/IoBackend.hpp"
+#include "Utils/Writeback.hpp"
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using daqling::utilities::Binary;
+using daqling::utilities::IoBackend;
+using daqling::utilities::Writeback;
+using Writer = daqling::utilities::GatherWriter<SharedDataType<Binary>>;
+
+static std::string read_file(const std::string &name) {
+  std::ifstream in(name, std::ios::binary);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+int main(int /*unused*/, char * /*unused*/ []) {
+  const std::string first = "test_gather_writer.0";
+  const std::string second = "test_gather_writer.1";
+  // Durability policy with incremental writeback and background sync of closed files
+  Writeback::Policy policy;
+  policy.range_bytes = 4096;
+  policy.sync_interval = std::chrono::milliseconds(1);
+  policy.sync_on_close = true;
+  policy.drop_cache = true;
+  Writeback::Stats stats;
+  auto writeback = std::make_shared<Writeback>(policy, &stats);
+
+  // Every backend, with buffers smaller than the data, with and without the policy
+  for (auto kind : {IoBackend::Kind::Buffered, IoBackend::Kind::Direct, IoBackend::Kind::Uring}) {
+    for (bool durable : {false, true}) {
+      IoBackend::Config config;
+      config.kind = kind;
+      config.buffer_size = 4096;
+      config.queue_depth = 2;
+      config = IoBackend::available(config);
+      if (durable) {
+        config.writeback = writeback;
+      }
+      std::string expected;
+      {
+        Writer writer(IoBackend::create(config));
+        writer.open(first);
+        // More payloads than fit in a single pwritev() call
+        for (size_t i = 0; i < 3000; ++i) {
+          const std::string bytes(i % 7 + 1, static_cast<char>('a' + i % 26));
+          expected += bytes;
+          writer.append(SharedDataType<Binary>(bytes.data(), bytes.size()));
+        }
+        writer.append(SharedDataType<Binary>()); // empty payloads are skipped
+        assert(writer.pending() == expected.size());
+
+        // Split within a payload, the rest goes to the next file
+        assert(writer.write(5001) == 5001);
+        assert(writer.offset() == 5001);
+        if (durable) {
+          writer.open(second);
+        } else { // Switch to a file opened elsewhere
+          auto next = IoBackend::create(config);
+          next->open(second, false);
+          writer.swap(std::move(next))->close();
+        }
+        assert(writer.offset() == 0);
+        assert(writer.write() == expected.size() - 5001);
+        assert(writer.pending() == 0);
+        writer.close();
+      }
+      assert(read_file(first) == expected.substr(0, 5001));
+      assert(read_file(second) == expected.substr(5001));
+      std::remove(first.c_str());
+      std::remove(second.c_str());
+    }
+  }
+
+  writeback.reset(); // Completes the closed files.
+
+  std::puts("test_gather_writer: OK");
+  return 0;
+}
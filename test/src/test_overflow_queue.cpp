@@ -0,0 +1,85 @@
+#include "Common/DataType.hpp"
+#include "Utils/Binary.hpp"
+#include "Utils/OverflowQueue.hpp"
+#include <cassert>
+#include <cstdio>
+#include <string>
+
+using daqling::utilities::Binary;
+using daqling::utilities::OverflowCounters;
+using Queue = daqling::utilities::OverflowQueue<SharedDataType<Binary>>;
+
+static SharedDataType<Binary> make_payload(uint8_t value) {
+  return SharedDataType<Binary>(&value, sizeof(value));
+}
+
+static uint8_t pop_value(Queue &q) {
+  auto *payload = q.frontPtr();
+  assert(payload != nullptr);
+  uint8_t value = *payload->data<uint8_t *>();
+  q.popFront();
+  return value;
+}
+
+int main(int /*unused*/, char * /*unused*/ []) {
+  std::atomic<bool> run{true};
+
+  // DropNewest keeps what is already queued
+  {
+    OverflowCounters counters;
+    Queue q({2, Queue::Policy::DropNewest, "", SIZE_MAX, &counters});
+    for (uint8_t i = 0; i < 4; ++i) {
+      q.push(make_payload(i), run);
+    }
+    assert(counters.dropped_newest == 2);
+    assert(pop_value(q) == 0);
+    assert(pop_value(q) == 1);
+    assert(q.isEmpty());
+  }
+
+  // DropOldest keeps the newest payloads, in order
+  {
+    OverflowCounters counters;
+    Queue q({2, Queue::Policy::DropOldest, "", SIZE_MAX, &counters});
+    for (uint8_t i = 0; i < 5; ++i) {
+      q.push(make_payload(i), run);
+    }
+    assert(q.frontPtr() == nullptr); // both queued payloads are dropped
+    q.service();
+    assert(pop_value(q) == 3);
+    assert(pop_value(q) == 4);
+    assert(q.isEmpty());
+    assert(counters.dropped_oldest == 3);
+  }
+
+  // Spill loses nothing and preserves the order
+  {
+    OverflowCounters counters;
+    const std::string spill_file = "test_overflow_queue.spill";
+    {
+      Queue q({2, Queue::Policy::Spill, spill_file, SIZE_MAX, &counters});
+      for (uint8_t i = 0; i < 6; ++i) {
+        q.push(make_payload(i), run);
+      }
+      assert(counters.spilled == 4);
+      for (uint8_t i = 0; i < 6; ++i) {
+        q.service();
+        assert(pop_value(q) == i);
+      }
+      assert(q.isEmpty());
+      assert(counters.unspilled == 4);
+      assert(counters.spill_bytes == 0);
+    }
+    assert(std::fopen(spill_file.c_str(), "r") == nullptr);
+  }
+
+  // Block gives up once the run is stopped
+  {
+    OverflowCounters counters;
+    Queue q({1, Queue::Policy::Block, "", SIZE_MAX, &counters});
+    assert(q.push(make_payload(0), run));
+    run = false;
+    assert(!q.push(make_payload(1), run));
+    assert(counters.dropped_newest == 1);
+  }
+}
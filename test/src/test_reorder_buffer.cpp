@@ -0,0 +1,68 @@
+#include "Utils/ReorderBuffer.hpp"
+#include <cassert>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+using daqling::utilities::ReorderCounters;
+using Buffer = daqling::utilities::ReorderBuffer<std::unique_ptr<uint64_t>>;
+using namespace std::chrono_literals;
+
+int main(int /*unused*/, char * /*unused*/ []) {
+  std::vector<uint64_t> out;
+  const auto release = [&out](std::unique_ptr<uint64_t> &&item) { out.push_back(*item); };
+  const auto t0 = Buffer::Clock::now();
+  const auto push = [&](Buffer &buffer, uint64_t key, Buffer::Clock::time_point now) {
+    buffer.push(key, std::make_unique<uint64_t>(key), now, release);
+  };
+
+  // Shuffled keys within the window are released in order
+  {
+    ReorderCounters counters;
+    Buffer buffer({4, 0ms, &counters});
+    for (uint64_t key : {10, 12, 11, 14, 13, 15}) {
+      push(buffer, key, t0);
+    }
+    assert((out == std::vector<uint64_t>{10, 11, 12, 13, 14, 15}));
+    assert(buffer.size() == 0 && counters.held == 0);
+    // Late and duplicate keys
+    push(buffer, 12, t0);
+    push(buffer, 17, t0);
+    push(buffer, 17, t0);
+    assert(counters.late == 1 && counters.duplicate == 1);
+    assert(out.back() == 12 && buffer.size() == 1);
+    // A key a window ahead of the missing one gives up on it
+    push(buffer, 20, t0);
+    assert(counters.skipped == 1 && out.back() == 17 && buffer.size() == 1);
+    buffer.flush(release);
+    assert(out.back() == 20 && counters.skipped == 3);
+  }
+
+  // Gap timeout
+  out.clear();
+  {
+    ReorderCounters counters;
+    Buffer buffer({8, 10ms, &counters});
+    push(buffer, 0, t0);
+    push(buffer, 2, t0);
+    push(buffer, 3, t0 + 5ms);
+    buffer.poll(t0 + 9ms, release);
+    assert((out == std::vector<uint64_t>{0}));
+    buffer.poll(t0 + 10ms, release);
+    assert((out == std::vector<uint64_t>{0, 2, 3}));
+    assert(counters.skipped == 1 && buffer.size() == 0);
+  }
+
+  // Restart of the numbering
+  out.clear();
+  {
+    ReorderCounters counters;
+    Buffer buffer({4, 0ms, &counters});
+    push(buffer, 1000, t0);
+    push(buffer, 1002, t0);
+    push(buffer, 0, t0);
+    push(buffer, 1, t0);
+    assert((out == std::vector<uint64_t>{1000, 1002, 0, 1}));
+    assert(counters.restarts == 1);
+  }
+}